@@ -0,0 +1,100 @@
+#ifndef BINARY_CONNECTION_H
+#define BINARY_CONNECTION_H
+
+#include <stdint.h>
+#include "connection.h"
+#include "kvs_handler.h"
+
+/*
+    二进制协议帧，请求和响应使用同一个定长头部（网络字节序），头部之后紧跟 key 和 value 的原始字节
+
+    | magic 1 | opcode 1 | engine 1 | flags/status 1 | key_len 2 | reserved 2 | value_len 4 | request_id 8 |
+
+    - 请求的 magic 为 BIN_MAGIC_REQUEST，flags 为 BIN_FLAG_*；响应的 magic 为 BIN_MAGIC_RESPONSE，该字节为状态码
+    - 响应原样带回请求的 opcode、engine 和 request_id，客户端按 request_id 匹配响应，
+      一个连接上可以同时有多个未完成的请求，不依赖响应的顺序
+    - GET 的响应中 value 为取到的值，其他响应没有 key 和 value
+*/
+struct BinaryHeader {
+    uint8_t magic;
+    uint8_t opcode;         // BIN_OP_*
+    uint8_t engine;         // BIN_ENGINE_*
+    uint8_t flags;          // 请求：BIN_FLAG_*，响应：BIN_STATUS_* / KVS_STATUS_*
+    uint16_t key_len;
+    uint16_t reserved;
+    uint32_t value_len;
+    uint64_t request_id;
+};
+
+enum {
+    BIN_HEADER_SIZE = 20,
+    BIN_MAGIC_REQUEST = 0xB0,
+    BIN_MAGIC_RESPONSE = 0xB1,
+};
+
+// 操作码与 KVS_OP_* 一致，另外有不访问引擎的 NOOP（探活、测量往返时延）
+enum {
+    BIN_OP_SET = KVS_OP_SET,
+    BIN_OP_GET = KVS_OP_GET,
+    BIN_OP_DEL = KVS_OP_DEL,
+    BIN_OP_MOD = KVS_OP_MOD,
+    BIN_OP_EXIST = KVS_OP_EXIST,
+    BIN_OP_NOOP = 0x10,
+};
+
+enum {
+    BIN_ENGINE_ARRAY = 0,
+    BIN_ENGINE_RBTREE,
+    BIN_ENGINE_HASH,
+    BIN_ENGINE_COUNT,
+};
+
+enum {
+    BIN_FLAG_QUIET = 0x01,      // 执行成功时不回复（批量写入），失败时仍然回复
+};
+
+// 响应状态码：0-5 为 KVS_STATUS_*，以下为协议层的错误
+enum {
+    BIN_STATUS_BAD_REQUEST = 0x80,  // 操作码或引擎不合法
+    BIN_STATUS_BUSY = 0x81,         // 服务器过载，请求没有执行，可以重试
+};
+
+/*
+    二进制协议连接，面向服务之间的低延迟调用
+    - 解析器直接在读缓冲区上工作，key 和 value 不拷贝，按长度传给引擎，可以包含任意字节
+    - 一次处理读缓冲区中所有完整的请求帧
+*/
+class BinaryConnection : public Connection {
+public:
+    BinaryConnection();
+    ~BinaryConnection();
+
+    void process();                             // 执行读缓冲区中所有完整的请求帧
+    void rejectOverloaded(int retry_after_s);   // 服务器过载，对每个完整的请求回复 BIN_STATUS_BUSY
+    int requestLane() const;                    // 按第一个请求帧的操作码分类
+    bool routingKey(const char** key, size_t* len) const;   // 第一个请求帧的 key
+
+    static void decodeHeader(const char* data, BinaryHeader* header);
+    static void encodeHeader(const BinaryHeader& header, char* data);
+
+    /*
+        检查 [p, end) 开头的请求帧
+        @return 帧的总长度，0 表示不完整（need 为需要的总字节数），-1 表示协议错误
+    */
+    static long frameLength(const char* p, const char* end, BinaryHeader* header, size_t* need);
+
+    // 执行一个请求，响应追加到 out，也供其他承载二进制帧的协议（WebSocket）使用
+    static void executeRequest(const BinaryHeader& request, const char* key, const char* value, ChainBuffer* out);
+    static void appendResponse(ChainBuffer* out, const BinaryHeader& request, int status,
+        const char* value, size_t value_len);
+
+protected:
+    void init();
+    bool onWriteComplete();
+    int protocolState() const;
+
+private:
+    bool m_close_after_write;   // 协议错误，回复发送完后关闭连接
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <sys/uio.h>
+
+/*
+    缓冲区块：块头和数据区在同一次分配中，数据区紧跟在块头之后
+    - [start, end) 为可读数据，[end, cap) 为可写空间
+*/
+struct BufferBlock {
+    BufferBlock* next;  // 链中的下一个块
+    size_t cap;         // 数据区容量
+    size_t start;       // 可读数据的起始位置（之前的数据已经被消费）
+    size_t end;         // 可读数据的结束位置
+    int node;           // 分配时所在的 NUMA 节点缓存，归还时回到同一个节点的空闲链表
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    size_t readable() const { return this->end - this->start; }
+    size_t writable() const { return this->cap - this->end; }
+};
+
+/*
+    全局缓冲区块池，按容量分级缓存空闲块
+    - 4KB、16KB、64KB、256KB、1MB 五个等级，归还的块挂回对应等级的空闲链表
+    - 超过 1MB 的块直接向系统申请，归还时直接释放，不进入缓存
+    - 每个等级缓存的块数有上限，空闲块过多时直接释放
+    - 空闲链表按 NUMA 节点分开：线程从自己所在节点的链表申请，块归还到分配它的节点，
+      绑核模式下连接的缓冲区始终在处理它的线程所在的节点上
+*/
+class BufferPool {
+public:
+    static const size_t MIN_BLOCK_SIZE = 4096;          // 最小块（含块头）
+    static const size_t MAX_POOLED_BLOCK_SIZE = 1 << 20;    // 可缓存的最大块（含块头）
+    static const int MAX_NODES = 8;                     // 区分的 NUMA 节点数，更多的节点取模共用
+
+    // 申请一个数据区容量不小于 min_cap 的块
+    static BufferBlock* acquire(size_t min_cap);
+
+    // 归还块
+    static void release(BufferBlock* block);
+
+    // 当前缓存的空闲块占用的字节数
+    static size_t cachedBytes();
+
+    // 设置调用线程所在的 NUMA 节点，之后该线程申请的块来自这个节点的空闲链表
+    static void setThreadNode(int node);
+};
+
+/*
+    链式缓冲区，由若干个池化的块串成单链表
+    - 追加数据时尾块写满就从池中补一个新块，块的大小随已有数据量倍增（上限 1MB），不需要搬移旧数据
+    - 被消费的块立即归还到池中，clear() 之后不持有任何块
+    - 需要连续内存的场景（HTTP 解析）调用 linearize() 整理成一块
+*/
+class ChainBuffer {
+private:
+    BufferBlock* m_head;    // 头块
+    BufferBlock* m_tail;    // 尾块
+    size_t m_size;          // 可读数据的总字节数
+
+    BufferBlock* grow(size_t min_cap);      // 在链尾追加一个新块
+
+public:
+    ChainBuffer();
+    ~ChainBuffer();
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+    size_t size() const { return this->m_size; }
+    bool empty() const { return this->m_size == 0; }
+    bool hasBlocks() const { return this->m_head != NULL; }
+
+    // 获取尾部可写空间（尾块写满时追加新块），写入后调用 commitWrite() 确认
+    char* prepareWrite(size_t* avail);
+    void commitWrite(size_t len);
+
+    bool append(const char* data, size_t len);              // 追加数据
+    bool appendFormat(const char* format, ...);             // 格式化追加
+    bool vappendFormat(const char* format, va_list args);
+    bool appendDecimal(unsigned long long value);           // 追加十进制整数，不经过 vsnprintf
+    void appendChain(ChainBuffer& other);                   // 把 other 的块整体挂到链尾，不拷贝数据
+
+    int peekIovec(struct iovec* iov, int max_iov) const;    // 将可读数据填充为分散写的 iovec 数组
+    void consume(size_t len);                               // 丢弃头部 len 字节，读空的块归还到池中
+
+    /*
+        把全部可读数据整理到一个连续块中，并保证数据之后至少还有 reserve 字节可写空间
+        数据已经连续且空间足够时不搬移，返回连续数据的起始地址
+    */
+    char* linearize(size_t reserve = 1);
+
+    void clear();           // 归还全部块
+};
+
+// 把整数格式化为十进制写到 out（至少 20 字节），每次处理两位数字，返回长度，不写结束符
+size_t formatDecimal(char* out, unsigned long long value);
+
+#endif
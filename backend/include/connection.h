@@ -0,0 +1,160 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <atomic>
+#include "buffer.h"
+
+/*
+    请求的优先级通道，主线程读取到请求之后按请求首行（命令名、操作码）分类
+    - 读：点查询（GET、EXIST）、静态文件和 PING 等很便宜的请求，对延迟敏感
+    - 写：SET/DEL/MOD、批量命令、WebSocket 帧，以及无法分类的请求
+    - 管理：统计信息、运行指标等后台请求
+*/
+enum RequestLane {
+    LANE_READ = 0,
+    LANE_WRITE,
+    LANE_ADMIN,
+    LANE_COUNT,
+};
+
+/*
+    与协议无关的客户端连接
+    - 管理 socket、epoll 注册和读写缓冲区，主线程负责 read()，工作线程调用 process()
+    - process() 生成响应后直接在工作线程中 flush()，只有 TCP 写缓冲区满时才等待 EPOLLOUT 由主线程 write()
+    - 每种协议（HTTP、RESP 等）继承这个类，实现请求解析、处理和过载时的拒绝响应
+    - 连接对象只能由主线程关闭和回收，工作线程需要关闭连接时调用 shutdownConnection()
+    - 重新注册 epoll 事件统一通过 rearm()，之后没有线程持有连接，主线程可以用 claim() 取得所有权，
+      在没有客户端事件时主动推送数据（例如 WebSocket 的统计信息）
+*/
+class Connection {
+public:
+    static int m_epoll_fd;      // 所有客户端通信对应 socket 上的事件都被注册到同一个 epoll 对象中，所以设置成静态的
+    static int m_user_count;    // 统计客户端的数量
+
+    static const int MAX_REQUEST_SIZE = 16 * 1024 * 1024;   // 读缓冲区中未处理数据的最大字节数
+    static const int MAX_WRITE_IOV = 64;        // 一次 writev 最多提交的内存块数量
+
+protected:
+    int m_sockfd;               // 客户端连接对应的文件描述符
+    struct sockaddr_in m_client_addr;   // 客户端通信的 socket 地址
+    ChainBuffer m_read_buf;     // 读缓冲区，链式池化块，按需增长
+    ChainBuffer m_write_buf;    // 写缓冲区，发送完的块立即归还到池中
+
+    int bytes_to_send;          // 将要发送的数据的字节数
+    int bytes_have_send;        // 已经发送的字节数
+
+    std::atomic<bool> m_armed;          // 已经重新注册到 epoll，没有线程在处理这个连接
+    std::atomic<bool> m_push_enabled;   // 主线程定时调用 push() 推送数据
+
+public:
+    Connection();
+    virtual ~Connection();
+    void init(int sockfd, const sockaddr_in& client_addr);      // 初始化新接收的客户端连接
+    void closeConnection();     // 关闭客户端的连接，只能由主线程调用
+    void shutdownConnection();  // 工作线程请求关闭连接：关闭 socket 的读写，由主线程收到挂断事件后回收连接
+    bool read();                // 非阻塞读，把 TCP 读缓冲区的数据全部读到读缓冲区中
+    bool write();               // 主线程的非阻塞写，返回 false 时由主线程关闭连接
+
+    /*
+        工作线程生成响应之后直接发送，省去注册 EPOLLOUT 和主线程的一轮事件循环
+        发送完成后只注册一次 EPOLLIN；TCP 写缓冲区满时注册 EPOLLOUT，剩下的数据由主线程 write()
+        需要关闭连接时调用 shutdownConnection()，调用之后工作线程不能再访问该连接对象
+    */
+    void flush();
+
+    virtual void process() = 0;                         // 由工作线程调用，解析并处理读缓冲区中的请求
+    virtual void rejectOverloaded(int retry_after_s) = 0;   // 服务器过载，丢弃读到的请求，生成拒绝响应
+    // 客户端超出限流速率，默认与过载相同，HTTP 返回 429
+    virtual void rejectRateLimited(int retry_after_s) { this->rejectOverloaded(retry_after_s); }
+
+    /*
+        重新注册 EPOLLONESHOT 事件，调用之前必须完成对连接对象的所有访问
+        调用之后连接可能立即被主线程交给其他线程处理
+    */
+    void rearm(int events);
+
+    /*
+        主线程取得连接的所有权：收到连接上的事件时调用，或者在主动推送之前调用
+        返回 false 表示连接正在被处理（或者已经在处理的路上），不能访问
+    */
+    bool claim() { return this->m_armed.exchange(false, std::memory_order_acq_rel); }
+
+    size_t readBytes() const { return this->m_read_buf.size(); }   // 读缓冲区中未处理的字节数
+
+    /*
+        由主线程在 read() 之后调用，只查看读缓冲区第一个块中的请求首行，不解析整个请求
+        流水线中有多个请求时按第一个请求分类，默认为写通道
+    */
+    virtual int requestLane() const { return LANE_WRITE; }
+
+    /*
+        shared-nothing 模式下由主线程在投递之前调用，同样只查看读缓冲区的第一个块：
+        取出第一个请求的第一个 key，请求投递给拥有这个 key 的分区的工作线程，命令不需要转发
+        看不出 key（分块到达、批量请求的 key 不在第一个块中、WebSocket 帧等）时返回 false
+    */
+    virtual bool routingKey(const char** key, size_t* len) const { (void)key; (void)len; return false; }
+
+    bool pushEnabled() const { return this->m_push_enabled.load(std::memory_order_relaxed); }
+
+    // 没有线程在处理这个连接（等待事件，或者事件已到达但主线程还没有 claim()）
+    bool armed() const { return this->m_armed.load(std::memory_order_acquire); }
+
+    /*
+        热重启时把连接移交给新进程，只能在 armed() 时由主线程调用
+        handoffState(): 没有未处理完的请求和未发送完的响应时返回协议相关的状态（>= 0），否则返回 -1
+        restoreState(): 新进程 init() 之后恢复这个状态
+    */
+    int handoffState() const;
+    virtual void restoreState(int state) { (void)state; }
+
+    /*
+        主线程取得所有权之后调用，把服务器主动推送的数据 data 按协议封装后发送
+        返回 false 时由主线程关闭连接
+    */
+    virtual bool push(const char* data, size_t len) { (void)data; (void)len; return true; }
+
+protected:
+    enum WRITE_RESULT {
+        WRITE_COMPLETE,         // 写缓冲区中的数据全部发送完成
+        WRITE_AGAIN,            // TCP 写缓冲区满，等待 EPOLLOUT
+        WRITE_ERROR             // 发送出错，关闭连接
+    };
+
+    // 把待发送的数据分散写到 socket，不注册 epoll 事件；主线程和工作线程共用
+    virtual WRITE_RESULT sendBuffered();
+
+    // 读缓冲区第一个块中的数据，用于在主线程中查看请求首行，返回字节数
+    size_t peekRead(const char** data) const;
+
+    virtual void init() = 0;    // 初始化协议相关的状态
+    virtual int protocolState() const { return 0; }    // 空闲连接移交时需要保留的协议状态，-1 表示不能移交
+    /*
+        写缓冲区的数据全部发送完成后调用，返回 false 表示关闭连接
+        默认保持连接，读缓冲区中剩余的数据（流水线中不完整的请求）保留到下一次处理
+    */
+    virtual bool onWriteComplete() { return true; }
+};
+
+// 设置文件描述符非阻塞
+int setNonBlocking(int fd);
+
+// 添加文件描述符到epoll对象中
+void addFDEpoll(int epoll_fd, int fd, bool et, bool one_shot);
+
+// 从epoll对象中删除文件描述符，并关闭文件描述符
+void removeFDEpoll(int epoll_fd, int fd);
+
+// 修改epoll对象中的文件描述符，重新注册 EPOLLONESHOT
+void modifyFDEpoll(int epoll_fd, int fd, int event_num);
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef FAIR_QUEUE_H
+#define FAIR_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include "connection.h"
+
+/*
+    令牌桶限流 + 按客户端的差额轮询（DRR）调度，只由主线程使用
+    - 每个客户端 IP 和每个连接各有一个令牌桶，一次读取到的请求（流水线中的多条命令一起）消耗一个令牌
+    - 令牌不足时允许透支：按透支量算出需要等待的时间，不超过最长等待时间的请求延迟到期后再排队，
+      超过的直接拒绝；两个桶都满足时才扣除令牌
+    - 排队的请求按客户端分成多个 FIFO，主线程用 DRR 依次从各客户端取出请求交给线程池：
+      每轮给客户端 QUANTUM 字节的额度，请求按读缓冲区的字节数扣除额度，
+      批量发送大请求的客户端不能挤占其他客户端的处理机会
+    - 请求按优先级通道（RequestLane）分开排队，每个通道内部按客户端 DRR；通道之间按权重平滑加权轮询，
+      读通道权重高，写请求和管理请求的积压不会让点查询一直等待
+    - Unix 域连接没有 IP 地址，所有本机连接算作同一个客户端
+    连接处于 EPOLLONESHOT 的未注册状态时才会排队，同一个连接同时最多只有一个排队的请求
+*/
+class FairQueue {
+public:
+    enum {
+        FAIR_QUEUED = 0,        // 进入所属客户端的队列
+        FAIR_DELAYED,           // 令牌不足，等待令牌后再进入队列
+        FAIR_REJECTED,          // 需要等待的时间超过上限，拒绝
+    };
+
+    static const size_t QUANTUM = 4096;     // DRR 每轮给每个客户端的额度（字节）
+    static const unsigned ALL_LANES = (1u << LANE_COUNT) - 1;
+
+private:
+    // 令牌桶，tokens 可以为负数（透支）
+    struct TokenBucket {
+        double tokens;
+        uint64_t last_ms;       // 上一次补充令牌的时间
+    };
+
+    // 一个客户端在一个通道中的队列
+    struct Flow {
+        int head;               // 排队的连接（按 fd 链接的 FIFO），-1 表示空
+        int tail;
+        size_t deficit;         // DRR 的剩余额度
+        bool in_ring;           // 在通道的轮询环中
+        bool turn_started;      // 本轮的额度已经发放
+    };
+
+    struct Client {
+        TokenBucket bucket;
+        int connections;        // 属于这个客户端的连接数量
+        Flow flows[LANE_COUNT];
+    };
+
+    enum SlotState {
+        SLOT_IDLE = 0,
+        SLOT_QUEUED,
+        SLOT_DELAYED,
+    };
+
+    // 每个连接的状态，按 fd 索引
+    struct Slot {
+        Client* client;
+        TokenBucket bucket;
+        int state;
+        int lane;               // 排队请求所在的通道
+        int prev;               // 客户端 FIFO 中的前后连接
+        int next;
+        size_t cost;            // 排队请求的字节数
+        uint64_t queued_ms;     // 读取到请求的时间
+        uint32_t generation;    // 连接关闭时加一，延迟队列中过时的记录按它识别
+    };
+
+    // 延迟队列的记录，按到期时间排序
+    struct Delayed {
+        uint64_t ready_ms;
+        int fd;
+        uint32_t generation;
+        bool operator>(const Delayed& other) const { return ready_ms > other.ready_ms; }
+    };
+
+    std::vector<Slot> m_slots;
+    std::unordered_map<uint32_t, Client> m_clients;     // 客户端 IP（网络字节序）-> 客户端状态
+    std::deque<Flow*> m_rings[LANE_COUNT];              // 每个通道中有排队请求的客户端，DRR 按顺序轮询
+    size_t m_lane_queued[LANE_COUNT];                   // 每个通道中排队的请求数
+    int m_lane_weight[LANE_COUNT];                      // 通道的权重
+    int m_lane_current[LANE_COUNT];                     // 平滑加权轮询的当前值
+    std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> m_delayed;
+    size_t m_queued;            // 客户端队列中的请求数
+    size_t m_waiting;           // 延迟队列中的请求数
+
+    double m_client_rate;       // 每个客户端 IP 每秒的令牌数，0 表示不限制
+    double m_client_burst;      // 客户端令牌桶的容量
+    double m_conn_rate;         // 每个连接每秒的令牌数，0 表示不限制
+    double m_conn_burst;        // 连接令牌桶的容量
+    uint64_t m_max_delay_ms;    // 令牌不足时最长的等待时间，超过时拒绝
+
+    void push(int fd);          // 把连接放到所属客户端在对应通道的队列末尾
+    void unlink(int fd);        // 把连接从所属客户端的队列中取下
+    int pickLane(unsigned lanes);   // 在 lanes 中有排队请求的通道里按权重选择一个，没有时返回 -1
+
+public:
+    explicit FairQueue(int max_fd);
+
+    /*
+        设置限流参数，rate 为每秒的令牌数（0 表示不限制），burst 为令牌桶的容量（0 表示等于 rate，至少为 1）
+        max_delay_ms 为令牌不足时最长的等待时间，0 表示令牌不足时直接拒绝
+    */
+    void setLimits(double client_rate, double client_burst, double conn_rate, double conn_burst, int max_delay_ms);
+
+    // 设置通道的权重（按 RequestLane 的顺序），权重为 0 的通道只在其他通道都空闲时才处理
+    void setLaneWeights(const int weights[LANE_COUNT]);
+
+    // 新连接，client 为客户端 IP（网络字节序），Unix 域连接为 0
+    void addConnection(int fd, uint32_t client, uint64_t now_ms);
+
+    // 连接关闭，排队中的请求一并移除
+    void removeConnection(int fd);
+
+    /*
+        连接上读取到请求后调用，lane 为请求的通道，cost 为读缓冲区的字节数
+        wait_ms 为需要等待令牌的时间：FAIR_DELAYED 时为延迟的时间，FAIR_REJECTED 时为建议的重试时间
+        @return
+        FAIR_QUEUED / FAIR_DELAYED: 由 next() 取出，FAIR_REJECTED: 超出速率，请求没有排队
+    */
+    int submit(int fd, int lane, size_t cost, uint64_t now_ms, uint64_t* wait_ms);
+
+    /*
+        在 lanes（按通道编号的位图）中按权重选择通道，再按 DRR 取出下一个应当处理的连接
+        queued_ms 为读取到请求的时间，lane 为请求所在的通道
+        到期的延迟请求先进入所属客户端的队列
+        @return fd，-1 表示没有可以处理的请求
+    */
+    int next(uint64_t now_ms, unsigned lanes, uint64_t* queued_ms, int* lane);
+
+    // 距离下一个延迟请求到期的毫秒数，没有延迟请求时返回 -1，作为 epoll_wait 的超时时间
+    int timeoutMs(uint64_t now_ms) const;
+
+    // 回收没有连接、也没有透支令牌的客户端，由主线程定期调用
+    void collect(uint64_t now_ms);
+
+    size_t pending() const { return this->m_queued + this->m_waiting; }
+    size_t clients() const { return this->m_clients.size(); }
+    size_t laneQueued(int lane) const { return this->m_lane_queued[lane]; }
+};
+
+#endif
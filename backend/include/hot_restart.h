@@ -0,0 +1,67 @@
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <stddef.h>
+
+/*
+    热重启：新进程通过 Unix 域 socket（--handoff PATH）从旧进程接手监听 socket、空闲连接和引擎数据
+    1. 新进程启动时连接 PATH，旧进程停止 accept，不再读取空闲连接上的新请求，等待处理中的请求完成
+    2. 旧进程把 boot id 和引擎数据（key、value、版本号）写到 socket，新进程载入后回复确认
+    3. 旧进程用 SCM_RIGHTS 依次发送监听 socket 和空闲连接，发送完后退出
+    - 监听 socket 一直没有关闭，移交期间到达的连接在内核的 accept 队列中等待，不会被拒绝
+    - 移交的连接在内核缓冲区中还没有读取的请求，由新进程注册 epoll 后立即处理
+    - 没有旧进程在 PATH 上监听时 handoff_connect() 失败，新进程按冷启动处理
+    两端是同一台主机上的同一个程序，数据按本机字节序传输，开头的魔数用来拒绝不兼容的版本
+*/
+
+#define HANDOFF_IO_TIMEOUT_S 30     // 移交过程中一次读写的最长等待时间（秒）
+
+// 移交的文件描述符的种类：监听 socket 按用途区分，连接为 HANDOFF_CONN_BASE + 协议（ConnProtocol）
+enum {
+    HANDOFF_LISTEN_HTTP = 0,
+    HANDOFF_LISTEN_RESP,
+    HANDOFF_LISTEN_BINARY,
+    HANDOFF_LISTEN_UNIX,
+    HANDOFF_LISTEN_COUNT,
+
+    HANDOFF_CONN_BASE = 16,
+};
+
+// 旧进程：在 path 上监听新进程的连接，上次运行留下的 socket 文件先删除，-1 表示失败
+int handoff_listen(const char* path);
+
+// 旧进程：接受新进程的连接，设置读写超时，-1 表示失败
+int handoff_accept(int listen_fd);
+
+// 新进程：连接旧进程，-1 表示没有旧进程（冷启动）
+int handoff_connect(const char* path);
+
+/*
+    旧进程：发送 boot id 和所有引擎的数据，之后等待新进程的确认
+    调用时工作线程没有在执行命令，引擎数据不会再变化
+    @return
+    0: success, -1: 发送失败或者新进程没有确认（旧进程继续服务）
+*/
+int handoff_send_snapshot(int sock);
+
+/*
+    新进程：载入引擎数据并恢复 boot id，成功后回复确认
+    @return
+    0: success, -1: 数据不完整或者版本不兼容
+*/
+int handoff_recv_snapshot(int sock);
+
+// 旧进程：发送一个文件描述符，state 为连接的协议状态（Connection::handoffState()），0: success, -1: failed
+int handoff_send_fd(int sock, int fd, int kind, int state);
+
+// 旧进程：所有文件描述符发送完成
+int handoff_send_end(int sock);
+
+/*
+    新进程：接收一个文件描述符
+    @return
+    1: 收到 fd、kind 和 state, 0: 旧进程已经发送完, -1: 出错
+*/
+int handoff_recv_fd(int sock, int* fd, int* kind, int* state);
+
+#endif
@@ -20,15 +20,11 @@
 #include <errno.h>
 #include <sys/uio.h>
 #include "locker.h"
+#include "connection.h"
 
-// 任务类，每一个对象处理客户端的一个 HTTP 请求
-class HttpConnection {
+// 任务类，每一个对象处理客户端的一个 HTTP 请求，单个 HTTP 请求（请求行 + 请求头 + 请求体）不超过 MAX_REQUEST_SIZE
+class HttpConnection : public Connection {
 public:
-    static int m_epoll_fd;      // 所有客户端通信对应 socket 上的事件都被注册到同一个 epoll 对象中，所以设置成静态的
-    static int m_user_count;    // 统计客户端的数量
-
-    static const int READ_BUFFER_SIZE = 4096;   // 读缓冲区大小
-    static const int WRITE_BUFFER_SIZE = 2048;  // 写缓冲区大小
     static const int FILENAME_LEN = 200;        // 文件名的最大长度
 
     // HTTP 请求方法，目前只支持 GET
@@ -91,9 +87,7 @@ public:
     };
 
 protected:
-    int m_sockfd;               // 客户端 HTTP 连接对应的文件描述符
-    struct sockaddr_in m_client_addr;   // 客户端通信的 socket 地址
-    char m_read_buf[READ_BUFFER_SIZE];  // 读缓冲区
+    char* m_read_base;          // 读缓冲区整理成连续内存后的起始地址，解析 HTTP 请求时使用
     int m_read_index;           // 记录从读缓冲区已经读取的数据字节的下一个位置
     int m_checked_index;        // 当前正在分析的字符，在读缓冲区的位置
     int m_start_line;           // 当前正在解析的行的起始位置
@@ -107,44 +101,44 @@ protected:
     char* m_host;               // 主机名
     long long m_content_length; // HTTP 请求体对应的总长度
     bool m_keep_alive;          // HTTP 请求是否要求保持连接
+    bool m_upgrade_websocket;   // 请求头 Upgrade: websocket
+    char* m_ws_key;             // 请求头 Sec-WebSocket-Key
+    char* m_if_none_match;      // 请求头 If-None-Match，条件 GET
 
-    char m_write_buf[WRITE_BUFFER_SIZE];    // 写缓冲区
-    int m_write_index;          // 写缓冲区中待发送的字节数
     char* m_file_address;       // 客户请求的目标文件被 mmap 到内存中的起始位置
     struct stat m_file_stat;    // 目标文件的状态，通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct iovec m_iv[2];       // 我们将采用 writev 来执行写操作，所以定义下面两个成员，其中 m_iv_count 表示被写内存块的数量
-    int m_iv_count;
-
-    int bytes_to_send;          // 将要发送的数据的字节数
-    int bytes_have_send;        // 已经发送的字节数
 
 public:
     HttpConnection();
     ~HttpConnection();
-    void init(int sockfd, const sockaddr_in& client_addr);      // 初始化新接收的客户端连接
-    void closeConnection();     // 关闭客户端的连接
+    using Connection::init;
     virtual void process();             // 响应并且处理客户端的请求
-    bool read();                // 非阻塞读
-    bool write();               // 非阻塞写
     void clearBuffer();         // 线程池工作队列满，丢弃 HttpConnection 对象
+    void rejectOverloaded(int retry_after_s);   // 服务器过载，丢弃读到的请求，生成 503 响应（发送后关闭连接）
+    void rejectRateLimited(int retry_after_s);  // 超出限流速率，丢弃读到的请求，生成 429 响应（发送后关闭连接）
 
 protected:
     void init();                                    // 初始化其余的数据
+    WRITE_RESULT sendBuffered();                    // 写缓冲区之后还要发送内存映射的文件
+    bool onWriteComplete();                         // 释放内存映射，keep-alive 时准备接收下一个请求
     HTTP_CODE processRead();                        // 解析 HTTP 请求
     bool processWrite(HTTP_CODE ret);               // 写 HTTP 响应
+    void rejectRequest(int status, const char* title, const char* form, int retry_after_s);    // 生成拒绝响应
 
     // 下面这一组函数被 process_read 调用以分析 HTTP 请求
-    HTTP_CODE parseRequestLine(char* text);       // 解析请求首行
-    HTTP_CODE parseRequestHeaders(char* text);    // 解析请求头
+    HTTP_CODE parseRequestLine(char* text, size_t len);       // 解析请求首行
+    HTTP_CODE parseRequestHeaders(char* text, size_t len);    // 解析请求头
     HTTP_CODE parseRequestContent(char* text);    // 解析请求体    
     // HTTP_CODE GetRequestFile();                   // 解析成功 HTTP 请求，将对应的请求资源映射到内存中
-    char* getLine() { return this->m_read_buf + this->m_start_line; }  // 获取一行数据
+    char* getLine() { return this->m_read_base + this->m_start_line; }  // 获取一行数据
     LINE_STATUS parseLineData();                       // 获取 HTTP 请求的一行数据   
+    bool linearizeReadBuffer(size_t reserve);           // 将读缓冲区整理成连续内存，并修正指向读缓冲区的指针
 
     // 填充 HTTP 响应
     void unmap();                                           // 释放内存映射 
     bool addResponse(const char* format, ...);              // 添加响应内容（通用函数）
     bool addContent(const char* content);                   // 添加响应体
+    bool addContent(const char* content, size_t len);
     bool addContentType();                                  // 添加响应类型
     bool addStatusLine(int status_num, const char* status_content);   // 添加响应状态行
     void addHeaders(int content_length);                    // 添加响应头
@@ -3,28 +3,66 @@
 
 #include "http_connection.h"
 #include "kvs_handler.h"
+#include "websocket.h"
+#include "json_request.h"
 
-// 扩展HttpConnection类以支持POST请求和JSON
+/*
+    扩展HttpConnection类以支持POST请求和JSON
+    GET /api/ws 升级为 WebSocket 之后，连接上的每个文本帧是一条 JSON 命令（与 POST /api/kv 的请求体相同），
+    每个二进制帧携带一个或多个二进制协议的请求帧；服务器按 --ws-push-interval-ms 定时推送统计信息
+*/
 class HttpKvsConnection : public HttpConnection {
 public:
     HttpKvsConnection();
     ~HttpKvsConnection();
+    using Connection::init;
 
     // 重写process方法以支持KV存储
     void process();
+    void rejectOverloaded(int retry_after_s);   // WebSocket 连接回复关闭帧 1013
+    void rejectRateLimited(int retry_after_s);  // WebSocket 连接同样回复关闭帧 1013
+    bool push(const char* data, size_t len);    // 以文本帧推送 data
+    void restoreState(int state);               // 1: 已经升级为 WebSocket
+    int requestLane() const;
+    bool routingKey(const char** key, size_t* len) const;   // URL 中的 key，或者请求体中第一个 "key" 字段
+
+protected:
+    void init();
+    WRITE_RESULT sendBuffered();
+    bool onWriteComplete();
+    int protocolState() const;
 
 private:
-    // JSON解析
-    bool parseJsonField(const char* json, const char* field, char* value, int max_len);
+    // 执行请求体中的一条命令或命令数组，响应追加到 response，返回响应的字节数，-1 表示请求格式错误
+    int executeJsonCommand(char* json, size_t len, ChainBuffer* response);
+    int executeCommand(const json_command_t& command, ChainBuffer* response);
 
     // 处理kv存储请求
     HTTP_CODE processKvsRequest();
+    bool processKvsGet();               // GET /api/kv/{engine}/{key}，带 ETag 的条件读取
+
+    // WebSocket
+    bool upgradeWebSocket();            // 完成握手，生成 101 响应
+    void processWebSocket();            // 处理读缓冲区中所有完整的帧
+    void executeWsText(char* payload, size_t len);
+    void executeWsBinary(char* payload, size_t len);
+    void addWsFrame(int opcode, const char* data, size_t len);
+    void addWsFrame(int opcode, ChainBuffer& payload);
+    void addWsClose(int code);          // 回复关闭帧，发送完成后关闭连接
 
     // 生成JSON响应
     bool writeJsonResponse(const char* json_content);
+    bool writeJsonResponse(ChainBuffer& json_content);  // 响应体的块直接挂到写缓冲区之后，不拷贝
+    void addJsonHeaders(int content_len, const char* etag = NULL);  // 200 状态行和响应头，由预先拼好的模板生成
+    void addJsonStatusHeaders(int status_num, const char* status_title, int content_len);   // 200 以外的 JSON 响应头
+    void addNotModified(const char* etag);          // 304 响应，没有响应体
 
     // 返回404 JSON错误响应（前后端分离后，非API请求返回此响应）
     bool writeNotFoundResponse();
+
+private:
+    bool m_websocket;           // 已经升级为 WebSocket
+    bool m_ws_closing;          // 已经发出关闭帧
 };
 
 #endif
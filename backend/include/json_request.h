@@ -0,0 +1,46 @@
+#ifndef JSON_REQUEST_H
+#define JSON_REQUEST_H
+
+#include <stddef.h>
+
+/*
+    JSON 命令的单遍解析器，用于 POST /api/kv 的请求体和 WebSocket 的文本帧
+    - 请求体是一个命令对象 {"cmd":...,"key":...,"value":...}，或者命令对象的数组（批量执行）
+    - 字段值直接指向请求体，不拷贝；只有含转义字符的字符串才原地解码（解码后不会变长）
+    - 只识别顶层的 cmd、key、value 字段，其他字段和嵌套的对象、数组整体跳过
+    - 一个命令对象解析完成后，字段值原地加上结束符，可以直接当作 C 字符串使用
+*/
+
+typedef struct json_view_s {
+    char* data;         // NULL 表示字段不存在
+    size_t len;
+}json_view_t;
+
+typedef struct json_command_s {
+    json_view_t cmd;
+    json_view_t key;
+    json_view_t value;  // 字符串、数字或字面量，值为 null 时视为不存在；对象和数组取原始文本
+}json_command_t;
+
+typedef struct json_reader_s {
+    char* p;            // 下一个要解析的位置
+    char* end;
+    int is_array;       // 请求体是命令数组
+    int done;
+}json_reader_t;
+
+/*
+    开始解析 [body, body + len)
+    @return
+    0: success, -1: 请求体不是对象或数组
+*/
+int json_request_begin(json_reader_t* reader, char* body, size_t len);
+
+/*
+    解析下一个命令对象
+    @return
+    1: 解析出一个命令（cmd 和 key 可能不存在，由调用者判断）, 0: 没有更多命令, -1: JSON 格式错误
+*/
+int json_request_next(json_reader_t* reader, json_command_t* command);
+
+#endif
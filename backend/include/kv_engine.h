@@ -0,0 +1,800 @@
+#ifndef KV_ENGINE_H
+#define KV_ENGINE_H
+
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "kvstore.h"
+#include "objectpool.h"
+#include "mpmcqueue.h"
+
+/*
+    policy-based engine core: KvEngine<Index, Alloc, Lock>
+    - Index: where entries live and how a key is found (ArrayIndex, ChainHashIndex, RbtreeIndex)
+    - Alloc: where entry nodes and key/value copies come from (MallocAlloc, SlabAlloc)
+    - Lock:  how readers and writers are serialized (std::shared_mutex, CombiningLock, ExclusiveLock, NoLock)
+    locking, copies, versions and counting are written once in KvEngine; an index only finds, links and unlinks
+    every combination is its own instantiation, so the index and allocator calls are inlined
+
+    an index provides:
+      typedef Node;                     entry with key, value, key_len, value_len, version
+      DEFAULT_SIZE;                     size of the preallocated table (entries or buckets), 0 if there is none
+      int create(size_t size);          -1: failed, 0: success
+      size_t capacity();                max number of entries, 0 if unlimited
+      void destroy(Alloc&);             free every entry and the index itself
+      Node* find(key, key_len);
+      Node* insert(Alloc&, key, key_len);   link a new entry that owns key, NULL if out of memory
+      void erase(Alloc&, Node*);        unlink the entry and free it with its key and value
+      void regions(cb, arg);            large preallocated tables, for NUMA placement
+      void forEach(f);                  call f(const Node*) for every entry
+*/
+
+// nodes and strings from the heap
+template <typename Node>
+struct MallocAlloc {
+    Node* newNode() {
+        Node* node = (Node*)kvs_malloc(sizeof(Node));
+        if (node != NULL) {
+            memset(node, 0, sizeof(Node));
+        }
+        return node;
+    }
+    void deleteNode(Node* node) { kvs_free(node); }
+    char* dup(const char* data, size_t len) { return kvs_dup(data, len); }
+    void release(void* ptr) { kvs_free(ptr); }
+};
+
+// nodes from fixed-size slots carved out of larger chunks, strings from the heap
+// ObjectPool is not thread-safe: nodes are only created and freed under the engine's exclusive lock
+template <typename Node>
+struct SlabAlloc {
+    ObjectPool<Node> m_pool;
+
+    Node* newNode() { return this->m_pool.create(); }   // value-initialized, all fields zero
+    void deleteNode(Node* node) { this->m_pool.destroy(node); }
+    char* dup(const char* data, size_t len) { return kvs_dup(data, len); }
+    void release(void* ptr) { kvs_free(ptr); }
+};
+
+// no locking, for an engine owned by a single thread
+struct NoLock {
+    void lock() {}
+    void unlock() {}
+    void lock_shared() {}
+    void unlock_shared() {}
+};
+
+// one mutex for readers and writers, readers do not run concurrently
+class ExclusiveLock {
+private:
+    std::mutex m_mutex;
+
+public:
+    void lock() { this->m_mutex.lock(); }
+    void unlock() { this->m_mutex.unlock(); }
+    void lock_shared() { this->m_mutex.lock(); }
+    void unlock_shared() { this->m_mutex.unlock(); }
+};
+
+/*
+    reader/writer lock whose writers are flat-combined
+    readers take the shared lock as usual; a writer publishes its operation in its thread's slot and
+    the writer that wins the exclusive lock runs every published operation in one critical section,
+    so under contention a burst of writes costs one lock handoff instead of one per write
+    and the index stays in the combiner's cache
+    a waiting writer spins on its slot and retries the lock, then parks: one parked writer at a time blocks
+    in lock() to become the next combiner, the rest sleep on their slot until a combiner has run their
+    operation and wakes them, so waiters beyond the CPUs do not take time from the combiner
+    threads beyond SLOTS fall back to lock()
+*/
+#define KVS_ENGINE_LOCKS 4      // combining locks a thread remembers its slot in, the rest use lock()
+
+class CombiningLock {
+public:
+    static const int SLOTS = 512;       // threads that can publish, more than the worker pool's limit
+    static const int PASSES = 2;        // scans per combining round, late arrivals are picked up by the second
+    static const int SPINS = 64;        // slot checks before a waiting writer parks
+
+    CombiningLock() : m_used(0), m_next(false) {}
+
+    void lock() { this->m_mutex.lock(); }
+    void unlock() { this->m_mutex.unlock(); }
+    void lock_shared() { this->m_mutex.lock_shared(); }
+    void unlock_shared() { this->m_mutex.unlock_shared(); }
+
+    // run f() under the exclusive lock, possibly on another writer's thread, and return its result
+    template <typename F>
+    int combine(F& f);
+
+private:
+    struct Request {
+        int (*run)(void* fn);
+        void* fn;
+        int result;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<Request*> request;      // published by the owner, cleared by the combiner when done
+        std::atomic<int> parked;            // futex word, 1 while the owner sleeps waiting for its request
+    };
+
+    template <typename F>
+    static int invoke(void* fn) { return (*static_cast<F*>(fn))(); }
+
+    // the caller holds the exclusive lock
+    void runPending() {
+        int used = this->m_used.load(std::memory_order_acquire);
+        if (used > SLOTS) {
+            used = SLOTS;
+        }
+        for (int pass = 0; pass < PASSES; ++pass) {
+            bool found = false;
+            for (int i = 0; i < used; ++i) {
+                Request* request = this->m_slots[i].request.load(std::memory_order_acquire);
+                if (request != NULL) {
+                    request->result = request->run(request->fn);
+                    this->m_slots[i].request.store(NULL, std::memory_order_seq_cst);
+                    if (this->m_slots[i].parked.exchange(0, std::memory_order_seq_cst) != 0) {
+                        syscall(SYS_futex, reinterpret_cast<int*>(&this->m_slots[i].parked),
+                            FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+                    }
+                    found = true;
+                }
+            }
+            if (!found) {
+                break;
+            }
+        }
+    }
+
+    // slot of the calling thread in this lock, -1 if every slot is taken
+    int slotIndex();
+
+    // sleep until a combiner has run the request in slot, or become the next combiner
+    int park(Slot& slot, Request& request);
+
+    std::shared_mutex m_mutex;
+    std::atomic<int> m_used;            // slots handed out, the combiner scans only these
+    std::atomic<bool> m_next;           // a parked writer is blocked in lock() and will combine
+    Slot m_slots[SLOTS] = {};
+};
+
+inline int CombiningLock::slotIndex() {
+    // threads are few and long-lived: each thread takes the next slot of a lock the first time it writes there
+    // and remembers it for up to one lock per engine
+    thread_local const CombiningLock* t_lock[KVS_ENGINE_LOCKS] = {};
+    thread_local int t_index[KVS_ENGINE_LOCKS] = {};
+    for (int i = 0; i < KVS_ENGINE_LOCKS; ++i) {
+        if (t_lock[i] == this) {
+            return t_index[i];
+        }
+        if (t_lock[i] == NULL) {
+            int index = this->m_used.fetch_add(1, std::memory_order_acq_rel);
+            if (index >= SLOTS) {
+                index = -1;
+            }
+            t_lock[i] = this;
+            t_index[i] = index;
+            return index;
+        }
+    }
+    return -1;
+}
+
+template <typename F>
+int CombiningLock::combine(F& f) {
+    int index = this->slotIndex();
+    if (index == -1) {
+        std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+        return f();
+    }
+
+    Request request = { &CombiningLock::invoke<F>, &f, 0 };
+    Slot& slot = this->m_slots[index];
+    slot.request.store(&request, std::memory_order_release);
+    for (int spins = 0; ; ++spins) {
+        if (slot.request.load(std::memory_order_acquire) == NULL) {
+            return request.result;      // another writer ran it
+        }
+        if (this->m_mutex.try_lock()) {
+            this->runPending();         // includes our own request
+            this->m_mutex.unlock();
+            return request.result;
+        }
+        if (spins >= SPINS) {
+            return this->park(slot, request);
+        }
+        CpuRelax();
+    }
+}
+
+/*
+    only one parked writer waits for the lock itself: it clears m_next once it holds the lock and before
+    it scans, so a writer that saw m_next taken published its request before that scan and will be served
+*/
+inline int CombiningLock::park(Slot& slot, Request& request) {
+    while (1) {
+        // mark parked before the last check: either the combiner sees the mark or we see the cleared request
+        slot.parked.store(1, std::memory_order_seq_cst);
+        if (slot.request.load(std::memory_order_seq_cst) == NULL) {
+            slot.parked.store(0, std::memory_order_relaxed);
+            return request.result;
+        }
+        if (!this->m_next.exchange(true, std::memory_order_seq_cst)) {
+            slot.parked.store(0, std::memory_order_relaxed);
+            this->m_mutex.lock();
+            this->m_next.store(false, std::memory_order_seq_cst);
+            this->runPending();
+            this->m_mutex.unlock();
+            return request.result;
+        }
+        syscall(SYS_futex, reinterpret_cast<int*>(&slot.parked), FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+// run a write under the exclusive lock: directly for plain locks, through the combiner for CombiningLock
+template <typename Lock, typename F>
+inline int kv_lock_exclusive(Lock& lock, F& f) {
+    std::unique_lock<Lock> guard(lock);
+    return f();
+}
+
+template <typename F>
+inline int kv_lock_exclusive(CombiningLock& lock, F& f) {
+    return lock.combine(f);
+}
+
+
+#if ENABLE_ARRAY
+// fixed table scanned from the start, entries are stored inline
+// scans stop at the end of the used part of the table, a restore into an empty table does not walk all of it
+class ArrayIndex {
+public:
+    typedef kvs_array_item_t Node;
+    static const size_t DEFAULT_SIZE = KVS_ARRAY_SIZE;
+
+    ArrayIndex() : m_table(NULL), m_capacity(0), m_end(0) {}
+
+    int create(size_t size) {
+        if (this->m_table != NULL || size == 0) {
+            return -1;
+        }
+        this->m_table = (Node*)kvs_malloc(size * sizeof(Node));
+        if (this->m_table == NULL) {
+            return -1;
+        }
+        memset(this->m_table, 0, size * sizeof(Node));
+        this->m_capacity = size;
+        return 0;
+    }
+
+    size_t capacity() const { return this->m_capacity; }
+
+    template <typename A>
+    void destroy(A& alloc) {
+        if (this->m_table == NULL) {
+            return;
+        }
+        for (size_t i = 0; i < this->m_end; ++i) {
+            if (this->m_table[i].key != NULL) {
+                alloc.release(this->m_table[i].key);
+                alloc.release(this->m_table[i].value);
+            }
+        }
+        kvs_free(this->m_table);
+        this->m_table = NULL;
+        this->m_end = 0;
+    }
+
+    Node* find(const char* key, size_t key_len) {
+        for (size_t i = 0; i < this->m_end; ++i) {
+            Node* item = &this->m_table[i];
+            if (item->key != NULL && item->key_len == key_len && memcmp(item->key, key, key_len) == 0) {
+                return item;
+            }
+        }
+        return NULL;
+    }
+
+    // the engine checks capacity() first, so a free slot exists
+    template <typename A>
+    Node* insert(A& alloc, char* key, size_t key_len) {
+        (void)alloc;
+        for (size_t i = 0; i < this->m_capacity; ++i) {
+            if (this->m_table[i].key == NULL) {
+                this->m_table[i].key = key;
+                this->m_table[i].key_len = key_len;
+                if (i >= this->m_end) {
+                    this->m_end = i + 1;
+                }
+                return &this->m_table[i];
+            }
+        }
+        return NULL;
+    }
+
+    template <typename A>
+    void erase(A& alloc, Node* item) {
+        alloc.release(item->key);
+        alloc.release(item->value);
+        memset(item, 0, sizeof(Node));
+    }
+
+    void regions(kvs_region_cb cb, void* arg) {
+        if (this->m_table != NULL) {
+            cb(this->m_table, this->m_capacity * sizeof(Node), arg);
+        }
+    }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t i = 0; i < this->m_end; ++i) {
+            if (this->m_table[i].key != NULL) {
+                f((const Node*)&this->m_table[i]);
+            }
+        }
+    }
+
+private:
+    Node* m_table;
+    size_t m_capacity;
+    size_t m_end;       // one past the last slot ever used, erased slots below it are reused first
+};
+#endif
+
+
+#if ENABLE_HASH
+// separate chaining over a fixed number of slots (KVS_HASH_SIZE by default), new entries go to the head of the chain
+class ChainHashIndex {
+public:
+    typedef hashnode_t Node;
+    static const size_t DEFAULT_SIZE = KVS_HASH_SIZE;
+
+    ChainHashIndex() : m_nodes(NULL), m_size(0) {}
+
+    int create(size_t size) {
+        if (this->m_nodes != NULL || size == 0) {
+            return -1;
+        }
+        this->m_nodes = (Node**)kvs_malloc(sizeof(Node*) * size);
+        if (this->m_nodes == NULL) {
+            return -1;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            this->m_nodes[i] = NULL;
+        }
+        this->m_size = size;
+        return 0;
+    }
+
+    size_t capacity() const { return 0; }
+
+    template <typename A>
+    void destroy(A& alloc) {
+        if (this->m_nodes == NULL) {
+            return;
+        }
+        for (size_t i = 0; i < this->m_size; ++i) {
+            Node* node = this->m_nodes[i];
+            while (node != NULL) {
+                Node* next = node->next;
+                alloc.release(node->key);
+                alloc.release(node->value);
+                alloc.deleteNode(node);
+                node = next;
+            }
+        }
+        kvs_free(this->m_nodes);
+        this->m_nodes = NULL;
+    }
+
+    Node* find(const char* key, size_t key_len) {
+        for (Node* node = this->m_nodes[slot(key, key_len)]; node != NULL; node = node->next) {
+            if (node->key_len == key_len && memcmp(node->key, key, key_len) == 0) {
+                return node;
+            }
+        }
+        return NULL;
+    }
+
+    template <typename A>
+    Node* insert(A& alloc, char* key, size_t key_len) {
+        Node* node = alloc.newNode();
+        if (node == NULL) {
+            return NULL;
+        }
+        node->key = key;
+        node->key_len = key_len;
+
+        Node** head = &this->m_nodes[slot(key, key_len)];
+        node->next = *head;
+        *head = node;
+        return node;
+    }
+
+    template <typename A>
+    void erase(A& alloc, Node* node) {
+        // pointer to the previous next field, the head and inner nodes are handled the same way
+        Node** link = &this->m_nodes[slot(node->key, node->key_len)];
+        while (*link != node) {
+            link = &(*link)->next;
+        }
+        *link = node->next;
+
+        alloc.release(node->key);
+        alloc.release(node->value);
+        alloc.deleteNode(node);
+    }
+
+    void regions(kvs_region_cb cb, void* arg) {
+        if (this->m_nodes != NULL) {
+            cb(this->m_nodes, sizeof(Node*) * this->m_size, arg);
+        }
+    }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t i = 0; i < this->m_size; ++i) {
+            for (const Node* node = this->m_nodes[i]; node != NULL; node = node->next) {
+                f(node);
+            }
+        }
+    }
+
+private:
+    size_t slot(const char* key, size_t key_len) const {
+        long sum = 0;
+        for (size_t i = 0; i < key_len; ++i) {
+            sum += key[i];
+        }
+        long size = (long)this->m_size;
+        return (size_t)((sum % size + size) % size);
+    }
+
+    Node** m_nodes;     // the head of every chain
+    size_t m_size;      // number of chains
+};
+#endif
+
+
+#if ENABLE_RBTREE
+// red-black tree ordered by key bytes, the balancing algorithms live in kvs_rbtree.cpp
+class RbtreeIndex {
+public:
+    typedef rbtree_node Node;
+    static const size_t DEFAULT_SIZE = 0;
+
+    RbtreeIndex() {
+        this->m_tree.root = NULL;
+        this->m_tree.nil = NULL;
+    }
+
+    int create(size_t size) {
+        (void)size;
+        this->m_tree.nil = (Node*)kvs_malloc(sizeof(Node));
+        if (this->m_tree.nil == NULL) {
+            return -1;
+        }
+        memset(this->m_tree.nil, 0, sizeof(Node));
+        this->m_tree.nil->color = BLACK;
+        this->m_tree.root = this->m_tree.nil;
+        return 0;
+    }
+
+    size_t capacity() const { return 0; }
+
+    template <typename A>
+    void destroy(A& alloc) {
+        if (this->m_tree.nil == NULL) {
+            return;
+        }
+        destroySubtree(alloc, this->m_tree.root);
+        kvs_free(this->m_tree.nil);
+        this->m_tree.root = NULL;
+        this->m_tree.nil = NULL;
+    }
+
+    Node* find(const char* key, size_t key_len) {
+        Node* node = rbtree_search_n(&this->m_tree, key, key_len);
+        return node == this->m_tree.nil ? NULL : node;
+    }
+
+    template <typename A>
+    Node* insert(A& alloc, char* key, size_t key_len) {
+        Node* node = alloc.newNode();
+        if (node == NULL) {
+            return NULL;
+        }
+        node->key = key;
+        node->key_len = key_len;
+        rbtree_insert(&this->m_tree, node);
+        return node;
+    }
+
+    template <typename A>
+    void erase(A& alloc, Node* node) {
+        // rbtree_delete() may swap node contents, it returns the node actually unlinked
+        Node* cur = rbtree_delete(&this->m_tree, node);
+        alloc.release(cur->key);
+        alloc.release(cur->value);
+        alloc.deleteNode(cur);
+    }
+
+    void regions(kvs_region_cb cb, void* arg) {
+        (void)cb;
+        (void)arg;
+    }
+
+    // in key order
+    template <typename F>
+    void forEach(F f) const {
+        visitSubtree(f, this->m_tree.root);
+    }
+
+private:
+    template <typename F>
+    void visitSubtree(F& f, const Node* node) const {
+        if (node == this->m_tree.nil) {
+            return;
+        }
+        visitSubtree(f, node->left);
+        f(node);
+        visitSubtree(f, node->right);
+    }
+
+    template <typename A>
+    void destroySubtree(A& alloc, Node* node) {
+        if (node == this->m_tree.nil) {
+            return;
+        }
+        destroySubtree(alloc, node->left);
+        destroySubtree(alloc, node->right);
+        alloc.release(node->key);
+        alloc.release(node->value);
+        alloc.deleteNode(node);
+    }
+
+    rbtree m_tree;
+};
+#endif
+
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+class KvEngine {
+public:
+    typedef typename Index::Node Node;
+
+    KvEngine() : m_count(0), m_version(0) {}
+    KvEngine(const KvEngine&) = delete;
+    KvEngine& operator=(const KvEngine&) = delete;
+
+    // size: entries or buckets of the preallocated table, 0 for the index default; -1: failed, 0: success
+    int create(size_t size = 0) { return this->m_index.create(size != 0 ? size : Index::DEFAULT_SIZE); }
+    void destroy();
+
+    /*
+        keys and values are binary-safe, values are stored with a trailing '\0'
+        every SET/MOD stamps the entry with the next version of this engine
+    */
+    int set(const char* key, size_t key_len, const char* value, size_t value_len);     // -1: ERROR, 0: OK, 1: EXIST, 2: full
+    // SET that overwrites an existing key in the same write section; -1: ERROR, 0: inserted, 1: replaced, 2: full
+    int upsert(const char* key, size_t key_len, const char* value, size_t value_len);
+    int get(const char* key, size_t key_len, kvs_version_t* version, kvs_value_cb cb, void* arg);    // -1: ERROR, 0: OK, 1: NO EXIST
+    int mod(const char* key, size_t key_len, const char* value, size_t value_len);     // -1: ERROR, 0: OK, 1: NO EXIST
+    int del(const char* key, size_t key_len);       // -1: ERROR, 0: OK, 1: NO EXIST
+    int exist(const char* key, size_t key_len);     // -1: ERROR, 0: EXIST, 1: NO EXIST
+
+    size_t count();
+    void regions(kvs_region_cb cb, void* arg) { this->m_index.regions(cb, arg); }
+
+    /*
+        hot restart: scan() passes every entry with its version to cb under the read lock,
+        and returns the last version handed out (deleted entries may have held higher versions than any live one)
+        restore() inserts an entry with the version it had in the previous process,
+        restoreVersion() moves the version counter forward, it never goes back
+    */
+    kvs_version_t scan(kvs_entry_cb cb, void* arg);
+    int restore(const char* key, size_t key_len, const char* value, size_t value_len, kvs_version_t version);
+    void restoreVersion(kvs_version_t version);
+
+private:
+    // insert under the write lock, version 0 takes the next version
+    int insert(const char* key, size_t key_len, const char* value, size_t value_len, kvs_version_t version);
+    // swap in a copy of value under the write lock; -1: ERROR, 0: OK
+    int replace(Node* node, const char* value, size_t value_len);
+
+    Index m_index;
+    Alloc<Node> m_alloc;
+    Lock m_lock;
+    size_t m_count;
+    kvs_version_t m_version;    // last version handed out
+};
+
+
+// 模板类的定义和实现放在头文件中
+template <typename Index, template <typename> class Alloc, typename Lock>
+void KvEngine<Index, Alloc, Lock>::destroy() {
+    std::unique_lock<Lock> lock(this->m_lock);
+    this->m_index.destroy(this->m_alloc);
+    this->m_count = 0;
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::set(const char* key, size_t key_len, const char* value, size_t value_len) {
+    if (key == NULL || value == NULL) {
+        return -1;
+    }
+
+    auto op = [&]() { return this->insert(key, key_len, value, value_len, 0); };
+    return kv_lock_exclusive(this->m_lock, op);
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::upsert(const char* key, size_t key_len, const char* value, size_t value_len) {
+    if (key == NULL || value == NULL) {
+        return -1;
+    }
+
+    auto op = [&]() {
+        Node* node = this->m_index.find(key, key_len);
+        if (node == NULL) {
+            return this->insert(key, key_len, value, value_len, 0);
+        }
+        return this->replace(node, value, value_len) == 0 ? 1 : -1;
+    };
+    return kv_lock_exclusive(this->m_lock, op);
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::replace(Node* node, const char* value, size_t value_len) {
+    char* vcopy = this->m_alloc.dup(value, value_len);
+    if (vcopy == NULL) {
+        return -1;
+    }
+    this->m_alloc.release(node->value);
+    node->value = vcopy;
+    node->value_len = value_len;
+    node->version = ++this->m_version;
+    return 0;
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::insert(const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_version_t version) {
+    if (this->m_index.find(key, key_len) != NULL) {
+        return 1;
+    }
+    if (this->m_index.capacity() != 0 && this->m_count >= this->m_index.capacity()) {
+        return 2;
+    }
+
+    char* kcopy = this->m_alloc.dup(key, key_len);
+    char* vcopy = this->m_alloc.dup(value, value_len);
+    Node* node = (kcopy != NULL && vcopy != NULL) ? this->m_index.insert(this->m_alloc, kcopy, key_len) : NULL;
+    if (node == NULL) {
+        this->m_alloc.release(kcopy);
+        this->m_alloc.release(vcopy);
+        return -1;
+    }
+
+    node->value = vcopy;
+    node->value_len = value_len;
+    if (version == 0) {
+        version = ++this->m_version;
+    }
+    else if (version > this->m_version) {
+        this->m_version = version;
+    }
+    node->version = version;
+    ++this->m_count;
+    return 0;
+}
+
+// version (if not NULL) is set before cb runs, both under the read lock
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::get(const char* key, size_t key_len, kvs_version_t* version,
+    kvs_value_cb cb, void* arg) {
+    if (key == NULL) {
+        return -1;
+    }
+
+    std::shared_lock<Lock> lock(this->m_lock);
+    Node* node = this->m_index.find(key, key_len);
+    if (node == NULL) {
+        return 1;
+    }
+
+    if (version != NULL) {
+        *version = node->version;
+    }
+    if (cb != NULL) {
+        cb((const char*)node->value, node->value_len, arg);
+    }
+    return 0;
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::mod(const char* key, size_t key_len, const char* value, size_t value_len) {
+    if (key == NULL || value == NULL) {
+        return -1;
+    }
+
+    auto op = [&]() {
+        Node* node = this->m_index.find(key, key_len);
+        if (node == NULL) {
+            return 1;
+        }
+        return this->replace(node, value, value_len);
+    };
+    return kv_lock_exclusive(this->m_lock, op);
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::del(const char* key, size_t key_len) {
+    if (key == NULL) {
+        return -1;
+    }
+
+    auto op = [&]() {
+        Node* node = this->m_index.find(key, key_len);
+        if (node == NULL) {
+            return 1;
+        }
+
+        this->m_index.erase(this->m_alloc, node);
+        --this->m_count;
+        return 0;
+    };
+    return kv_lock_exclusive(this->m_lock, op);
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::exist(const char* key, size_t key_len) {
+    if (key == NULL) {
+        return -1;
+    }
+
+    std::shared_lock<Lock> lock(this->m_lock);
+    return this->m_index.find(key, key_len) != NULL ? 0 : 1;
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+size_t KvEngine<Index, Alloc, Lock>::count() {
+    std::shared_lock<Lock> lock(this->m_lock);
+    return this->m_count;
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+kvs_version_t KvEngine<Index, Alloc, Lock>::scan(kvs_entry_cb cb, void* arg) {
+    std::shared_lock<Lock> lock(this->m_lock);
+    if (cb != NULL) {
+        this->m_index.forEach([cb, arg](const Node* node) {
+            cb((const char*)node->key, node->key_len, (const char*)node->value, node->value_len, node->version, arg);
+        });
+    }
+    return this->m_version;
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+int KvEngine<Index, Alloc, Lock>::restore(const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_version_t version) {
+    if (key == NULL || value == NULL || version == 0) {
+        return -1;
+    }
+
+    auto op = [&]() { return this->insert(key, key_len, value, value_len, version); };
+    return kv_lock_exclusive(this->m_lock, op);
+}
+
+template <typename Index, template <typename> class Alloc, typename Lock>
+void KvEngine<Index, Alloc, Lock>::restoreVersion(kvs_version_t version) {
+    std::unique_lock<Lock> lock(this->m_lock);
+    if (version > this->m_version) {
+        this->m_version = version;
+    }
+}
+
+#endif
@@ -2,38 +2,214 @@
 #define __KVS_HANDLER_H__
 
 #include "kvstore.h"
+#include "kv_engine.h"
+#include "buffer.h"
+#include <atomic>
 #include <shared_mutex>
 
-// 全局KV存储实例
+// 全局KV存储实例，每个引擎是一种索引、分配器和锁的组合，写操作通过 CombiningLock 合并执行
 #if ENABLE_ARRAY
+typedef KvEngine<ArrayIndex, MallocAlloc, CombiningLock> kvs_array_t;
 extern kvs_array_t global_array;
-extern std::shared_mutex global_array_rwlock;
 #endif
 
 #if ENABLE_RBTREE
+typedef KvEngine<RbtreeIndex, SlabAlloc, CombiningLock> kvs_rbtree_t;
 extern kvs_rbtree_t global_rbtree;
-extern std::shared_mutex global_rbtree_rwlock;
 #endif
 
 #if ENABLE_HASH
+typedef KvEngine<ChainHashIndex, SlabAlloc, CombiningLock> kvs_hash_t;
 extern kvs_hash_t global_hash;
-extern std::shared_mutex global_hash_rwlock;
 #endif
 
 // 函数声明
-int init_kvengine(void);
+/**
+ * partitions: 0 creates the shared engines above, used by every thread under their locks;
+ * N > 0 switches to shared-nothing mode: the keyspace is split by key hash into N partitions, each with
+ * its own array, rbtree and hash engines without locks, owned by one thread (kvs_partition_attach())
+ * a command for another thread's partition is handed to the owner over a lock-free single-slot channel
+ * the fixed tables (array slots, hash buckets) are divided among the partitions
+ */
+int init_kvengine(int partitions);
 
 void destroy_kvengine(void);
 
+/**
+ * enumerate the large tables preallocated by init_kvengine() (array table, hash buckets),
+ * used to place engine memory on NUMA nodes
+ */
+void kvs_engine_regions(kvs_region_cb cb, void* arg);
+
 /**
  * cmd: SET/GET/DEL/MOD/EXIST/RSET/RGET/HSET/HGET...
  * key: [value](GET/DEL/EXIST haven't value)
- * response: json type
+ * response: json type, appended to the response buffer (no size limit)
  * @return the size of response str
  */
-int kvs_handle_command(const char* cmd, const char* key, const char* value, char* response);
+int kvs_handle_command(const char* cmd, const char* key, const char* value, ChainBuffer* response);
+
+/**
+ * embed the engine stats ("data") in every kvs_handle_command() response, enabled by default
+ * clients that get stats another way (WebSocket push, /api/stats) can turn it off
+ */
+void kvs_set_embed_stats(bool enable);
 
-// get statistics of kvs info
+/**
+ * get statistics of kvs info, read from the engine counters without taking the engine locks
+ * response needs at least KVS_STATS_MAX_LEN bytes
+ * @return the size of response str
+ */
+#define KVS_STATS_MAX_LEN 512
 int kvs_get_stats(char* response);
 
+// kv cmd, every engine has the same five operations in the same order
+enum {
+    KVS_CMD_START = 0,
+
+    // array
+    KVS_CMD_SET = KVS_CMD_START,
+    KVS_CMD_GET,
+    KVS_CMD_DEL,
+    KVS_CMD_MOD,
+    KVS_CMD_EXIST,
+
+    // rbtree
+    KVS_CMD_RSET,
+    KVS_CMD_RGET,
+    KVS_CMD_RDEL,
+    KVS_CMD_RMOD,
+    KVS_CMD_REXIST,
+
+    // hash
+    KVS_CMD_HSET,
+    KVS_CMD_HGET,
+    KVS_CMD_HDEL,
+    KVS_CMD_HMOD,
+    KVS_CMD_HEXIST,
+
+    KVS_CMD_COUNT,
+};
+
+// operation of a command, independent of the engine
+enum {
+    KVS_OP_SET = 0,
+    KVS_OP_GET,
+    KVS_OP_DEL,
+    KVS_OP_MOD,
+    KVS_OP_EXIST,
+
+    KVS_OP_COUNT,
+};
+
+// protocol-neutral result of a command
+enum {
+    KVS_STATUS_OK = 0,          // SET/DEL/MOD succeeded, GET found the value (passed to the callback), EXIST found the key
+    KVS_STATUS_EXIST,           // SET: key already exists
+    KVS_STATUS_NO_EXIST,        // key not found
+    KVS_STATUS_FULL,            // storage full
+    KVS_STATUS_ERROR,           // engine error
+    KVS_STATUS_VALUE_REQUIRED,  // SET/MOD without value
+};
+
+/**
+ * look up a command name (case insensitive)
+ * @return KVS_CMD_*, -1 if unknown
+ */
+int kvs_command_lookup(const char* cmd);
+int kvs_command_lookup_n(const char* cmd, size_t len);
+
+// KVS_OP_* of a command
+static inline int kvs_command_op(int cmd_type) {
+    return cmd_type % KVS_OP_COUNT;
+}
+
+// engine of a command, in the order of the command groups
+enum {
+    KVS_ENGINE_ARRAY = 0,
+    KVS_ENGINE_RBTREE,
+    KVS_ENGINE_HASH,
+
+    KVS_ENGINE_COUNT,
+};
+
+static inline int kvs_command_engine(int cmd_type) {
+    return cmd_type / KVS_OP_COUNT;
+}
+
+/**
+ * item counters of the global engines, updated by kvs_execute() after every successful SET/DEL
+ * (in shared-nothing mode each worker counts in its own partition, kvs_get_stats() adds them up)
+ * one cache line per engine, so workers writing different engines do not share a line
+ */
+typedef struct kvs_counter_s {
+    alignas(64) std::atomic<long> count;
+} kvs_counter_t;
+
+extern kvs_counter_t global_kvs_counters[KVS_ENGINE_COUNT];
+
+/**
+ * look up an engine by the name used in the stats and in the URLs: "array", "rbtree", "hash"
+ * @return KVS_ENGINE_*, -1 if unknown
+ */
+int kvs_engine_lookup(const char* name, size_t len);
+
+/**
+ * conditional read for GET /api/kv/{engine}/{key}
+ * etag: receives the quoted ETag of the stored value, at least KVS_ETAG_MAX_LEN bytes ("" if not found)
+ * if_none_match: the request header or NULL; when it matches the ETag nothing is appended and
+ * *not_modified is set, otherwise the response is the same JSON as a GET command (without stats)
+ * @return KVS_STATUS_*, -1: invalid parameters
+ */
+#define KVS_ETAG_MAX_LEN 48
+int kvs_handle_get(int engine, const char* key, size_t key_len, const char* if_none_match,
+    char* etag, bool* not_modified, ChainBuffer* response);
+
+/**
+ * execute a command without formatting the response, used by non-HTTP protocols
+ * keys and values are binary-safe; GET passes the value to cb while the engine lock is held
+ * @return KVS_STATUS_*, -1: invalid parameters
+ */
+int kvs_execute(int cmd_type, const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_value_cb cb, void* arg);
+
+/**
+ * SET that overwrites an existing key, checked and written under one engine write lock
+ * (Redis SET semantics; a separate SET + MOD could lose the write to a DEL in between)
+ * @return KVS_STATUS_OK: inserted, KVS_STATUS_EXIST: value replaced, other KVS_STATUS_* on failure,
+ *         -1: invalid parameters or cmd_type is not a SET command
+ */
+int kvs_upsert(int cmd_type, const char* key, size_t key_len, const char* value, size_t value_len);
+
+/**
+ * hot restart snapshot (hot_restart.h), called only while no worker runs commands
+ * kvs_dump: pass every entry of an engine to cb under its read lock, @return the last version it handed out
+ * kvs_restore: insert an entry with its old version, @return KVS_STATUS_*, -1: invalid parameters
+ * kvs_restore_version: move the version counter of an engine forward to the last version of the old process
+ * the boot id is part of every ETag, the new process takes over the old one so cached ETags still match
+ */
+kvs_version_t kvs_dump(int engine, kvs_entry_cb cb, void* arg);
+int kvs_restore(int engine, const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_version_t version);
+void kvs_restore_version(int engine, kvs_version_t version);
+unsigned long kvs_get_boot_id(void);
+void kvs_set_boot_id(unsigned long boot_id);
+
+/**
+ * shared-nothing mode (init_kvengine(N))
+ * kvs_partition_attach: make the calling thread the owner of partition index, called once by every worker
+ * kvs_partition_set_notify: cb(partition, arg) runs after a command is handed to the owner of partition,
+ *   it must make that thread call kvs_partition_poll() soon, waking it if it sleeps
+ * kvs_partition_poll: run the commands other threads handed to the calling thread's partition
+ * kvs_partition_stats: commands run on the caller's own partition and handed to another one,
+ *   @return the number of partitions, 0 in shared mode
+ */
+typedef void (*kvs_notify_cb)(int partition, void* arg);
+void kvs_partition_attach(int index);
+// partition (= owning worker index) of a key, -1 in shared mode; used to send requests to the owner
+int kvs_partition_owner(const char* key, size_t key_len);
+void kvs_partition_set_notify(kvs_notify_cb cb, void* arg);
+void kvs_partition_poll(void);
+int kvs_partition_stats(unsigned long long* local, unsigned long long* forwarded);
+
 #endif
@@ -20,6 +20,29 @@
 #define ENABLE_RBTREE 1
 #define ENABLE_HASH 1
 
+/*
+    entry layouts of the three indexes; the engines themselves are KvEngine<Index, Alloc, Lock> (kv_engine.h)
+    keys and values carry explicit lengths and may contain '\0'
+    values are always stored with a trailing '\0', so text values can be used as C strings
+*/
+
+// called with the value while the engine lock is held, value is only valid during the call
+typedef void (*kvs_value_cb)(const char* value, size_t len, void* arg);
+
+/*
+    every SET/MOD stamps the entry with the next version of its engine (under the write lock)
+    a key that is deleted and set again never reuses an old version, so (engine, version) identifies a value
+    KvEngine::get reports the version of the entry before cb runs, the pair is consistent under the read lock
+*/
+typedef unsigned long long kvs_version_t;
+
+// a large preallocated table of an engine, used to place engine memory on NUMA nodes
+typedef void (*kvs_region_cb)(void* addr, size_t len, void* arg);
+
+// one entry of an engine, called while the engine read lock is held (hot restart snapshot)
+typedef void (*kvs_entry_cb)(const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_version_t version, void* arg);
+
 
 #if ENABLE_ARRAY
 #define KVS_ARRAY_SIZE 1024 * 512
@@ -27,22 +50,10 @@
 typedef struct kvs_array_item_s {
     char* key;
     char* value;
+    size_t key_len;
+    size_t value_len;
+    kvs_version_t version;
 }kvs_array_item_t;
-
-typedef struct kvs_array_s {
-    kvs_array_item_t* table;
-    int idx;
-    int total;      // number of item
-}kvs_array_t;
-
-int kvs_array_create(kvs_array_t* inst);
-void kvs_array_destroy(kvs_array_t* inst);
-
-int kvs_array_set(kvs_array_t* inst, char* key, char* value);
-char* kvs_array_get(kvs_array_t* inst, char* key);
-int kvs_array_mod(kvs_array_t* inst, char* key, char* value);
-int kvs_array_del(kvs_array_t* inst, char* key);
-int kvs_array_exist(kvs_array_t* inst, char* key);
 #endif
 
 #if ENABLE_RBTREE
@@ -66,24 +77,21 @@ typedef struct _rbtree_node {
 
     KEY_TYPE key;
     void* value;
+    size_t key_len;
+    size_t value_len;
+    kvs_version_t version;
 }rbtree_node;
 
 typedef struct _rbtree {
     rbtree_node* root;
     rbtree_node* nil;
-    int count;  // 红黑树节点计数
 }rbtree;
 
-typedef struct _rbtree kvs_rbtree_t;
-
-int kvs_rbtree_create(kvs_rbtree_t* inst);
-void kvs_rbtree_destroy(kvs_rbtree_t* inst);
+// balancing algorithms, the caller allocates nodes and holds the lock
+void rbtree_insert(rbtree* T, rbtree_node* z);
+rbtree_node* rbtree_delete(rbtree* T, rbtree_node* z);     // returns the node actually unlinked (contents may be swapped)
+rbtree_node* rbtree_search_n(rbtree* T, const char* key, size_t key_len);   // T->nil if not found
 
-int kvs_rbtree_set(kvs_rbtree_t* inst, char* key, char* value);
-char* kvs_rbtree_get(kvs_rbtree_t* inst, char* key);
-int kvs_rbtree_del(kvs_rbtree_t* inst, char* key);
-int kvs_rbtree_mod(kvs_rbtree_t* inst, char* key, char* value);
-int kvs_rbtree_exist(kvs_rbtree_t* inst, char* key);
 #endif
 
 
@@ -98,6 +106,9 @@ typedef struct hashnode_s {
 #if ENABLE_KEY_POINTER
     char* key;
     char* value;
+    size_t key_len;
+    size_t value_len;
+    kvs_version_t version;
 #else
     char key[MAX_KEY_LEN];
     char value[MAX_VALUE_LEN];
@@ -105,26 +116,11 @@ typedef struct hashnode_s {
     struct hashnode_s* next;    // hash confilict
 }hashnode_t;
 
-typedef struct hashtable_s {
-    hashnode_t** nodes;     // the pointer of linklist head
-
-    int max_slots;
-    int count;
-}hashtable_t;
-
-typedef struct hashtable_s kvs_hash_t;
-
-int kvs_hash_create(kvs_hash_t* hash);
-void kvs_hash_destroy(kvs_hash_t* hash);
-int kvs_hash_set(hashtable_t* hash, char* key, char* value);
-char* kvs_hash_get(kvs_hash_t* hash, char* key);
-int kvs_hash_mod(kvs_hash_t* hash, char* key, char* value);
-int kvs_hash_del(kvs_hash_t* hash, char* key);
-int kvs_hash_exist(kvs_hash_t* hash, char* key);
 #endif 
 
 
 void* kvs_malloc(size_t size);
 void kvs_free(void* ptr);
+char* kvs_dup(const char* data, size_t len);    // copy len bytes and append '\0', NULL if out of memory
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+// 自旋等待时提示 CPU 降低功耗、让出流水线给超线程
+static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/*
+    有界无锁 MPMC 环形队列（Vyukov 算法）
+    - 每个槽位带一个序号：序号 == 入队位置表示槽位空闲可写，序号 == 出队位置 + 1 表示槽位有数据可读
+    - 入队、出队各只需要一次 CAS 抢占位置，再用 release/acquire 更新槽位序号，没有互斥锁
+    - 元素按值存放在预先分配的槽位中，入队出队不分配内存，T 应当是定长的小结构体
+    - 容量向上取整为 2 的幂，下标用位与计算
+    - 只提供非阻塞的 TryPush/TryPop，队列为空时如何等待由调用者决定（线程池在每个工作线程自己的 futex 上睡眠）
+*/
+template <typename T>
+class MpmcQueue {
+private:
+    static const size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+
+    // 入队位置和出队位置分别被生产者和消费者修改，放在不同的缓存行，避免伪共享
+    alignas(CACHE_LINE) std::atomic<size_t> m_enqueue_pos;
+    alignas(CACHE_LINE) std::atomic<size_t> m_dequeue_pos;
+
+    static size_t RoundUpPow2(size_t n);
+
+public:
+    explicit MpmcQueue(size_t capacity);
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool TryPush(const T& value);   // 入队，队列满时返回 false
+    bool TryPop(T& value);          // 出队，队列空时返回 false
+
+    size_t Capacity() const { return m_mask + 1; }
+    size_t Size() const;            // 队列中元素的近似数量
+};
+
+
+// 模板类的定义和实现放在头文件中
+template<typename T>
+size_t MpmcQueue<T>::RoundUpPow2(size_t n) {
+    size_t cap = 2;
+    while (cap < n) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+template<typename T>
+MpmcQueue<T>::MpmcQueue(size_t capacity)
+    : m_mask(RoundUpPow2(capacity) - 1),
+    m_cells(new Cell[m_mask + 1]),
+    m_enqueue_pos(0), m_dequeue_pos(0) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+bool MpmcQueue<T>::TryPush(const T& value) {
+    Cell* cell = NULL;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    while (1) {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            // 槽位空闲，抢占入队位置
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return false;   // 槽位上一轮的数据还没有被取走，队列已满
+        }
+        else {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->data = value;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MpmcQueue<T>::TryPop(T& value) {
+    Cell* cell = NULL;
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    while (1) {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return false;   // 队列为空
+        }
+        else {
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    value = cell->data;
+    // 槽位留给下一轮的入队者
+    cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+size_t MpmcQueue<T>::Size() const {
+    size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
@@ -0,0 +1,97 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <stdlib.h>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+    定长对象池
+    - 按块（每块 CHUNK_OBJECTS 个对象槽）向系统申请内存，空闲槽串成单链表，申请和归还都是 O(1)
+    - 归还的对象槽只回到空闲链表，不还给系统，对象池析构时统一释放
+    - 非线程安全，只能在同一个线程（主线程）中使用
+*/
+template <typename T>
+class ObjectPool {
+private:
+    static const size_t CHUNK_OBJECTS = 64;
+
+    // 空闲时槽位存放下一个空闲槽的指针，使用时存放对象本身
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    Slot* m_free_list;              // 空闲槽链表
+    std::vector<Slot*> m_chunks;    // 所有申请过的块，析构时释放
+    size_t m_in_use;                // 正在使用的对象数量
+
+    bool grow();
+
+public:
+    ObjectPool() : m_free_list(NULL), m_in_use(0) {}
+    ~ObjectPool();
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    template <typename... Args>
+    T* create(Args&&... args);      // 取出一个空闲槽并构造对象
+    void destroy(T* obj);           // 析构对象并归还槽位
+
+    size_t inUse() const { return this->m_in_use; }
+    size_t capacity() const { return this->m_chunks.size() * CHUNK_OBJECTS; }
+};
+
+
+// 模板类的定义和实现放在头文件中
+template <typename T>
+ObjectPool<T>::~ObjectPool() {
+    for (Slot* chunk : this->m_chunks) {
+        free(chunk);
+    }
+}
+
+template <typename T>
+bool ObjectPool<T>::grow() {
+    Slot* chunk = (Slot*)malloc(sizeof(Slot) * CHUNK_OBJECTS);
+    if (chunk == NULL) {
+        return false;
+    }
+    this->m_chunks.push_back(chunk);
+
+    for (size_t i = 0; i < CHUNK_OBJECTS; ++i) {
+        chunk[i].next = this->m_free_list;
+        this->m_free_list = &chunk[i];
+    }
+    return true;
+}
+
+template <typename T>
+template <typename... Args>
+T* ObjectPool<T>::create(Args&&... args) {
+    if (this->m_free_list == NULL && !this->grow()) {
+        return NULL;
+    }
+
+    Slot* slot = this->m_free_list;
+    this->m_free_list = slot->next;
+    ++this->m_in_use;
+
+    return new (slot->storage) T(std::forward<Args>(args)...);
+}
+
+template <typename T>
+void ObjectPool<T>::destroy(T* obj) {
+    if (obj == NULL) {
+        return;
+    }
+    obj->~T();
+
+    Slot* slot = reinterpret_cast<Slot*>(obj);
+    slot->next = this->m_free_list;
+    this->m_free_list = slot;
+    --this->m_in_use;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef RESP_CONNECTION_H
+#define RESP_CONNECTION_H
+
+#include "connection.h"
+#include "kvs_handler.h"
+
+/*
+    RESP（Redis 序列化协议）连接，可以直接使用 redis-cli、redis-benchmark 和各语言的 Redis 客户端
+    - 支持多条批量命令（*N\r\n$len\r\n...）和内联命令，一次处理读缓冲区中所有完整的命令（流水线）
+    - 默认 RESP2，HELLO 3 切换到 RESP3
+    - SET/GET/DEL/MOD/EXIST 操作数组引擎，R 前缀操作红黑树引擎，H 前缀操作哈希引擎
+*/
+class RespConnection : public Connection {
+public:
+    static const int MAX_ARGS = 16;                 // 一条命令最多保留的参数个数，多出的参数只校验格式
+    static const int MAX_INLINE_SIZE = 64 * 1024;   // 内联命令一行的最大长度
+    static const int MAX_MULTIBULK = 1024 * 1024;   // 多条批量命令的最大参数个数
+
+    /*
+        解析一条命令的结果
+        - PARSE_OK: 解析出一条完整的命令
+        - PARSE_INCOMPLETE: 命令不完整，需要继续读取客户端数据
+        - PARSE_ERROR: 协议错误，回复错误后关闭连接
+    */
+    enum PARSE_RESULT {
+        PARSE_OK = 0,
+        PARSE_INCOMPLETE,
+        PARSE_ERROR
+    };
+
+public:
+    RespConnection();
+    ~RespConnection();
+
+    void process();                             // 执行读缓冲区中所有完整的命令
+    void rejectOverloaded(int retry_after_s);   // 服务器过载，回复 -BUSY 后关闭连接
+    void restoreState(int state);               // HELLO 协商的协议版本
+    int requestLane() const;                    // 按第一条命令的命令名分类
+    bool routingKey(const char** key, size_t* len) const;   // 第一条命令的第二个参数
+
+protected:
+    void init();
+    bool onWriteComplete();
+    int protocolState() const;
+
+private:
+    // 命令的参数直接指向读缓冲区，解析完整后在原地添加字符串结束符
+    struct Command {
+        int argc;
+        char* argv[MAX_ARGS];
+        int argl[MAX_ARGS];
+    };
+
+    // 解析 [p, end) 中的一条命令，next 为命令之后的位置；不完整时 need 为已知需要的总字节数（从 p 算起，0 表示未知）
+    PARSE_RESULT parseMultiBulk(char* p, char* end, Command* cmd, char** next, size_t* need);
+    PARSE_RESULT parseInline(char* p, char* end, Command* cmd, char** next);
+
+    void execute(Command* cmd);                 // 执行一条命令，回复追加到写缓冲区
+    void executeKvs(int cmd_type, Command* cmd);
+    void executeHello(Command* cmd);
+
+    // 生成回复
+    void addSimple(const char* str);
+    void addError(const char* format, ...);
+    void addInteger(long long value);
+    void addBulk(const char* data, size_t len);
+    void addNull();
+    void addArrayHeader(int count);
+    void addMapHeader(int count);
+
+private:
+    int m_proto;                // 协议版本，2 或 3
+    bool m_close_after_write;   // QUIT、协议错误或过载，回复发送完后关闭连接
+};
+
+#endif
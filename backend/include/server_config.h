@@ -0,0 +1,42 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <stddef.h>
+
+#define MAX_WORKERS 256             // 工作线程数量的上限
+
+// 服务器运行参数，由命令行解析得到
+typedef struct ServerConfig {
+    int port;                   // HTTP 监听端口
+    size_t queue_capacity;      // 线程池任务队列的容量（向上取整为 2 的幂），队列满时直接返回 503
+    int queue_deadline_ms;      // 任务在队列中等待的最长时间（毫秒），超过后不再执行，0 表示不限制
+    int retry_after_s;          // 503 响应中 Retry-After 的秒数
+    bool cpu_affinity;          // 按拓扑绑核，并按 NUMA 节点放置内存
+    int resp_port;              // RESP（Redis 协议）监听端口，0 表示不开启
+    int binary_port;            // 二进制协议监听端口，0 表示不开启
+    int ws_push_interval_ms;    // WebSocket 连接推送统计信息的间隔（毫秒），0 表示不推送
+    bool embed_stats;           // /api/kv 的响应中附带引擎的统计信息
+    const char* unix_path;      // HTTP 服务额外监听的 Unix 域 socket 路径，NULL 表示不开启
+    const char* handoff_path;   // 热重启时新旧进程交接用的 Unix 域 socket 路径，NULL 表示不开启
+    int workers;                // 启动时的工作线程数量，0 表示按可用的 CPU 数量确定
+    int min_workers;            // 工作线程数量的下限，0 表示自动
+    int max_workers;            // 工作线程数量的上限，0 表示自动
+    int client_rate;            // 每个客户端 IP 每秒可以提交的请求数，0 表示不限制
+    int client_burst;           // 客户端令牌桶的容量（允许的突发请求数），0 表示等于 client_rate
+    int conn_rate;              // 每个连接每秒可以提交的请求数，0 表示不限制
+    int conn_burst;             // 连接令牌桶的容量，0 表示等于 conn_rate
+    int throttle_delay_ms;      // 超出速率的请求最多延迟的时间（毫秒），超过时返回 429，0 表示直接拒绝
+    int lane_weights[3];        // 读、写、管理请求通道（RequestLane）的调度权重
+    int read_reserve;           // 每个工作线程为读请求保留的投递窗口，写请求占满窗口时读请求仍然可以投递
+    int busy_poll_us;           // 低延迟模式：reactor 和空闲的工作线程阻塞之前自旋的时间（微秒），0 表示不自旋
+    bool partitions;            // shared-nothing 模式：每个工作线程拥有一个引擎分区，引擎不加锁
+}ServerConfig;
+
+/*
+    解析命令行参数：kv-webserver port [options]
+    @return
+    0: success, -1: 参数错误（已打印用法）
+*/
+int parse_server_config(int argc, char* argv[], ServerConfig* config);
+
+#endif
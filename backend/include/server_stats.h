@@ -0,0 +1,32 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <atomic>
+#include "buffer.h"
+
+class ThreadPool;
+
+// 服务器运行指标，由网络层和线程池更新，通过 GET /api/metrics 导出
+typedef struct ServerStats {
+    std::atomic<unsigned long long> tasks_posted;       // 进入队列的任务总数
+    std::atomic<unsigned long long> tasks_shed;         // 队列满被拒绝（返回 503）的任务数
+    std::atomic<unsigned long long> tasks_expired;      // 排队超过期限被丢弃（返回 503）的任务数
+    std::atomic<unsigned long long> tasks_stolen;       // 被空闲工作线程窃取的任务数
+    std::atomic<unsigned long long> throttled;          // 超出速率被延迟的请求数
+    std::atomic<unsigned long long> throttle_delay_ms;  // 限流延迟的累计时间（毫秒）
+    std::atomic<unsigned long long> rate_limited;       // 超出速率被拒绝（返回 429）的请求数
+    std::atomic<size_t> fair_pending;                   // 公平调度队列中等待交给线程池的请求数，由主线程更新
+    std::atomic<size_t> fair_clients;                   // 公平调度跟踪的客户端数量，由主线程更新
+    std::atomic<size_t> lane_pending[3];                // 每个请求通道（RequestLane）排队的请求数，由主线程更新
+    std::atomic<unsigned long long> lane_dispatched[3]; // 每个请求通道投递给线程池的请求数
+    const ThreadPool* pool;                             // 线程池，导出时读取队列深度
+    size_t queue_capacity;                              // 队列容量
+    int queue_deadline_ms;                              // 排队期限
+}ServerStats;
+
+extern ServerStats global_server_stats;
+
+// 将运行指标以 JSON 格式追加到 response 中，返回追加的字节数
+int server_stats_json(ChainBuffer* response);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <stddef.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+    在缓冲区中查找分隔符，解析器的热点循环
+    - 以 -mavx2（make ARCH_FLAGS=-mavx2 或 -march=native）编译时一次比较 32 字节
+    - x86-64 上一定有 SSE2，一次比较 16 字节；其他平台退回逐字节比较
+    - 只读取 [p, end) 范围内的字节，不要求缓冲区之后有可读的填充
+*/
+
+// 返回 [p, end) 中第一个等于 a 或 b 的字节的位置，没有时返回 end
+static inline const char* scan_find2(const char* p, const char* end, char a, char b) {
+#ifdef __AVX2__
+    const __m256i wa = _mm256_set1_epi8(a);
+    const __m256i wb = _mm256_set1_epi8(b);
+    while (end - p >= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)p);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, wa), _mm256_cmpeq_epi8(x, wb)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#endif
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != a && *p != b) {
+        ++p;
+    }
+    return p;
+}
+
+static inline char* scan_find2(char* p, char* end, char a, char b) {
+    return const_cast<char*>(scan_find2((const char*)p, (const char*)end, a, b));
+}
+
+// 不区分大小写比较 len 字节，lower 为小写；只有 'A'..'Z' 转成小写，其他字节要完全相同（'\r' 不等于 '-'）
+static inline constexpr bool scan_equals_lower(const char* p, const char* lower, size_t len) {
+    unsigned char diff = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)p[i];
+        c |= (unsigned char)(((unsigned char)(c - 'A') < 26) << 5);
+        diff |= (unsigned char)(c ^ (unsigned char)lower[i]);
+    }
+    return diff == 0;
+}
+
+#endif
@@ -1,27 +1,121 @@
 #pragma once
 #include <thread>
-#include <functional>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
 
-// 前置声明，解决循环依赖的问题 ==> #include "blockingqueue.h"
-// 前置声明的类只能用做指针或引用，如果是一个非指针成员变量，需要执行构造函数
-template <typename T>
-class BlockingQueue;
-
-template <typename T>
-class BlockingQueuePro;
+/*
+    任务记录：定长，按值存放在无锁队列的槽位中，投递任务不需要分配内存
+    - fd 为连接的文件描述符，opcode 告诉处理函数要做什么，由使用者定义
+    - enqueue_us 为入队时间（单调时钟，微秒），用于判断排队是否超过期限，并统计排队时间
+*/
+struct PoolTask {
+    int fd;
+    int opcode;
+    uint64_t enqueue_us;
+};
 
+/*
+    工作窃取线程池
+    - 每个工作线程有自己的收件箱（有界 MPMC 环形队列，接收主线程投递的任务），其他线程可以从中窃取
+    - 收件箱分为普通和紧急两个，紧急任务（例如点查询）总是先于其他任务执行和被窃取
+    - 主线程按连接上一次被哪个工作线程处理来投递，连接状态留在该线程所在核的 L1/L2 缓存中
+    - 工作线程先处理自己的收件箱，空闲时随机选择其他线程窃取，窃取不到再用 futex 睡眠
+    - 启动时按上限创建所有线程，只有前 active 个参与调度；Adjust() 按排队时间和利用率在 [min, max] 内
+      增减 active，停用的线程处理完自己队列中剩余的任务后睡眠，不再被投递和唤醒去窃取
+    - 低延迟模式（SetIdleSpinUs()）下空闲的线程先自旋一段时间再睡眠，新任务不必等待 futex 唤醒
+*/
 class ThreadPool {
+public:
+    // 任务处理函数，expired 为 true 表示任务在队列中等待超过了期限，应当放弃执行（例如直接返回 503）
+    typedef void (*TaskHandler)(const PoolTask& task, bool expired);
+
+    // 工作线程启动时调用，index 为线程编号，用于绑核、设置内存策略等线程级初始化
+    typedef void (*WorkerInit)(size_t index);
+
+    // 工作线程收到 Notify() 之后调用，处理任务之外的消息（例如其他线程转发过来的引擎命令）
+    typedef void (*MailHandler)(size_t index);
+
 private:
+    struct WorkerSlot;      // 每个工作线程的队列和睡眠状态，定义在 threadpool.cpp 中
+
+    void Worker(size_t index);                  // 线程运行函数
+    bool TrySteal(size_t index, PoolTask& task);    // 从随机选择的其他工作线程窃取任务
+    void Run(const PoolTask& task);             // 检查排队期限并执行任务
+    void WakeIdle(size_t except);               // 唤醒一个睡眠的工作线程去窃取任务
+    void HandleMail(size_t index);              // 有 Notify() 时调用处理函数
+    void SetActive(size_t n);                   // 修改参与调度的线程数量，新启用的线程立即唤醒
 
-    void Worker();      // 线程运行函数
-    // std::function<void()> 函数封装器
     // unique_ptr<T> 防止线程池对象浅拷贝问题
-    std::unique_ptr<BlockingQueuePro<std::function<void()>>> m_task_queue;     // 工作队列
+    std::vector<std::unique_ptr<WorkerSlot>> m_workers;
     std::vector<std::thread> m_threads;     // 线程池数组
+    TaskHandler m_handler;                  // 任务处理函数
+    WorkerInit m_init;                      // 工作线程初始化函数，可以为 NULL
+    std::atomic<MailHandler> m_mail;        // Notify() 的处理函数，可以为 NULL
+    uint64_t m_deadline_ms;                 // 排队期限，0 表示不限制
+    size_t m_inbox_capacity;                // 每个收件箱的容量
+    std::atomic<size_t> m_next;             // 没有指定工作线程时轮询投递
+    std::atomic<int> m_idle;                // 睡眠中的工作线程数量
+    std::atomic<bool> m_stop;               // 控制线程退出
+    std::atomic<size_t> m_active;           // 参与调度的线程数量，编号小于它的线程为启用状态
+    size_t m_min_active;                    // active 的下限
+    uint64_t m_last_adjust_ns;              // 上一次 Adjust() 的时间和累计值，只被调用 Adjust() 的线程使用
+    uint64_t m_last_busy_ns;
+    uint64_t m_last_wait_us;
+    uint64_t m_last_tasks;
+    std::atomic<unsigned> m_utilization;    // 上一个调整周期的利用率（百分比）
+    std::atomic<uint64_t> m_avg_wait_us;    // 上一个调整周期的平均排队时间（微秒）
+    std::atomic<unsigned> m_spin_us;        // 空闲时睡眠之前自旋的时间（微秒），0 表示只做几轮窃取
+    std::atomic<bool> m_steal;              // 空闲时是否窃取其他线程的任务
+    std::atomic<size_t> m_exited;           // 销毁时已经处理完自己队列的线程数
 public:
 
-    explicit ThreadPool(size_t threads_num);   // 初始化线程池
+    /*
+        初始化线程池
+        queue_capacity 为所有收件箱的总容量（平均分给每个工作线程，向上取整为 2 的幂），deadline_ms 为排队期限（0 表示不限制）
+        threads_num 为启动时参与调度的线程数量，min_threads/max_threads 为 Adjust() 调整的范围，0 表示固定为 threads_num
+    */
+    ThreadPool(size_t threads_num, TaskHandler handler, size_t queue_capacity, int deadline_ms = 0,
+        WorkerInit init = NULL, size_t min_threads = 0, size_t max_threads = 0);
     ~ThreadPool();                          // 销毁线程池
-    void Post(std::function<void()> task);  // 发布任务到线程池
+
+    /*
+        主线程发布任务到线程池，worker 为期望执行任务的工作线程（-1 表示轮询选择）
+        urgent 为 true 时放入紧急收件箱，排在已经投递的普通任务之前执行
+        目标收件箱满时改投其他工作线程，全部满时返回 false，由调用者做降级处理
+    */
+    bool Post(int fd, int opcode, int worker = -1, bool urgent = false);
+
+    /*
+        根据上一次调用以来的平均排队时间和线程利用率增减一个启用的线程，由主线程周期性调用（例如每秒一次）
+        - 平均排队时间超过 1ms，或者利用率超过 85%：启用一个线程
+        - 平均排队时间低于 100us，并且负载放到少一个线程上利用率也不超过 50%：停用一个线程
+        返回调整后的 active
+    */
+    size_t Adjust();
+
+    // 设置空闲的工作线程睡眠之前自旋的时间（微秒），只有一个 CPU 时不自旋
+    void SetIdleSpinUs(unsigned us) { m_spin_us.store(us, std::memory_order_relaxed); }
+
+    // 关闭窃取：任务只由投递的目标线程执行（例如任务必须在拥有数据的线程上执行），默认开启
+    void SetStealing(bool enabled) { m_steal.store(enabled, std::memory_order_relaxed); }
+
+    /*
+        通知第 index 个工作线程（包括停用的线程）调用 handler，睡眠中的线程被唤醒
+        线程正在执行任务时，处理完当前任务后调用；多次通知可能合并为一次调用
+        销毁线程池时，处理完自己队列的线程继续处理通知，直到所有线程都处理完，
+        其他线程的最后几个任务发给它的消息不会没有人处理
+    */
+    void SetMailHandler(MailHandler handler) { m_mail.store(handler, std::memory_order_release); }
+    void Notify(size_t index);
+
+    static int CurrentWorker();             // 当前线程在线程池中的编号，非工作线程返回 -1
+    size_t Size() const { return m_threads.size(); }
+    size_t Active() const { return m_active.load(std::memory_order_relaxed); }
+    size_t MinActive() const { return m_min_active; }
+    unsigned Utilization() const { return m_utilization.load(std::memory_order_relaxed); }
+    uint64_t AvgWaitUs() const { return m_avg_wait_us.load(std::memory_order_relaxed); }
+    size_t QueueCapacity() const { return m_inbox_capacity * m_workers.size(); }
+    size_t QueueDepth() const;              // 所有队列中等待的任务数（近似值）
 };
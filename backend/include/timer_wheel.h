@@ -0,0 +1,104 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "objectpool.h"
+
+class UtilTimer;        // 前向声明
+
+// 用户数据结构
+typedef struct ClientData {
+    struct sockaddr_in address;     // 客户端 socket 地址
+    int sockfd;                     // socket 文件描述符
+    UtilTimer* timer;               // 每一个客户端连接对应一个定时器
+}ClientData;
+
+
+/*
+    为不活跃的客户端连接创建定时器类
+    - 当客户端没有向服务器发送请求时，定时器一直计时
+        - 超时，关闭与客户端的 TCP 连接，释放文件描述符资源
+    - 直到客户端重新向服务器发送请求，定时器重新计时
+*/
+class UtilTimer {
+public:
+    UtilTimer* prev;    // 时间轮槽位链表中的前一个定时器
+    UtilTimer* next;    // 时间轮槽位链表中的后一个定时器
+    uint64_t expire;    // 任务超时时间，使用单调时钟的绝对时间（毫秒）
+    ClientData* user_data;  // 客户端连接信息
+public:
+    UtilTimer() : prev(NULL), next(NULL), expire(0), user_data(NULL), cb_func(NULL) {}
+public:
+    void(*cb_func)(ClientData*);    // 函数指针，任务回调函数，回调函数处理的客户数据，由定时器的执行者传递给回调函数
+};
+
+/*
+    分层时间轮，由 timerfd 驱动
+    - 第 0 层 256 个槽，每个槽一个 tick；第 1~3 层各 64 个槽，每个槽是下一层转一圈的时间
+    - 添加、删除定时器都是 O(1)：根据超时时间直接算出所在的层和槽，挂到槽位的双向链表上
+    - 第 0 层转完一圈时，把上一层当前槽中的定时器重新分配（cascade）到下层
+    - 延长超时时间是惰性的：只修改 expire，定时器所在的槽到期时发现没有超时，再重新挂到新的槽上
+    - 定时器节点从对象池中分配，不在每个连接上 new/delete
+    - 时间轮中有定时器时 timerfd 每个 tick 触发一次，时间轮为空时停止 timerfd
+*/
+class TimerWheel {
+public:
+    static const uint64_t TICK_MS = 100;    // tick 的时间粒度（毫秒）
+
+private:
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVELS = 3;            // 第 0 层之外的层数
+
+    // 每个槽是一个带哨兵节点的双向循环链表，哨兵节点不是真正的定时器
+    UtilTimer m_root[ROOT_SIZE];            // 第 0 层
+    UtilTimer m_levels[LEVELS][LEVEL_SIZE]; // 第 1~3 层
+    uint64_t m_current;                     // 下一个要处理的 tick
+    size_t m_count;                         // 时间轮中的定时器数量
+    int m_timer_fd;                         // 驱动时间轮的 timerfd
+    ObjectPool<UtilTimer> m_pool;           // 定时器节点池
+
+    void link(UtilTimer* timer);            // 根据超时时间把定时器挂到对应的槽上
+    void unlink(UtilTimer* timer);          // 把定时器从所在的槽上取下
+    int cascade(int level, int index);      // 把上层槽中的定时器重新分配到下层，返回槽的下标
+    void armTimerFd(bool enable);           // 启动/停止 timerfd
+
+public:
+    TimerWheel();
+
+    // 时间轮被销毁时，删除其中所有的定时器
+    ~TimerWheel();
+
+    // 创建 timerfd，返回文件描述符，由事件循环监听其可读事件
+    int init();
+
+    // 从节点池中申请一个定时器
+    UtilTimer* createTimer();
+
+    // 将目标定时器 Timer 添加到时间轮中
+    void addTimer(UtilTimer* timer);
+
+    /*
+        当某个定时任务发生变化时，将定时器的超时时间调整为 expire
+        超时时间延长时只修改 expire，不移动定时器（惰性调整），超时时间提前时重新挂到对应的槽上
+    */
+    void adjustTimer(UtilTimer* timer, uint64_t expire);
+
+    // 将目标定时器 timer 从时间轮中删除，并归还到节点池
+    void delTimer(UtilTimer* timer);
+
+    /*
+        timerfd 每次可读就执行一次 tick() 函数，以处理时间轮上到期的任务
+    */
+    void tick();
+
+    // 单调时钟的当前时间（毫秒）
+    static uint64_t nowMs();
+};
+
+#endif
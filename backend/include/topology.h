@@ -0,0 +1,59 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stddef.h>
+
+#define TOPOLOGY_MAX_CPUS 1024
+#define TOPOLOGY_MAX_NODES 64
+
+/*
+    CPU 和 NUMA 拓扑
+    - 从 /sys/devices/system/node 读取每个节点的 CPU 列表，只保留当前进程允许运行的 CPU
+    - cpus 按节点排序：同一个节点的 CPU 相邻，线程按顺序放置时会先填满一个节点
+    - 没有 NUMA 信息（容器、单节点机器）时，所有 CPU 都视为节点 0
+*/
+typedef struct Topology {
+    int cpu_count;                          // 可用的 CPU 数量
+    int cpus[TOPOLOGY_MAX_CPUS];            // 可用的 CPU 编号，按节点排序
+    int cpu_node[TOPOLOGY_MAX_CPUS];        // CPU 编号 -> 节点编号
+    int node_count;                         // 有可用 CPU 的节点数量
+    unsigned long node_mask;                // 有可用 CPU 的节点位图
+}Topology;
+
+/*
+    探测拓扑
+    @return
+    0: success, -1: failed
+*/
+int topology_detect(Topology* topo);
+
+// 第 slot 个线程（0 为 reactor，之后依次为工作线程）应当放置的 CPU，超过 CPU 数量时回绕
+int topology_cpu_for_slot(const Topology* topo, int slot);
+
+// CPU 所在的节点
+int topology_node_of_cpu(const Topology* topo, int cpu);
+
+// 把调用线程绑定到 cpu 上，0: success, -1: failed
+int topology_pin_thread(int cpu);
+
+// 调用线程之后分配的内存优先放在 node 节点上（MPOL_PREFERRED），0: success, -1: failed
+int topology_prefer_node(int node);
+
+/*
+    把 [addr, addr + len) 的内存交错分布到所有节点上（MPOL_INTERLEAVE），已经分配的页会被迁移
+    单节点时什么也不做
+    0: success, -1: failed
+*/
+int topology_interleave(const Topology* topo, void* addr, size_t len);
+
+/*
+    进程实际可以使用的 CPU 数量，用于确定工作线程的数量
+    - 取亲和性掩码中的 CPU 数量，和 cgroup CPU 配额（quota / period，向上取整）中较小的一个
+    - cgroup v2 读取进程所在的 cgroup 及其所有上级的 cpu.max，v1 读取 cpu.cfs_quota_us 和 cpu.cfs_period_us
+    - 容器中 hardware_concurrency() 返回的是宿主机的 CPU 数量，按它创建线程会超出配额而被限流
+    quota 不为 NULL 时写入配额（可以是小数，例如 1.5），没有配额时写入 0
+    @return 至少为 1
+*/
+int topology_cpu_limit(double* quota);
+
+#endif
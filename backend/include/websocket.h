@@ -0,0 +1,60 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stddef.h>
+
+/*
+    WebSocket（RFC 6455）的帧编解码和握手
+    - 只处理服务器一侧：客户端发来的帧必须带掩码，服务器发出的帧不带掩码
+    - 解析直接在读缓冲区上进行，负载原地去掉掩码，不拷贝
+*/
+
+// 帧的操作码
+enum {
+    WS_OP_CONTINUATION = 0x0,
+    WS_OP_TEXT = 0x1,
+    WS_OP_BINARY = 0x2,
+    WS_OP_CLOSE = 0x8,
+    WS_OP_PING = 0x9,
+    WS_OP_PONG = 0xA,
+};
+
+// 关闭帧的状态码
+enum {
+    WS_CLOSE_NORMAL = 1000,
+    WS_CLOSE_PROTOCOL_ERROR = 1002,
+    WS_CLOSE_UNSUPPORTED = 1003,
+    WS_CLOSE_TOO_BIG = 1009,
+    WS_CLOSE_TRY_AGAIN = 1013,
+};
+
+#define WS_MAX_HEADER_SIZE 10           // 服务器发出的帧头部的最大长度（不带掩码）
+#define WS_MAX_CONTROL_PAYLOAD 125      // 控制帧负载的最大长度
+#define WS_ACCEPT_KEY_SIZE 29           // Sec-WebSocket-Accept 的长度（含结束符）
+
+typedef struct ws_frame_s {
+    int fin;
+    int opcode;
+    char* payload;          // 指向读缓冲区中已经去掉掩码的负载
+    size_t payload_len;
+    size_t frame_len;       // 头部 + 负载的总长度
+}ws_frame_t;
+
+/*
+    解析 [data, data + len) 开头的一个客户端帧，max_payload 为负载的上限
+    @return
+    1: 完整的帧（负载已原地去掉掩码）, 0: 帧不完整（need 为已知需要的总字节数，0 表示未知）, -1: 协议错误
+*/
+int ws_parse_frame(char* data, size_t len, size_t max_payload, ws_frame_t* frame, size_t* need);
+
+// 生成服务器发出的帧头部（FIN 置位，不带掩码），out 至少 WS_MAX_HEADER_SIZE 字节，返回头部长度
+size_t ws_frame_header(char* out, int opcode, size_t payload_len);
+
+/*
+    根据客户端的 Sec-WebSocket-Key 计算 Sec-WebSocket-Accept，out 至少 WS_ACCEPT_KEY_SIZE 字节
+    @return
+    0: success, -1: key 不合法
+*/
+int ws_accept_key(const char* client_key, size_t key_len, char* out);
+
+#endif
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <endian.h>
+#include "binary_connection.h"
+
+BinaryConnection::BinaryConnection() : Connection(), m_close_after_write(false) {
+
+}
+
+BinaryConnection::~BinaryConnection() {
+
+}
+
+void BinaryConnection::init() {
+    this->m_close_after_write = false;
+    this->bytes_to_send = 0;
+    this->bytes_have_send = 0;
+    this->m_read_buf.clear();
+    this->m_write_buf.clear();
+}
+
+bool BinaryConnection::onWriteComplete() {
+    return !this->m_close_after_write;
+}
+
+int BinaryConnection::protocolState() const {
+    return this->m_close_after_write ? -1 : 0;
+}
+
+// 按第一个请求帧的操作码分类：GET、EXIST 和 NOOP 为读，其余为写
+int BinaryConnection::requestLane() const {
+    const char* p = NULL;
+    size_t len = this->peekRead(&p);
+    if (len < 2 || (uint8_t)p[0] != BIN_MAGIC_REQUEST) {
+        return LANE_WRITE;
+    }
+    uint8_t opcode = (uint8_t)p[1];
+    return (opcode == BIN_OP_GET || opcode == BIN_OP_EXIST || opcode == BIN_OP_NOOP) ? LANE_READ : LANE_WRITE;
+}
+
+bool BinaryConnection::routingKey(const char** key, size_t* len) const {
+    const char* p = NULL;
+    size_t n = this->peekRead(&p);
+    if (n < BIN_HEADER_SIZE || (uint8_t)p[0] != BIN_MAGIC_REQUEST) {
+        return false;
+    }
+    BinaryHeader header;
+    decodeHeader(p, &header);
+    if (header.key_len == 0 || n < BIN_HEADER_SIZE + (size_t)header.key_len) {
+        return false;
+    }
+    *key = p + BIN_HEADER_SIZE;
+    *len = header.key_len;
+    return true;
+}
+
+// 头部按字节读取，不要求读缓冲区中的帧按 8 字节对齐
+void BinaryConnection::decodeHeader(const char* data, BinaryHeader* header) {
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+
+    header->magic = (uint8_t)data[0];
+    header->opcode = (uint8_t)data[1];
+    header->engine = (uint8_t)data[2];
+    header->flags = (uint8_t)data[3];
+    memcpy(&u16, data + 4, sizeof(u16));
+    header->key_len = be16toh(u16);
+    memcpy(&u16, data + 6, sizeof(u16));
+    header->reserved = be16toh(u16);
+    memcpy(&u32, data + 8, sizeof(u32));
+    header->value_len = be32toh(u32);
+    memcpy(&u64, data + 12, sizeof(u64));
+    header->request_id = be64toh(u64);
+}
+
+void BinaryConnection::encodeHeader(const BinaryHeader& header, char* data) {
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+
+    data[0] = (char)header.magic;
+    data[1] = (char)header.opcode;
+    data[2] = (char)header.engine;
+    data[3] = (char)header.flags;
+    u16 = htobe16(header.key_len);
+    memcpy(data + 4, &u16, sizeof(u16));
+    u16 = htobe16(header.reserved);
+    memcpy(data + 6, &u16, sizeof(u16));
+    u32 = htobe32(header.value_len);
+    memcpy(data + 8, &u32, sizeof(u32));
+    u64 = htobe64(header.request_id);
+    memcpy(data + 12, &u64, sizeof(u64));
+}
+
+long BinaryConnection::frameLength(const char* p, const char* end, BinaryHeader* header, size_t* need) {
+    *need = 0;
+    if (end - p < BIN_HEADER_SIZE) {
+        return 0;
+    }
+
+    decodeHeader(p, header);
+    if (header->magic != BIN_MAGIC_REQUEST) {
+        return -1;      // 帧边界已经丢失，无法继续解析
+    }
+
+    size_t total = BIN_HEADER_SIZE + (size_t)header->key_len + header->value_len;
+    if (total > static_cast<size_t>(MAX_REQUEST_SIZE)) {
+        return -1;
+    }
+    if ((size_t)(end - p) < total) {
+        *need = total;
+        return 0;
+    }
+    return (long)total;
+}
+
+// 响应头部和 value 追加到写缓冲区
+void BinaryConnection::appendResponse(ChainBuffer* out, const BinaryHeader& request, int status,
+    const char* value, size_t value_len) {
+    BinaryHeader response;
+    response.magic = BIN_MAGIC_RESPONSE;
+    response.opcode = request.opcode;
+    response.engine = request.engine;
+    response.flags = (uint8_t)status;
+    response.key_len = 0;
+    response.reserved = 0;
+    response.value_len = (uint32_t)value_len;
+    response.request_id = request.request_id;
+
+    char data[BIN_HEADER_SIZE];
+    encodeHeader(response, data);
+    out->append(data, BIN_HEADER_SIZE);
+    if (value_len > 0) {
+        out->append(value, value_len);
+    }
+}
+
+// 执行一个请求，key 和 value 指向读缓冲区
+void BinaryConnection::executeRequest(const BinaryHeader& request, const char* key, const char* value,
+    ChainBuffer* out) {
+    if (request.opcode == BIN_OP_NOOP) {
+        appendResponse(out, request, KVS_STATUS_OK, NULL, 0);
+        return;
+    }
+    if (request.opcode >= KVS_OP_COUNT || request.engine >= BIN_ENGINE_COUNT) {
+        appendResponse(out, request, BIN_STATUS_BAD_REQUEST, NULL, 0);
+        return;
+    }
+
+    // 三个引擎的命令按引擎分组，每组 KVS_OP_COUNT 个
+    int cmd_type = KVS_CMD_START + request.engine * KVS_OP_COUNT + request.opcode;
+    bool has_value = request.opcode == BIN_OP_SET || request.opcode == BIN_OP_MOD;
+
+    // GET 在引擎的读锁内直接生成响应，值只拷贝一次（到写缓冲区）
+    struct GetContext {
+        ChainBuffer* out;
+        const BinaryHeader* request;
+    } ctx = { out, &request };
+    auto on_value = [](const char* data, size_t len, void* arg) {
+        GetContext* c = static_cast<GetContext*>(arg);
+        appendResponse(c->out, *c->request, KVS_STATUS_OK, data, len);
+    };
+
+    int status = kvs_execute(cmd_type, key, request.key_len, has_value ? value : NULL, request.value_len,
+        on_value, &ctx);
+    if (status < 0) {
+        status = BIN_STATUS_BAD_REQUEST;
+    }
+
+    if (request.opcode == BIN_OP_GET && status == KVS_STATUS_OK) {
+        return;     // 已经在回调中回复
+    }
+    if ((request.flags & BIN_FLAG_QUIET) && status == KVS_STATUS_OK) {
+        return;
+    }
+    appendResponse(out, request, status, NULL, 0);
+}
+
+// 服务器过载：完整的请求都回复 BUSY，连接保持，不完整的帧留到下一次
+void BinaryConnection::rejectOverloaded(int retry_after_s) {
+    (void)retry_after_s;
+    this->m_write_buf.clear();
+
+    char* base = this->m_read_buf.linearize(1);
+    if (base == NULL) {
+        this->m_read_buf.clear();
+        this->m_close_after_write = true;
+        this->bytes_to_send = 0;
+        return;
+    }
+
+    char* p = base;
+    char* end = base + this->m_read_buf.size();
+    while (p < end) {
+        BinaryHeader request;
+        size_t need = 0;
+        long len = frameLength(p, end, &request, &need);
+        if (len == 0) {
+            break;
+        }
+        if (len < 0) {
+            p = end;
+            this->m_close_after_write = true;
+            break;
+        }
+        appendResponse(&this->m_write_buf, request, BIN_STATUS_BUSY, NULL, 0);
+        p += len;
+    }
+
+    this->m_read_buf.consume(p - base);
+    this->bytes_to_send = this->m_write_buf.size();
+}
+
+// 由线程池中的工作线程调用，处理读缓冲区中所有完整的请求帧
+void BinaryConnection::process() {
+    char* base = this->m_read_buf.linearize(1);
+    if (base == NULL) {
+        this->shutdownConnection();
+        return;
+    }
+
+    char* p = base;
+    char* end = base + this->m_read_buf.size();
+    size_t need = 0;
+    while (p < end) {
+        BinaryHeader request;
+        long len = frameLength(p, end, &request, &need);
+        if (len == 0) {
+            break;
+        }
+        if (len < 0) {
+            // 回复一个请求号为 0 的错误，然后关闭连接
+            BinaryHeader bad;
+            memset(&bad, 0, sizeof(bad));
+            appendResponse(&this->m_write_buf, bad, BIN_STATUS_BAD_REQUEST, NULL, 0);
+            this->m_close_after_write = true;
+            p = end;
+            break;
+        }
+
+        const char* key = p + BIN_HEADER_SIZE;
+        executeRequest(request, key, key + request.key_len, &this->m_write_buf);
+        p += len;
+    }
+
+    this->m_read_buf.consume(p - base);
+    if (this->m_close_after_write) {
+        this->m_read_buf.clear();
+    }
+    else if (need > this->m_read_buf.size()) {
+        // 不完整的大帧：按头部中的长度一次预留连续空间，后续数据直接读到后面
+        if (this->m_read_buf.linearize(need - this->m_read_buf.size() + 1) == NULL) {
+            this->shutdownConnection();
+            return;
+        }
+    }
+
+    if (this->m_write_buf.empty()) {
+        // 没有完整的请求，或者全部是静默请求
+        this->rearm(EPOLLIN);
+        return;
+    }
+
+    this->bytes_to_send = this->m_write_buf.size();
+    this->flush();
+}
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <mutex>
+#include "buffer.h"
+
+// 块池的分级：4KB、16KB、64KB、256KB、1MB
+static const int POOL_CLASS_COUNT = 5;
+static const size_t POOL_CACHE_BYTES = 16 * 1024 * 1024;   // 每个等级最多缓存的字节数
+
+struct BufferClass {
+    std::mutex mtx;
+    BufferBlock* free_list;     // 空闲块链表，复用 BufferBlock::next
+    size_t free_count;
+};
+
+static BufferClass pool_classes[BufferPool::MAX_NODES][POOL_CLASS_COUNT];
+static thread_local int t_buffer_node = 0;     // 调用线程所在的节点
+
+// 等级 i 对应的块大小（含块头）
+static inline size_t classSize(int i) {
+    return BufferPool::MIN_BLOCK_SIZE << (2 * i);
+}
+
+// 返回能容纳 total 字节（含块头）的最小等级，超出可缓存范围返回 -1
+static inline int classIndex(size_t total) {
+    for (int i = 0; i < POOL_CLASS_COUNT; ++i) {
+        if (total <= classSize(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+BufferBlock* BufferPool::acquire(size_t min_cap) {
+    size_t total = min_cap + sizeof(BufferBlock);
+    int idx = classIndex(total);
+    BufferBlock* block = NULL;
+
+    if (idx >= 0) {
+        BufferClass& cls = pool_classes[t_buffer_node][idx];
+        {
+            std::lock_guard<std::mutex> lock(cls.mtx);
+            block = cls.free_list;
+            if (block != NULL) {
+                cls.free_list = block->next;
+                --cls.free_count;
+            }
+        }
+        total = classSize(idx);
+    }
+
+    if (block == NULL) {
+        block = (BufferBlock*)malloc(total);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->cap = total - sizeof(BufferBlock);
+        block->node = t_buffer_node;
+    }
+
+    block->next = NULL;
+    block->start = 0;
+    block->end = 0;
+    return block;
+}
+
+void BufferPool::release(BufferBlock* block) {
+    if (block == NULL) {
+        return;
+    }
+
+    int idx = classIndex(block->cap + sizeof(BufferBlock));
+    if (idx >= 0 && classSize(idx) == block->cap + sizeof(BufferBlock)) {
+        BufferClass& cls = pool_classes[block->node][idx];
+        std::lock_guard<std::mutex> lock(cls.mtx);
+        if (cls.free_count * classSize(idx) < POOL_CACHE_BYTES) {
+            block->next = cls.free_list;
+            cls.free_list = block;
+            ++cls.free_count;
+            return;
+        }
+    }
+
+    // 大块或者缓存已满，直接还给系统
+    free(block);
+}
+
+size_t BufferPool::cachedBytes() {
+    size_t bytes = 0;
+    for (int node = 0; node < MAX_NODES; ++node) {
+        for (int i = 0; i < POOL_CLASS_COUNT; ++i) {
+            std::lock_guard<std::mutex> lock(pool_classes[node][i].mtx);
+            bytes += pool_classes[node][i].free_count * classSize(i);
+        }
+    }
+    return bytes;
+}
+
+void BufferPool::setThreadNode(int node) {
+    t_buffer_node = node >= 0 ? node % MAX_NODES : 0;
+}
+
+// =============== ChainBuffer =======================
+ChainBuffer::ChainBuffer() : m_head(NULL), m_tail(NULL), m_size(0) {
+
+}
+
+ChainBuffer::~ChainBuffer() {
+    this->clear();
+}
+
+// 在链尾追加一个新块，新块大小随已有数据量倍增，单块上限为池中最大的等级
+BufferBlock* ChainBuffer::grow(size_t min_cap) {
+    size_t cap = this->m_size;
+    if (cap > BufferPool::MAX_POOLED_BLOCK_SIZE - sizeof(BufferBlock)) {
+        cap = BufferPool::MAX_POOLED_BLOCK_SIZE - sizeof(BufferBlock);
+    }
+    if (cap < min_cap) {
+        cap = min_cap;
+    }
+
+    BufferBlock* block = BufferPool::acquire(cap);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    if (this->m_tail == NULL) {
+        this->m_head = this->m_tail = block;
+    }
+    else {
+        this->m_tail->next = block;
+        this->m_tail = block;
+    }
+    return block;
+}
+
+char* ChainBuffer::prepareWrite(size_t* avail) {
+    BufferBlock* block = this->m_tail;
+    if (block == NULL || block->writable() == 0) {
+        block = this->grow(1);
+        if (block == NULL) {
+            *avail = 0;
+            return NULL;
+        }
+    }
+    *avail = block->writable();
+    return block->data() + block->end;
+}
+
+void ChainBuffer::commitWrite(size_t len) {
+    this->m_tail->end += len;
+    this->m_size += len;
+}
+
+bool ChainBuffer::append(const char* data, size_t len) {
+    while (len > 0) {
+        BufferBlock* block = this->m_tail;
+        if (block == NULL || block->writable() == 0) {
+            block = this->grow(len);
+            if (block == NULL) {
+                return false;
+            }
+        }
+
+        size_t n = block->writable() < len ? block->writable() : len;
+        memcpy(block->data() + block->end, data, n);
+        block->end += n;
+        this->m_size += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool ChainBuffer::appendFormat(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    bool ret = this->vappendFormat(format, args);
+    va_end(args);
+    return ret;
+}
+
+size_t formatDecimal(char* out, unsigned long long value) {
+    static const char digits[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // 从低位向高位写到临时数组的末尾
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        unsigned idx = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = digits[idx + 1];
+        *--p = digits[idx];
+    }
+    if (value >= 10) {
+        unsigned idx = (unsigned)value * 2;
+        *--p = digits[idx + 1];
+        *--p = digits[idx];
+    }
+    else {
+        *--p = (char)('0' + value);
+    }
+
+    size_t len = tmp + sizeof(tmp) - p;
+    memcpy(out, p, len);
+    return len;
+}
+
+bool ChainBuffer::appendDecimal(unsigned long long value) {
+    char digits[20];
+    return this->append(digits, formatDecimal(digits, value));
+}
+
+bool ChainBuffer::vappendFormat(const char* format, va_list args) {
+    // 先尝试直接格式化到尾块的剩余空间中
+    va_list copy;
+    va_copy(copy, args);
+    BufferBlock* block = this->m_tail;
+    size_t writable = (block != NULL) ? block->writable() : 0;
+    int len = vsnprintf(writable ? block->data() + block->end : NULL, writable, format, copy);
+    va_end(copy);
+
+    if (len < 0) {
+        return false;
+    }
+
+    if (static_cast<size_t>(len) >= writable) {
+        // 尾块放不下（vsnprintf 需要额外的 '\0'），补一个足够大的块重新格式化
+        block = this->grow(len + 1);
+        if (block == NULL) {
+            return false;
+        }
+        vsnprintf(block->data(), block->cap, format, args);
+    }
+
+    block->end += len;
+    this->m_size += len;
+    return true;
+}
+
+void ChainBuffer::appendChain(ChainBuffer& other) {
+    if (other.m_head == NULL) {
+        return;
+    }
+
+    if (this->m_tail == NULL) {
+        this->m_head = other.m_head;
+    }
+    else {
+        this->m_tail->next = other.m_head;
+    }
+    this->m_tail = other.m_tail;
+    this->m_size += other.m_size;
+
+    other.m_head = other.m_tail = NULL;
+    other.m_size = 0;
+}
+
+int ChainBuffer::peekIovec(struct iovec* iov, int max_iov) const {
+    int count = 0;
+    for (BufferBlock* block = this->m_head; block != NULL && count < max_iov; block = block->next) {
+        if (block->readable() == 0) {
+            continue;
+        }
+        iov[count].iov_base = block->data() + block->start;
+        iov[count].iov_len = block->readable();
+        ++count;
+    }
+    return count;
+}
+
+void ChainBuffer::consume(size_t len) {
+    while (len > 0 && this->m_head != NULL) {
+        BufferBlock* block = this->m_head;
+        size_t n = block->readable() < len ? block->readable() : len;
+        block->start += n;
+        this->m_size -= n;
+        len -= n;
+
+        if (block->readable() == 0) {
+            // 块已读空，归还到池中
+            this->m_head = block->next;
+            if (this->m_head == NULL) {
+                this->m_tail = NULL;
+            }
+            BufferPool::release(block);
+        }
+    }
+}
+
+char* ChainBuffer::linearize(size_t reserve) {
+    BufferBlock* head = this->m_head;
+    if (head != NULL && head == this->m_tail && head->writable() >= reserve) {
+        // 已经是连续数据且空间足够
+        return head->data() + head->start;
+    }
+
+    BufferBlock* block = BufferPool::acquire(this->m_size + reserve);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    for (BufferBlock* cur = this->m_head; cur != NULL;) {
+        memcpy(block->data() + block->end, cur->data() + cur->start, cur->readable());
+        block->end += cur->readable();
+        BufferBlock* next = cur->next;
+        BufferPool::release(cur);
+        cur = next;
+    }
+
+    this->m_head = this->m_tail = block;
+    return block->data();
+}
+
+void ChainBuffer::clear() {
+    while (this->m_head != NULL) {
+        BufferBlock* block = this->m_head;
+        this->m_head = block->next;
+        BufferPool::release(block);
+    }
+    this->m_tail = NULL;
+    this->m_size = 0;
+}
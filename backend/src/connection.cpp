@@ -0,0 +1,231 @@
+#include "connection.h"
+
+// 静态成员变量需要初始化
+int Connection::m_epoll_fd = -1;
+int Connection::m_user_count = 0;
+
+// 设置文件描述符非阻塞
+int setNonBlocking(int fd) {
+    int old_option = fcntl(fd, F_GETFL);
+    int new_option = old_option | O_NONBLOCK;
+    fcntl(fd, F_SETFL, new_option);
+    return old_option;
+}
+
+// 添加fd到epoll对象中
+void addFDEpoll(int epoll_fd, int fd, bool et, bool one_shot) {
+
+    epoll_event event;
+    event.data.fd = fd;
+
+    event.events = EPOLLIN | EPOLLRDHUP;    // EPOLLRDHUP可以检测文件描述符对应的客户端断开连接，交给内核处理
+
+    if (et) {
+        event.events |= EPOLLET;
+    }
+
+    if (one_shot) {
+        // EPOLLNONESHOT事件属性限制一个线程操作一个socket
+        event.events |= EPOLLONESHOT;
+    }
+
+    // 添加
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+    setNonBlocking(fd);
+}
+
+// 从epoll对象删除fd
+void removeFDEpoll(int epoll_fd, int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    //printf("close fd = %d.\n", fd);
+    close(fd);
+}
+
+// 修改epoll对象中的fd
+void modifyFDEpoll(int epoll_fd, int fd, int event_num) {
+    epoll_event event;
+    event.data.fd = fd;
+
+    // 重置socket上的EPOLLONESHOT事件，以确保下一次可读时，EPOLLIN事件能被触发
+    event.events = event_num | EPOLLONESHOT | EPOLLRDHUP | EPOLLET;
+
+    // 修改
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+Connection::Connection() : m_sockfd(-1), bytes_to_send(0), bytes_have_send(0), m_armed(false),
+    m_push_enabled(false) {
+
+}
+
+Connection::~Connection() {
+
+}
+
+// 关闭客户端连接
+void Connection::closeConnection() {
+    if (this->m_sockfd != -1) {
+        removeFDEpoll(this->m_epoll_fd, this->m_sockfd);
+        this->m_sockfd = -1;
+        --this->m_user_count;       // 连接的客户端总数量减一
+    }
+}
+
+/*
+    工作线程不能直接关闭连接（主线程随时可能复用同一个文件描述符或回收连接对象），
+    这里只关闭 socket 的读写并重新注册事件，主线程收到 EPOLLRDHUP/EPOLLHUP 后再关闭连接、回收对象
+    调用之后工作线程不能再访问该连接对象
+*/
+void Connection::shutdownConnection() {
+    shutdown(this->m_sockfd, SHUT_RDWR);
+    this->rearm(EPOLLIN);
+}
+
+/*
+    先标记为空闲再注册事件：注册之后事件可能立即到达，主线程必须能看到连接已经空闲
+    标记之后主线程可能取得连接（主动推送），所以文件描述符要在标记之前取出
+*/
+void Connection::rearm(int events) {
+    int sockfd = this->m_sockfd;
+    this->m_armed.store(true, std::memory_order_release);
+    modifyFDEpoll(this->m_epoll_fd, sockfd, events);
+}
+
+// 读缓冲区中的数据还没有处理完，或者响应还没有发送完，连接就不能移交
+int Connection::handoffState() const {
+    if (!this->m_read_buf.empty() || this->bytes_to_send > 0) {
+        return -1;
+    }
+    return this->protocolState();
+}
+
+// 读缓冲区第一个块中的数据
+size_t Connection::peekRead(const char** data) const {
+    struct iovec iov;
+    if (this->m_read_buf.peekIovec(&iov, 1) != 1) {
+        *data = NULL;
+        return 0;
+    }
+    *data = (const char*)iov.iov_base;
+    return iov.iov_len;
+}
+
+// 初始化客户端连接
+void Connection::init(int sockfd, const sockaddr_in& client_addr) {
+    this->m_sockfd = sockfd;
+    this->m_client_addr = client_addr;
+
+    // 设置端口复用
+    int reuse = 1;
+    setsockopt(this->m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    this->m_push_enabled.store(false, std::memory_order_relaxed);
+    this->m_armed.store(true, std::memory_order_release);
+
+    // 指定 EPOLLONESHOT, 一个线程处理一个socket
+    addFDEpoll(this->m_epoll_fd, this->m_sockfd, true, true);
+    ++this->m_user_count;
+
+    // 初始化协议相关的信息
+    this->init();
+}
+
+// 循环读取TCP内核缓冲区数据
+bool Connection::read() {
+    // 请求超过上限，不再继续读取
+    if (this->m_read_buf.size() >= static_cast<size_t>(MAX_REQUEST_SIZE)) {
+        return false;
+    }
+
+    int bytes_read = 0;
+
+    // EPOLLET
+    while (true) {
+        // 尾块写满时，读缓冲区从池中补充新块
+        size_t avail = 0;
+        char* buf = this->m_read_buf.prepareWrite(&avail);
+        if (buf == NULL) {
+            return false;
+        }
+
+        bytes_read = recv(this->m_sockfd, buf, avail, 0);
+        if (bytes_read == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // 返回EAGAIN或EWOULDBLOCK表示没有数据可读
+                break;
+            }
+            else {
+                // 其它错误，直接返回
+                return false;
+            }
+        }
+        else if (bytes_read == 0) {
+            // 对方关闭连接
+            return false;
+        }
+        this->m_read_buf.commitWrite(bytes_read);
+        if (this->m_read_buf.size() >= static_cast<size_t>(MAX_REQUEST_SIZE)) {
+            break;
+        }
+    }
+
+    if (this->m_read_buf.empty()) {
+        // 没有读到数据，不持有空块
+        this->m_read_buf.clear();
+    }
+    return true;
+}
+
+// 把写缓冲区中的数据分散写到 socket
+Connection::WRITE_RESULT Connection::sendBuffered() {
+    while (this->bytes_to_send > 0) {
+        struct iovec iov[MAX_WRITE_IOV];
+        int iov_count = this->m_write_buf.peekIovec(iov, MAX_WRITE_IOV);
+
+        int tmp = writev(this->m_sockfd, iov, iov_count);
+        if (tmp <= -1) {
+            // TCP 写缓冲区满，等待下一轮 EPOLLOUT 事件
+            return errno == EAGAIN ? WRITE_AGAIN : WRITE_ERROR;
+        }
+
+        this->bytes_have_send += tmp;
+        this->bytes_to_send -= tmp;
+        this->m_write_buf.consume(tmp);
+    }
+
+    this->bytes_to_send = 0;
+    this->bytes_have_send = 0;
+    return WRITE_COMPLETE;
+}
+
+/*
+    主线程收到 EPOLLOUT 或者直接生成响应（过载、主动推送）之后调用
+    完成回调在重新注册之前执行：回调会重置协议状态，注册之后连接可能立即被交给工作线程
+*/
+bool Connection::write() {
+    WRITE_RESULT ret = this->sendBuffered();
+    if (ret == WRITE_AGAIN) {
+        this->rearm(EPOLLOUT);
+        return true;
+    }
+    if (ret == WRITE_ERROR || !this->onWriteComplete()) {
+        return false;
+    }
+    this->rearm(EPOLLIN);
+    return true;
+}
+
+// 工作线程直接发送响应，rearm() 和 shutdownConnection() 都是对连接对象的最后一次访问
+void Connection::flush() {
+    WRITE_RESULT ret = this->sendBuffered();
+    if (ret == WRITE_AGAIN) {
+        this->rearm(EPOLLOUT);
+        return;
+    }
+    if (ret == WRITE_ERROR || !this->onWriteComplete()) {
+        this->shutdownConnection();
+        return;
+    }
+    this->rearm(EPOLLIN);
+}
@@ -0,0 +1,315 @@
+#include <math.h>
+#include "fair_queue.h"
+
+// 按经过的时间补充令牌，不超过桶的容量
+static void refill(double* tokens, uint64_t* last_ms, double rate, double burst, uint64_t now_ms) {
+    if (now_ms > *last_ms) {
+        *tokens += (double)(now_ms - *last_ms) * rate / 1000.0;
+        if (*tokens > burst) {
+            *tokens = burst;
+        }
+        *last_ms = now_ms;
+    }
+}
+
+// 再取一个令牌之后需要等待的毫秒数（透支的令牌按速率补回来的时间）
+static uint64_t debtWaitMs(double tokens, double rate) {
+    double left = tokens - 1.0;
+    if (left >= 0) {
+        return 0;
+    }
+    return (uint64_t)ceil(-left * 1000.0 / rate);
+}
+
+FairQueue::FairQueue(int max_fd)
+    : m_slots(max_fd), m_queued(0), m_waiting(0), m_client_rate(0), m_client_burst(0),
+    m_conn_rate(0), m_conn_burst(0), m_max_delay_ms(0) {
+    for (Slot& slot : this->m_slots) {
+        slot.client = NULL;
+        slot.state = SLOT_IDLE;
+        slot.lane = LANE_WRITE;
+        slot.prev = -1;
+        slot.next = -1;
+        slot.generation = 0;
+    }
+    for (int lane = 0; lane < LANE_COUNT; ++lane) {
+        this->m_lane_queued[lane] = 0;
+        this->m_lane_weight[lane] = 1;
+        this->m_lane_current[lane] = 0;
+    }
+}
+
+void FairQueue::setLaneWeights(const int weights[LANE_COUNT]) {
+    for (int lane = 0; lane < LANE_COUNT; ++lane) {
+        this->m_lane_weight[lane] = weights[lane] > 0 ? weights[lane] : 0;
+        this->m_lane_current[lane] = 0;
+    }
+}
+
+void FairQueue::setLimits(double client_rate, double client_burst, double conn_rate, double conn_burst,
+    int max_delay_ms) {
+    this->m_client_rate = client_rate > 0 ? client_rate : 0;
+    this->m_client_burst = client_burst > 0 ? client_burst : this->m_client_rate;
+    if (this->m_client_burst < 1) {
+        this->m_client_burst = 1;
+    }
+    this->m_conn_rate = conn_rate > 0 ? conn_rate : 0;
+    this->m_conn_burst = conn_burst > 0 ? conn_burst : this->m_conn_rate;
+    if (this->m_conn_burst < 1) {
+        this->m_conn_burst = 1;
+    }
+    this->m_max_delay_ms = max_delay_ms > 0 ? max_delay_ms : 0;
+}
+
+void FairQueue::addConnection(int fd, uint32_t client, uint64_t now_ms) {
+    auto result = this->m_clients.try_emplace(client);
+    Client& c = result.first->second;
+    if (result.second) {
+        c.bucket.tokens = this->m_client_burst;
+        c.bucket.last_ms = now_ms;
+        c.connections = 0;
+        for (Flow& flow : c.flows) {
+            flow.head = -1;
+            flow.tail = -1;
+            flow.deficit = 0;
+            flow.in_ring = false;
+            flow.turn_started = false;
+        }
+    }
+    ++c.connections;
+
+    Slot& slot = this->m_slots[fd];
+    slot.client = &c;
+    slot.bucket.tokens = this->m_conn_burst;
+    slot.bucket.last_ms = now_ms;
+    slot.state = SLOT_IDLE;
+    slot.prev = -1;
+    slot.next = -1;
+}
+
+void FairQueue::removeConnection(int fd) {
+    Slot& slot = this->m_slots[fd];
+    if (slot.client == NULL) {
+        return;
+    }
+    if (slot.state == SLOT_QUEUED) {
+        this->unlink(fd);
+        --this->m_queued;
+        --this->m_lane_queued[slot.lane];
+    }
+    else if (slot.state == SLOT_DELAYED) {
+        --this->m_waiting;      // 延迟队列中的记录按 generation 识别为过时，到期时丢弃
+    }
+    --slot.client->connections;
+    slot.client = NULL;
+    slot.state = SLOT_IDLE;
+    ++slot.generation;
+}
+
+void FairQueue::push(int fd) {
+    Slot& slot = this->m_slots[fd];
+    Flow* flow = &slot.client->flows[slot.lane];
+    slot.state = SLOT_QUEUED;
+    slot.prev = flow->tail;
+    slot.next = -1;
+    if (flow->tail != -1) {
+        this->m_slots[flow->tail].next = fd;
+    }
+    else {
+        flow->head = fd;
+    }
+    flow->tail = fd;
+    ++this->m_queued;
+    ++this->m_lane_queued[slot.lane];
+
+    if (!flow->in_ring) {
+        flow->in_ring = true;
+        flow->turn_started = false;
+        flow->deficit = 0;
+        this->m_rings[slot.lane].push_back(flow);
+    }
+}
+
+void FairQueue::unlink(int fd) {
+    Slot& slot = this->m_slots[fd];
+    Flow* flow = &slot.client->flows[slot.lane];
+    if (slot.prev != -1) {
+        this->m_slots[slot.prev].next = slot.next;
+    }
+    else {
+        flow->head = slot.next;
+    }
+    if (slot.next != -1) {
+        this->m_slots[slot.next].prev = slot.prev;
+    }
+    else {
+        flow->tail = slot.prev;
+    }
+    slot.prev = -1;
+    slot.next = -1;
+}
+
+int FairQueue::submit(int fd, int lane, size_t cost, uint64_t now_ms, uint64_t* wait_ms) {
+    Slot& slot = this->m_slots[fd];
+    Client* c = slot.client;
+
+    // 两个桶都要满足：先算出各自需要等待的时间，不超过上限时再一起扣除
+    uint64_t wait = 0;
+    if (this->m_conn_rate > 0) {
+        refill(&slot.bucket.tokens, &slot.bucket.last_ms, this->m_conn_rate, this->m_conn_burst, now_ms);
+        uint64_t w = debtWaitMs(slot.bucket.tokens, this->m_conn_rate);
+        wait = w > wait ? w : wait;
+    }
+    if (this->m_client_rate > 0) {
+        refill(&c->bucket.tokens, &c->bucket.last_ms, this->m_client_rate, this->m_client_burst, now_ms);
+        uint64_t w = debtWaitMs(c->bucket.tokens, this->m_client_rate);
+        wait = w > wait ? w : wait;
+    }
+    if (wait_ms != NULL) {
+        *wait_ms = wait;
+    }
+    if (wait > this->m_max_delay_ms) {
+        return FAIR_REJECTED;
+    }
+    if (this->m_conn_rate > 0) {
+        slot.bucket.tokens -= 1.0;
+    }
+    if (this->m_client_rate > 0) {
+        c->bucket.tokens -= 1.0;
+    }
+
+    slot.lane = lane >= 0 && lane < LANE_COUNT ? lane : LANE_WRITE;
+    slot.cost = cost > 0 ? cost : 1;
+    // 延迟的请求从到期时开始算排队时间，排队期限不包括限流的等待
+    slot.queued_ms = now_ms + wait;
+    if (wait == 0) {
+        this->push(fd);
+        return FAIR_QUEUED;
+    }
+
+    slot.state = SLOT_DELAYED;
+    Delayed delayed = { now_ms + wait, fd, slot.generation };
+    this->m_delayed.push(delayed);
+    ++this->m_waiting;
+    return FAIR_DELAYED;
+}
+
+// 平滑加权轮询：每次给候选通道加上各自的权重，选当前值最大的，再减去总权重
+int FairQueue::pickLane(unsigned lanes) {
+    int best = -1;
+    int total = 0;
+    for (int lane = 0; lane < LANE_COUNT; ++lane) {
+        if (!(lanes & (1u << lane)) || this->m_lane_queued[lane] == 0) {
+            continue;
+        }
+        this->m_lane_current[lane] += this->m_lane_weight[lane];
+        total += this->m_lane_weight[lane];
+        if (best == -1 || this->m_lane_current[lane] > this->m_lane_current[best]) {
+            best = lane;
+        }
+    }
+    if (best != -1) {
+        this->m_lane_current[best] -= total;
+    }
+    return best;
+}
+
+int FairQueue::next(uint64_t now_ms, unsigned lanes, uint64_t* queued_ms, int* lane) {
+    while (!this->m_delayed.empty() && this->m_delayed.top().ready_ms <= now_ms) {
+        Delayed delayed = this->m_delayed.top();
+        this->m_delayed.pop();
+        Slot& slot = this->m_slots[delayed.fd];
+        if (slot.state != SLOT_DELAYED || slot.generation != delayed.generation) {
+            continue;
+        }
+        --this->m_waiting;
+        this->push(delayed.fd);
+    }
+
+    int picked = this->pickLane(lanes);
+    if (picked == -1) {
+        return -1;
+    }
+
+    // 通道中有排队的请求，轮询环中一定有非空的队列
+    std::deque<Flow*>& ring = this->m_rings[picked];
+    while (!ring.empty()) {
+        Flow* flow = ring.front();
+        if (flow->head == -1) {
+            // 排队的连接都已关闭
+            flow->in_ring = false;
+            ring.pop_front();
+            continue;
+        }
+        if (!flow->turn_started) {
+            flow->deficit += QUANTUM;
+            flow->turn_started = true;
+        }
+
+        int fd = flow->head;
+        Slot& slot = this->m_slots[fd];
+        if (slot.cost > flow->deficit && ring.size() == 1) {
+            flow->deficit = slot.cost;  // 没有其他客户端在等待，不必一轮一轮地累积额度
+        }
+        if (slot.cost > flow->deficit) {
+            // 额度不够，轮到下一个客户端，剩余的额度留到下一轮
+            flow->turn_started = false;
+            ring.pop_front();
+            ring.push_back(flow);
+            continue;
+        }
+
+        flow->deficit -= slot.cost;
+        this->unlink(fd);
+        slot.state = SLOT_IDLE;
+        --this->m_queued;
+        if (--this->m_lane_queued[picked] == 0) {
+            this->m_lane_current[picked] = 0;
+        }
+        if (flow->head == -1) {
+            // 队列空了，剩余的额度作废，下一次排队时重新开始
+            flow->in_ring = false;
+            flow->deficit = 0;
+            ring.pop_front();
+        }
+        if (queued_ms != NULL) {
+            *queued_ms = slot.queued_ms;
+        }
+        if (lane != NULL) {
+            *lane = picked;
+        }
+        return fd;
+    }
+    return -1;
+}
+
+int FairQueue::timeoutMs(uint64_t now_ms) const {
+    if (this->m_delayed.empty()) {
+        return -1;
+    }
+    uint64_t ready = this->m_delayed.top().ready_ms;
+    return ready > now_ms ? (int)(ready - now_ms) : 0;
+}
+
+void FairQueue::collect(uint64_t now_ms) {
+    for (auto it = this->m_clients.begin(); it != this->m_clients.end();) {
+        Client& c = it->second;
+        bool queued = false;
+        for (const Flow& flow : c.flows) {
+            queued = queued || flow.in_ring;
+        }
+        if (c.connections > 0 || queued) {
+            ++it;
+            continue;
+        }
+        // 透支的令牌还没有补回来时保留，避免客户端断开重连就能绕过限流
+        if (this->m_client_rate > 0) {
+            refill(&c.bucket.tokens, &c.bucket.last_ms, this->m_client_rate, this->m_client_burst, now_ms);
+            if (c.bucket.tokens < this->m_client_burst) {
+                ++it;
+                continue;
+            }
+        }
+        it = this->m_clients.erase(it);
+    }
+}
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "hot_restart.h"
+#include "kvs_handler.h"
+
+#define HANDOFF_MAGIC 0x31484b56u       // "VKH1"
+#define HANDOFF_BUF_SIZE (64 * 1024)
+
+// 快照中的记录类型
+enum {
+    HANDOFF_REC_ENTRY = 1,      // engine, version, key_len, value_len, key, value
+    HANDOFF_REC_VERSION,        // engine, 引擎发出的最后一个版本号
+    HANDOFF_REC_END,            // 快照结束
+};
+
+// 快照之后的文件描述符消息，每条消息用 SCM_RIGHTS 携带一个 fd，END 不带 fd
+enum {
+    HANDOFF_MSG_FD = 1,
+    HANDOFF_MSG_END,
+};
+
+typedef struct handoff_fd_msg_s {
+    uint8_t type;
+    uint8_t kind;
+    uint16_t state;
+}handoff_fd_msg_t;
+
+static const char HANDOFF_ACK = 'A';
+
+static int fill_addr(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (path == NULL || strlen(path) >= sizeof(addr->sun_path)) {
+        return -1;
+    }
+    strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+    return 0;
+}
+
+static void set_timeout(int sock) {
+    struct timeval tv;
+    tv.tv_sec = HANDOFF_IO_TIMEOUT_S;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int write_all(int sock, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int handoff_listen(const char* path) {
+    struct sockaddr_un addr;
+    if (fill_addr(path, &addr) != 0) {
+        return -1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        return -1;
+    }
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(listen_fd, 1) == -1) {
+        close(listen_fd);
+        return -1;
+    }
+    return listen_fd;
+}
+
+int handoff_accept(int listen_fd) {
+    int sock = accept(listen_fd, NULL, NULL);
+    if (sock == -1) {
+        return -1;
+    }
+    // 监听 socket 是非阻塞的，移交过程按阻塞方式读写
+    int flags = fcntl(sock, F_GETFL);
+    fcntl(sock, F_SETFL, flags & ~O_NONBLOCK);
+    set_timeout(sock);
+    return sock;
+}
+
+int handoff_connect(const char* path) {
+    struct sockaddr_un addr;
+    if (fill_addr(path, &addr) != 0) {
+        return -1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+    set_timeout(sock);
+    return sock;
+}
+
+/*
+    快照的写端：小记录先拼到缓冲区中，缓冲区放不下的 key 和 value 直接发送
+    回调在引擎的读锁内执行，出错之后只记录，不再发送
+*/
+typedef struct handoff_writer_s {
+    int sock;
+    int failed;
+    size_t len;
+    char buf[HANDOFF_BUF_SIZE];
+}handoff_writer_t;
+
+static void writer_flush(handoff_writer_t* w) {
+    if (!w->failed && w->len > 0 && write_all(w->sock, w->buf, w->len) != 0) {
+        w->failed = 1;
+    }
+    w->len = 0;
+}
+
+static void writer_put(handoff_writer_t* w, const void* data, size_t len) {
+    if (w->failed) {
+        return;
+    }
+    if (w->len + len > sizeof(w->buf)) {
+        writer_flush(w);
+        if (len > sizeof(w->buf)) {
+            if (!w->failed && write_all(w->sock, (const char*)data, len) != 0) {
+                w->failed = 1;
+            }
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+typedef struct handoff_dump_ctx_s {
+    handoff_writer_t* writer;
+    uint8_t engine;
+}handoff_dump_ctx_t;
+
+static void dump_entry(const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_version_t version, void* arg) {
+    handoff_dump_ctx_t* ctx = (handoff_dump_ctx_t*)arg;
+    uint8_t head[2] = { HANDOFF_REC_ENTRY, ctx->engine };
+    uint64_t lens[3] = { version, key_len, value_len };
+    writer_put(ctx->writer, head, sizeof(head));
+    writer_put(ctx->writer, lens, sizeof(lens));
+    writer_put(ctx->writer, key, key_len);
+    writer_put(ctx->writer, value, value_len);
+}
+
+int handoff_send_snapshot(int sock) {
+    handoff_writer_t* w = (handoff_writer_t*)malloc(sizeof(handoff_writer_t));
+    if (w == NULL) {
+        return -1;
+    }
+    w->sock = sock;
+    w->failed = 0;
+    w->len = 0;
+
+    uint32_t magic = HANDOFF_MAGIC;
+    uint64_t boot_id = kvs_get_boot_id();
+    writer_put(w, &magic, sizeof(magic));
+    writer_put(w, &boot_id, sizeof(boot_id));
+
+    for (int engine = 0; engine < KVS_ENGINE_COUNT; ++engine) {
+        handoff_dump_ctx_t ctx = { w, (uint8_t)engine };
+        uint64_t last_version = kvs_dump(engine, dump_entry, &ctx);
+
+        uint8_t head[2] = { HANDOFF_REC_VERSION, (uint8_t)engine };
+        writer_put(w, head, sizeof(head));
+        writer_put(w, &last_version, sizeof(last_version));
+    }
+
+    uint8_t end = HANDOFF_REC_END;
+    writer_put(w, &end, sizeof(end));
+    writer_flush(w);
+    int failed = w->failed;
+    free(w);
+    if (failed) {
+        return -1;
+    }
+
+    // 新进程载入完成之前不能发送文件描述符：快照的读端是带缓冲的，可能读到后面的消息
+    char ack = 0;
+    ssize_t n;
+    do {
+        n = recv(sock, &ack, 1, 0);
+    } while (n < 0 && errno == EINTR);
+    return (n == 1 && ack == HANDOFF_ACK) ? 0 : -1;
+}
+
+// 快照的读端
+typedef struct handoff_reader_s {
+    int sock;
+    size_t pos;
+    size_t len;
+    char buf[HANDOFF_BUF_SIZE];
+}handoff_reader_t;
+
+static int reader_get(handoff_reader_t* r, void* out, size_t len) {
+    char* dst = (char*)out;
+    while (len > 0) {
+        if (r->pos == r->len) {
+            ssize_t n = recv(r->sock, r->buf, sizeof(r->buf), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return -1;
+            }
+            r->pos = 0;
+            r->len = (size_t)n;
+        }
+        size_t chunk = r->len - r->pos < len ? r->len - r->pos : len;
+        memcpy(dst, r->buf + r->pos, chunk);
+        r->pos += chunk;
+        dst += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+static int load_snapshot(handoff_reader_t* r) {
+    uint32_t magic = 0;
+    uint64_t boot_id = 0;
+    if (reader_get(r, &magic, sizeof(magic)) != 0 || magic != HANDOFF_MAGIC ||
+        reader_get(r, &boot_id, sizeof(boot_id)) != 0) {
+        return -1;
+    }
+    kvs_set_boot_id((unsigned long)boot_id);
+
+    // key 和 value 读到同一块内存中，按最大的记录增长
+    char* data = NULL;
+    size_t capacity = 0;
+    int ret = -1;
+    while (true) {
+        uint8_t type = 0;
+        if (reader_get(r, &type, sizeof(type)) != 0) {
+            break;
+        }
+        if (type == HANDOFF_REC_END) {
+            ret = 0;
+            break;
+        }
+
+        uint8_t engine = 0;
+        if (reader_get(r, &engine, sizeof(engine)) != 0 || engine >= KVS_ENGINE_COUNT) {
+            break;
+        }
+        if (type == HANDOFF_REC_VERSION) {
+            uint64_t last_version = 0;
+            if (reader_get(r, &last_version, sizeof(last_version)) != 0) {
+                break;
+            }
+            kvs_restore_version(engine, last_version);
+            continue;
+        }
+        if (type != HANDOFF_REC_ENTRY) {
+            break;
+        }
+
+        uint64_t lens[3];
+        if (reader_get(r, lens, sizeof(lens)) != 0 || lens[1] > SIZE_MAX / 2 || lens[2] > SIZE_MAX / 2) {
+            break;
+        }
+        size_t need = lens[1] + lens[2];
+        if (need > capacity) {
+            char* grown = (char*)realloc(data, need);
+            if (grown == NULL) {
+                break;
+            }
+            data = grown;
+            capacity = need;
+        }
+        if (reader_get(r, data, need) != 0) {
+            break;
+        }
+        if (kvs_restore(engine, data, lens[1], data + lens[1], lens[2], lens[0]) != KVS_STATUS_OK) {
+            break;
+        }
+    }
+    free(data);
+    return ret;
+}
+
+int handoff_recv_snapshot(int sock) {
+    handoff_reader_t* r = (handoff_reader_t*)malloc(sizeof(handoff_reader_t));
+    if (r == NULL) {
+        return -1;
+    }
+    r->sock = sock;
+    r->pos = 0;
+    r->len = 0;
+
+    int ret = load_snapshot(r);
+    free(r);
+    if (ret != 0) {
+        return -1;
+    }
+    return write_all(sock, &HANDOFF_ACK, 1);
+}
+
+static int send_msg(int sock, const handoff_fd_msg_t* msg, int fd) {
+    struct iovec iov;
+    iov.iov_base = (void*)msg;
+    iov.iov_len = sizeof(*msg);
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+        memset(control, 0, sizeof(control));
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)sizeof(*msg) ? 0 : -1;
+}
+
+int handoff_send_fd(int sock, int fd, int kind, int state) {
+    if (fd < 0 || kind < 0 || kind > 0xFF || state < 0 || state > 0xFFFF) {
+        return -1;
+    }
+    handoff_fd_msg_t msg = { HANDOFF_MSG_FD, (uint8_t)kind, (uint16_t)state };
+    return send_msg(sock, &msg, fd);
+}
+
+int handoff_send_end(int sock) {
+    handoff_fd_msg_t msg = { HANDOFF_MSG_END, 0, 0 };
+    return send_msg(sock, &msg, -1);
+}
+
+int handoff_recv_fd(int sock, int* fd, int* kind, int* state) {
+    handoff_fd_msg_t msg;
+    struct iovec iov;
+    iov.iov_base = &msg;
+    iov.iov_len = sizeof(msg);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n != (ssize_t)sizeof(msg)) {
+        return -1;
+    }
+
+    int received = -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+        memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    if (msg.type == HANDOFF_MSG_END) {
+        if (received >= 0) {
+            close(received);
+        }
+        return 0;
+    }
+    if (msg.type != HANDOFF_MSG_FD || received < 0 || (mh.msg_flags & MSG_CTRUNC)) {
+        if (received >= 0) {
+            close(received);
+        }
+        return -1;
+    }
+
+    *fd = received;
+    *kind = msg.kind;
+    *state = msg.state;
+    return 1;
+}
@@ -1,4 +1,5 @@
 #include"http_connection.h"
+#include "simd_scan.h"
 
 // 定义 HTTP 响应的一些状态信息
 const char* ok_200_title = "OK";
@@ -10,92 +11,16 @@ const char* error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char* error_503_title = "Service Unavailable";
+const char* error_503_form = "{\"status\":\"ERROR\",\"message\":\"Server overloaded, retry later\"}";
+const char* error_429_title = "Too Many Requests";
+const char* error_429_form = "{\"status\":\"ERROR\",\"message\":\"Rate limit exceeded, retry later\"}";
 
 // 前后端分离
 // const char* kv_root = "./frontend";
 // const char* resource_root = "./resources";
 
 
-// 静态成员变量需要初始化
-int HttpConnection::m_epoll_fd = -1;
-int HttpConnection::m_user_count = 0;
-
-// 设置文件描述符非阻塞
-int setNonBlocking(int fd) {
-    int old_option = fcntl(fd, F_GETFL);
-    int new_option = old_option | O_NONBLOCK;
-    fcntl(fd, F_SETFL, new_option);
-    return old_option;
-}
-
-// 添加fd到epoll对象中
-void addFDEpoll(int epoll_fd, int fd, bool et, bool one_shot) {
-
-    epoll_event event;
-    event.data.fd = fd;
-
-    event.events = EPOLLIN | EPOLLRDHUP;    // EPOLLRDHUP可以检测文件描述符对应的客户端断开连接，交给内核处理
-
-    if (et) {
-        event.events |= EPOLLET;
-    }
-
-    if (one_shot) {
-        // EPOLLNONESHOT事件属性限制一个线程操作一个socket
-        event.events |= EPOLLONESHOT;
-    }
-
-    // 添加
-    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
-
-    setNonBlocking(fd);
-}
-
-// 从epoll对象删除fd
-void removeFDEpoll(int epoll_fd, int fd) {
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
-    //printf("close fd = %d.\n", fd);
-    close(fd);
-}
-
-// 修改epoll对象中的fd
-void modifyFDEpoll(int epoll_fd, int fd, int event_num) {
-    epoll_event event;
-    event.data.fd = fd;
-
-    // 重置socket上的EPOLLONESHOT事件，以确保下一次可读时，EPOLLIN事件能被触发
-    event.events = event_num | EPOLLONESHOT | EPOLLRDHUP | EPOLLET;
-
-    // 修改
-    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
-}
-
-// 关闭客户端连接
-void HttpConnection::closeConnection() {
-    if (this->m_sockfd != -1) {
-        removeFDEpoll(this->m_epoll_fd, this->m_sockfd);
-        this->m_sockfd = -1;
-        --this->m_user_count;       // 连接的客户端总数量减一
-    }
-}
-
-// 初始化客户端连接
-void HttpConnection::init(int sockfd, const sockaddr_in& client_addr) {
-    this->m_sockfd = sockfd;
-    this->m_client_addr = client_addr;
-
-    // 设置端口复用
-    int reuse = 1;
-    setsockopt(this->m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-
-    // 指定 EPOLLONESHOT, 一个线程处理一个socket
-    addFDEpoll(this->m_epoll_fd, this->m_sockfd, true, true);
-    ++this->m_user_count;
-
-    // 初始化其余信息
-    this->init();
-}
-
 // 初始化其余的信息
 void HttpConnection::init() {
     this->bytes_to_send = 0;
@@ -109,13 +34,18 @@ void HttpConnection::init() {
     this->m_version = 0;
     this->m_content_length = 0;
     this->m_host = 0;
+    this->m_upgrade_websocket = false;
+    this->m_ws_key = 0;
+    this->m_if_none_match = 0;
     this->m_start_line = 0;
     this->m_checked_index = 0;
     this->m_read_index = 0;
-    this->m_write_index = 0;
+    this->m_file_address = NULL;
 
-    bzero(this->m_read_buf, READ_BUFFER_SIZE);
-    bzero(this->m_write_buf, WRITE_BUFFER_SIZE);
+    // 读写缓冲区的块全部归还到池中，等待下一次请求时再按需申请
+    this->m_read_buf.clear();
+    this->m_write_buf.clear();
+    this->m_read_base = NULL;
     bzero(this->m_real_file, FILENAME_LEN);         // 目标文件的完整路径
 }
 
@@ -124,115 +54,147 @@ void HttpConnection::clearBuffer() {
     this->init();
 }
 
-// 循环读取TCP内核缓冲区数据
-bool HttpConnection::read() {
-    // m_read_index记录已经读取到的数据下一个位置
-    if (this->m_read_index >= READ_BUFFER_SIZE) {
+/*
+    不解析请求，直接返回拒绝响应（503 过载、429 超出速率）
+    Retry-After 告诉客户端多久之后再重试，响应发送完成后关闭连接（m_keep_alive 为 false）
+*/
+void HttpConnection::rejectRequest(int status, const char* title, const char* form, int retry_after_s) {
+    this->clearBuffer();
+
+    this->addStatusLine(status, title);
+    this->addResponse("Retry-After: %d\r\n", retry_after_s);
+    this->addResponse("Content-Type: application/json\r\n");
+    this->addContentLength(strlen(form));
+    this->addKeepAlive();
+    this->addBlankLine();
+    this->addContent(form);
+
+    this->bytes_to_send = this->m_write_buf.size();
+}
+
+// 服务器过载（队列已满或者请求排队超过期限）
+void HttpConnection::rejectOverloaded(int retry_after_s) {
+    this->rejectRequest(503, error_503_title, error_503_form, retry_after_s);
+}
+
+// 客户端超出限流速率
+void HttpConnection::rejectRateLimited(int retry_after_s) {
+    this->rejectRequest(429, error_429_title, error_429_form, retry_after_s);
+}
+
+/*
+    将读缓冲区的数据整理到一块连续内存中，并保证数据之后至少还有 reserve 字节可写空间
+    数据被搬移时，修正已经解析出的指向读缓冲区的指针
+*/
+bool HttpConnection::linearizeReadBuffer(size_t reserve) {
+    char* base = this->m_read_buf.linearize(reserve);
+    if (base == NULL) {
         return false;
     }
 
-    int bytes_read = 0;
-
-    // EPOLLET
-    while (true) {
-        bytes_read = recv(this->m_sockfd, this->m_read_buf + this->m_read_index, this->READ_BUFFER_SIZE - this->m_read_index, 0);
-        if (bytes_read == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // 返回EAGAIN或EWOULDBLOCK表示没有数据可读
-                break;
-            }
-            else {
-                // 其它错误，直接返回
-                return false;
-            }
+    if (base != this->m_read_base && this->m_read_base != NULL) {
+        char* old_base = this->m_read_base;
+        if (this->m_url) {
+            this->m_url = base + (this->m_url - old_base);
         }
-        else if (bytes_read == 0) {
-            // 对方关闭连接
-            return false;
+        if (this->m_version) {
+            this->m_version = base + (this->m_version - old_base);
+        }
+        if (this->m_host) {
+            this->m_host = base + (this->m_host - old_base);
+        }
+        if (this->m_ws_key) {
+            this->m_ws_key = base + (this->m_ws_key - old_base);
+        }
+        if (this->m_if_none_match) {
+            this->m_if_none_match = base + (this->m_if_none_match - old_base);
         }
-        this->m_read_index += bytes_read;
     }
-
-    //printf("read data:\n%s", this->m_read_buf);
+    this->m_read_base = base;
     return true;
 }
 
-// 解析HTTP请求的一行数据（从状态机）
+/*
+    解析HTTP请求的一行数据（从状态机）
+    从 m_checked_index 继续查找 '\r' 或 '\n'，一次比较 16/32 字节；读到的数据不完整时，
+    m_checked_index 停在已经检查过的位置，下一次读到新数据后从这里继续，不会从行首重新扫描
+*/
 HttpConnection::LINE_STATUS HttpConnection::parseLineData() {
-    char temp;
-    for (; this->m_checked_index < this->m_read_index; ++this->m_checked_index) {
-
-        temp = this->m_read_buf[this->m_checked_index];   // 当前检查的字符
+    char* end = this->m_read_base + this->m_read_index;
+    char* p = scan_find2(this->m_read_base + this->m_checked_index, end, '\r', '\n');
+    this->m_checked_index = p - this->m_read_base;
+    if (p == end) {
+        return LINE_OPEN;
+    }
 
-        if (temp == '\r') {
-            if ((this->m_checked_index + 1) == this->m_read_index) {
-                // 指针指向地址比较，行数据最后一个字符是 '\r'，行数据不完整
-                return LINE_OPEN;
-            }
-            else if (this->m_read_buf[this->m_checked_index + 1] == '\n') {
-                // 一行完整数据，将 '\r' 和 '\n' 换成 '\0'
-                this->m_read_buf[this->m_checked_index++] = '\0';
-                this->m_read_buf[this->m_checked_index++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-        else if (temp == '\n') {
-            if ((this->m_checked_index > 1) && (this->m_read_buf[this->m_checked_index - 1] == '\r')) {
-                // 一行完整数据，将 '\r' 和 '\n' 换成 '\0'
-                this->m_read_buf[this->m_checked_index - 1] = '\0';
-                this->m_read_buf[this->m_checked_index++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+    if (*p == '\r') {
+        if (p + 1 == end) {
+            // 行数据最后一个字符是 '\r'，行数据不完整，下一次从 '\r' 开始检查
+            return LINE_OPEN;
         }
+        if (p[1] == '\n') {
+            // 一行完整数据，将 '\r' 和 '\n' 换成 '\0'
+            p[0] = '\0';
+            p[1] = '\0';
+            this->m_checked_index += 2;
+            return LINE_OK;
+        }
+        return LINE_BAD;
     }
 
-    // 如果检测到的读缓冲区最后一个字符不是 '\n' , 说明这一行数据不完整
-    return LINE_OPEN;
+    // 单独的 '\n'
+    if ((this->m_checked_index > 1) && (p[-1] == '\r')) {
+        p[-1] = '\0';
+        p[0] = '\0';
+        this->m_checked_index += 1;
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
-// 解析HTTP请求行, 获得请求方法, 目标URL和HTTP版本
-HttpConnection::HTTP_CODE HttpConnection::parseRequestLine(char* text) {
+/*
+    解析HTTP请求行, 获得请求方法, 目标URL和HTTP版本
+    len 为行的长度（不含 CRLF），方法和版本按长度和整词比较
+*/
+HttpConnection::HTTP_CODE HttpConnection::parseRequestLine(char* text, size_t len) {
+    char* end = text + len;
 
     // GET /index.html HTTP/1.1
-    // 判断第二个参数在字符text最先出现的位置
-    this->m_url = strpbrk(text, " \t");
-    if (this->m_url == NULL) {
+    char* method_end = scan_find2(text, end, ' ', '\t');
+    if (method_end == end) {
         return BAD_REQUEST;
     }
 
-    // GET\0/index.html HTTP/1.1
-    *this->m_url++ = '\0';
-
-    char* method = text;
-    if (strcasecmp(method, "GET") == 0) {
-        // 不区分大小，比较两个字符串
+    size_t method_len = method_end - text;
+    if (method_len == 3 && memcmp(text, "GET", 3) == 0) {
         this->m_method = GET;
     }
-    else if (strcasecmp(method, "POST") == 0) {
+    else if (method_len == 4 && memcmp(text, "POST", 4) == 0) {
         this->m_method = POST;
     }
     else {
         return BAD_REQUEST;
     }
 
+    // GET\0/index.html HTTP/1.1
+    *method_end = '\0';
+    this->m_url = method_end + 1;
+
     // /index.html HTTP/1.1
-    this->m_version = strpbrk(this->m_url, " \t");
-    if (this->m_version == NULL) {
+    char* url_end = scan_find2(this->m_url, end, ' ', '\t');
+    if (url_end == end) {
         return BAD_REQUEST;
     }
 
-    // /index.html\0HTTP/1.1
-    *this->m_version++ = '\0';
-    if (strcasecmp(this->m_version, "HTTP/1.1") != 0) {
-        // 只支持 HTTP1.1 
+    // /index.html\0HTTP/1.1，只支持 HTTP1.1
+    *url_end = '\0';
+    this->m_version = url_end + 1;
+    if (end - this->m_version != 8 || memcmp(this->m_version, "HTTP/1.1", 8) != 0) {
         return BAD_REQUEST;
     }
 
     // http://192.168.1.1:10000/index.html
-    if (strncasecmp(this->m_url, "http://", 7) == 0) {
-        // 不区分大小写，比较前n个字符
+    if (url_end - this->m_url >= 7 && scan_equals_lower(this->m_url, "http://", 7)) {
         this->m_url += 7;   // 192.168.1.1:10000/index.html
         this->m_url = strchr(this->m_url, '/');     // /index.html (查找指定字符第一次出现的位置)
     }
@@ -241,18 +203,34 @@ HttpConnection::HTTP_CODE HttpConnection::parseRequestLine(char* text) {
         return BAD_REQUEST;
     }
 
-    this->m_check_state = CHECK_STATE_HEADER;       // 主状态机的检查状态变成检查请求头
+    // /api/kv/hash/foo?v=1：查询参数不参与路由，也不是 key 的一部分
+    char* query = strchr(this->m_url, '?');
+    if (query != NULL) {
+        *query = '\0';
+    }
 
+    this->m_check_state = CHECK_STATE_HEADER;       // 主状态机的检查状态变成检查请求头
     return NO_REQUEST;      // 继续解析 HTTP 请求内容
 }
 
-// 解析HTTP请求头
-HttpConnection::HTTP_CODE HttpConnection::parseRequestHeaders(char* text) {
+// 跳过头部字段值前面的空白字符
+static inline char* headerValue(char* text) {
+    while (*text == ' ' || *text == '\t') {
+        ++text;
+    }
+    return text;
+}
+
+/*
+    解析HTTP请求头
+    先找到冒号，按字段名的长度分派，长度相同时再比较字段名，不关心的字段只需要一次 memchr
+*/
+HttpConnection::HTTP_CODE HttpConnection::parseRequestHeaders(char* text, size_t len) {
     // 遇到空行，表示头部字段解析完毕
-    if (text[0] == '\0') {
+    if (len == 0) {
         if (this->m_content_length != 0) {
             // 如果 HTTP 请求有请求体，则还需要读取m_content_length字节的请求体
-            // 状态机转移到 CHECK_STATE_CONTENT 状态            
+            // 状态机转移到 CHECK_STATE_CONTENT 状态
             this->m_check_state = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
@@ -261,37 +239,60 @@ HttpConnection::HTTP_CODE HttpConnection::parseRequestHeaders(char* text) {
             return GET_REQUEST;
         }
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0) {
-        // 处理 Connection 头部字段，Connection: keep-alive
-        text += 11;
-        text += strspn(text, " \t");    // 计算前缀长度
-        if (strcasecmp(text, "keep-alive") == 0) {
+
+    char* colon = (char*)memchr(text, ':', len);
+    if (colon == NULL) {
+        return NO_REQUEST;      // 不是合法的头部字段，忽略
+    }
+    char* value = headerValue(colon + 1);
+
+    switch (colon - text) {
+    case 4:
+        if (scan_equals_lower(text, "host", 4)) {
+            this->m_host = value;
+        }
+        break;
+    case 7:
+        if (scan_equals_lower(text, "upgrade", 7) && strncasecmp(value, "websocket", 9) == 0) {
+            this->m_upgrade_websocket = true;
+        }
+        break;
+    case 10:
+        // Connection: keep-alive
+        if (scan_equals_lower(text, "connection", 10) && strcasecmp(value, "keep-alive") == 0) {
             this->m_keep_alive = true;
         }
-    }
-    else if (strncasecmp(text, "Proxy-Connection:", 17) == 0) {
-        // 处理 Proxy-Connection 头部字段，考虑代理服务器的行为（但是）
-        text += 17;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
+        break;
+    case 13:
+        if (scan_equals_lower(text, "if-none-match", 13)) {
+            this->m_if_none_match = value;
+        }
+        break;
+    case 14:
+        if (scan_equals_lower(text, "content-length", 14)) {
+            this->m_content_length = atol(value);    // 将字符串转换为长整型
+            if (this->m_content_length < 0 || this->m_content_length > MAX_REQUEST_SIZE - this->m_checked_index) {
+                // 请求体超过上限
+                return BAD_REQUEST;
+            }
+        }
+        break;
+    case 16:
+        // 考虑代理服务器的行为，Proxy-Connection: keep-alive
+        if (scan_equals_lower(text, "proxy-connection", 16) && strcasecmp(value, "keep-alive") == 0) {
             this->m_keep_alive = true;
         }
-    }
-    else if (strncasecmp(text, "Content-Length:", 15) == 0) {
-        // 处理 Content-Length 头部字段
-        text += 15;
-        text += strspn(text, " \t");
-        this->m_content_length = atol(text);    // 将字符串转换为长整型
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0) {
-        // 处理 Host 头部字段
-        text += 5;
-        text += strspn(text, " \t");
-        this->m_host = text;
-    }
-    else {
-        // 请求体中的其它类型
-        //printf("unknow header %s\n", text);
+        break;
+    case 17:
+        // Sec-WebSocket-Key，去掉末尾的空白字符
+        if (scan_equals_lower(text, "sec-websocket-key", 17)) {
+            value[strcspn(value, " \t")] = '\0';
+            this->m_ws_key = value;
+        }
+        break;
+    default:
+        // 其它头部字段
+        break;
     }
     return NO_REQUEST;  // 继续解析HTTP请求内容
 }
@@ -308,6 +309,18 @@ HttpConnection::HTTP_CODE HttpConnection::parseRequestContent(char* text) {
 // 主状态机，解析HTTP请求
 HttpConnection::HTTP_CODE HttpConnection::processRead() {
 
+    this->m_read_index = this->m_read_buf.size();
+    if ((this->m_check_state == CHECK_STATE_CONTENT) &&
+        (this->m_read_index < this->m_content_length + this->m_checked_index)) {
+        // 请求体还没有读完，不需要整理读缓冲区
+        return NO_REQUEST;
+    }
+
+    // 解析前把读缓冲区整理成连续内存，额外保留 1 字节给请求体末尾的 '\0'
+    if (!this->linearizeReadBuffer(1)) {
+        return INTERNAL_ERROR;
+    }
+
     // 从状态机初始化为读取到完整的一行
     LINE_STATUS line_status = LINE_OK;
 
@@ -319,20 +332,22 @@ HttpConnection::HTTP_CODE HttpConnection::processRead() {
         ((line_status = parseLineData()) == LINE_OK)) {
         // 解析到了一行完整的数据，或者解析到了请求体，也是完整的数据
 
-        // 获取一行数据
+        // 获取一行数据，行的长度不含已经换成 '\0' 的 CRLF
         text = this->getLine();
+        size_t line_len = this->m_check_state == CHECK_STATE_CONTENT ? 0 :
+            this->m_checked_index - this->m_start_line - 2;
         this->m_start_line = this->m_checked_index;
         //printf("got 1 http line: %s\n", text);
 
         switch (this->m_check_state) {
         case CHECK_STATE_REQUESTLINE:
-            ret = this->parseRequestLine(text);
+            ret = this->parseRequestLine(text, line_len);
             if (ret == BAD_REQUEST) {
                 return BAD_REQUEST;
             }
             break;
         case CHECK_STATE_HEADER:
-            ret = this->parseRequestHeaders(text);
+            ret = this->parseRequestHeaders(text, line_len);
             if (ret == BAD_REQUEST) {
                 return BAD_REQUEST;
             }
@@ -353,6 +368,14 @@ HttpConnection::HTTP_CODE HttpConnection::processRead() {
             return INTERNAL_ERROR;              // 主状态机其它状态，内部错误
         }
     }
+
+    if (this->m_check_state == CHECK_STATE_CONTENT) {
+        // 请求体不完整，按 Content-Length 一次性预留好空间，后续读取的数据直接落在同一块连续内存中
+        size_t reserve = this->m_content_length + this->m_checked_index - this->m_read_index + 1;
+        if (!this->linearizeReadBuffer(reserve)) {
+            return INTERNAL_ERROR;
+        }
+    }
     return NO_REQUEST;
 }
 
@@ -365,91 +388,79 @@ void HttpConnection::unmap() {
 }
 
 // 写HTTP响应
-bool HttpConnection::write() {
-    int tmp = 0;
-    if (this->bytes_to_send == 0) {
-        // 将要发送的字节为 0，这一次响应结束
-        modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
-        this->init();
-        return true;
-    }
+HttpConnection::WRITE_RESULT HttpConnection::sendBuffered() {
+    while (this->bytes_to_send > 0) {
+        // 分散写，第一部分是写缓冲区中的各个块（响应状态行、响应头和响应体）
+        // 第二部分是解析 HTTP 请求成功后创建的内存映射区（存储在 web 服务器上，发送给客户端的资源文件）
+        struct iovec iov[MAX_WRITE_IOV];
+        int iov_count = this->m_write_buf.peekIovec(iov, MAX_WRITE_IOV - 1);
+        size_t file_left = this->bytes_to_send - this->m_write_buf.size();
+        if (file_left > 0 && this->m_file_address != NULL) {
+            iov[iov_count].iov_base = this->m_file_address + (this->m_file_stat.st_size - file_left);
+            iov[iov_count].iov_len = file_left;
+            ++iov_count;
+        }
 
-    while (1) {
-        // 分散写，m_iv[2] 表示有两块内存区被分散写（同时操作两块内存区）
-        // 本项目操作的第一块内存区（即 this->m_write_buf, 存储了响应状态行, 响应头）
-        // 本项目操作的第二块内存区（即解析 HTTP 请求成功后创建的内存映射区, 是存储在 web 服务器上，发送给客户端的资源文件）
-        tmp = writev(this->m_sockfd, this->m_iv, this->m_iv_count);
+        int tmp = writev(this->m_sockfd, iov, iov_count);
         if (tmp <= -1) {
             /*
-                如果 TCP 写缓冲区没有空间，则等待下一轮 EPOLLOUT 事件，重新调用 modifyFDEpoll() 是有必要的，
+                如果 TCP 写缓冲区没有空间，则等待下一轮 EPOLLOUT 事件，由调用者重新注册 EPOLLOUT，
                 以便主线程在 epoll_wait() 时，可以检测到 web 程序触发了 EPOLLOUT 事件，需要向 TCP 写缓冲区中写数据,
                 在此期间，服务器无法立即接收到同一客户端的下一个请求（没有注册 EPOLLIN 事件），但可以保证连接的完整性。
             */
             if (errno == EAGAIN) {
-                modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLOUT);
-                return true;
+                return WRITE_AGAIN;
             }
             this->unmap();
-            return false;
+            return WRITE_ERROR;
         }
 
         this->bytes_have_send += tmp;
         this->bytes_to_send -= tmp;
 
-        if (static_cast<size_t>(this->bytes_have_send) >= this->m_iv[0].iov_len) {
-            // 响应状态行和响应头发送完毕，发送响应体
-            this->m_iv[0].iov_len = 0;
-            this->m_iv[1].iov_base = this->m_file_address + (this->bytes_have_send - this->m_write_index);
-            this->m_iv[1].iov_len = this->bytes_to_send;
-        }
-        else {
-            // 继续发送响应状态行和响应头
-            this->m_iv[0].iov_base = this->m_write_buf + this->bytes_have_send;
-            this->m_iv[0].iov_len = this->m_iv[0].iov_len - tmp;
-        }
+        // 已发送的写缓冲区块归还到池中，剩余部分属于内存映射区
+        size_t buffered = this->m_write_buf.size();
+        this->m_write_buf.consume(static_cast<size_t>(tmp) < buffered ? tmp : buffered);
+    }
 
-        if (this->bytes_to_send <= 0) {
-            // 没有数据要发送了
-            this->unmap();
-            modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
+    // 没有数据要发送了
+    this->bytes_to_send = 0;
+    this->bytes_have_send = 0;
+    this->unmap();
+    return WRITE_COMPLETE;
+}
 
-            if (this->m_keep_alive) {
-                // HTTP 响应写入到内核缓冲区成功，初始化该连接对象的缓冲区，准备接收下一次HTTP请求
-                this->init();
-                return true;
-            }
-            else {
-                // 只响应一次，关闭 TCP 通信不用初始化 HTTP 任务类对象也行
-                // 下一个客户端连接到服务器上时，调用了 HTTP 任务类的初始化函数
-                return false;
-            }
-        }
+// HTTP 响应发送完成
+bool HttpConnection::onWriteComplete() {
+    if (this->m_keep_alive) {
+        // HTTP 响应写入到内核缓冲区成功，初始化该连接对象的缓冲区，准备接收下一次HTTP请求
+        this->init();
+        return true;
     }
+    // 只响应一次，关闭 TCP 通信不用初始化 HTTP 任务类对象也行
+    // 下一个客户端连接到服务器上时，调用了 HTTP 任务类的初始化函数
+    return false;
 }
 
 // 往写缓冲区中写入待发送的数据
 bool HttpConnection::addResponse(const char* format, ...) {
-    if (this->m_write_index >= WRITE_BUFFER_SIZE) {
-        return false;       // 写缓冲区满
-    }
-
     va_list arg_list;           // 存储可变参数列表的信息 
     va_start(arg_list, format); // format 确定可变参数列表的起始位置
 
-    // 将可变的参数列表内容写入到缓冲区中，如 add_response("%s %s", "xi", "xi");
-    int len = vsnprintf(this->m_write_buf + this->m_write_index, WRITE_BUFFER_SIZE - 1 - this->m_write_index, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - this->m_write_index)) {
-        return false;
-    }
-    this->m_write_index += len;
+    // 将可变的参数列表内容写入到缓冲区中，如 add_response("%s %s", "xi", "xi")，尾块放不下时写缓冲区自动扩展
+    bool ret = this->m_write_buf.vappendFormat(format, arg_list);
 
     va_end(arg_list);           // 清理参数列表变量
-    return true;
+    return ret;
 }
 
 // 响应状态行
 bool HttpConnection::addStatusLine(int status_num, const char* status_content) {
-    return this->addResponse("%s %d %s\r\n", "HTTP/1.1", status_num, status_content);
+    return this->m_write_buf.append("HTTP/1.1 ", 9) &&
+        this->m_write_buf.appendDecimal(status_num) &&
+        this->m_write_buf.append(" ", 1) &&
+        this->m_write_buf.append(status_content, strlen(status_content)) &&
+        this->m_write_buf.append("\r\n", 2);
 }
 
 // 响应头
@@ -462,22 +473,31 @@ void HttpConnection::addHeaders(int content_len) {
 
 // 响应头：响应体长度
 bool HttpConnection::addContentLength(int content_len) {
-    return this->addResponse("Content-Length: %d\r\n", content_len);
+    return this->m_write_buf.append("Content-Length: ", 16) &&
+        this->m_write_buf.appendDecimal(content_len) &&
+        this->m_write_buf.append("\r\n", 2);
 }
 
 // 响应头：是否保持连接
 bool HttpConnection::addKeepAlive() {
-    return this->addResponse("Connection: %s\r\n", (this->m_keep_alive == true) ? "keep-alive" : "close");
+    if (this->m_keep_alive) {
+        return this->m_write_buf.append("Connection: keep-alive\r\n", 24);
+    }
+    return this->m_write_buf.append("Connection: close\r\n", 19);
 }
 
 // 响应头：空白行
 bool HttpConnection::addBlankLine() {
-    return this->addResponse("%s", "\r\n");
+    return this->m_write_buf.append("\r\n", 2);
 }
 
 // 响应体
 bool HttpConnection::addContent(const char* content) {
-    return this->addResponse("%s", content);
+    return this->addContent(content, strlen(content));
+}
+
+bool HttpConnection::addContent(const char* content, size_t len) {
+    return this->m_write_buf.append(content, len);
 }
 
 // 响应体类型
@@ -562,24 +582,15 @@ bool HttpConnection::processWrite(HTTP_CODE ret) {
         this->addStatusLine(200, ok_200_title);
         this->addHeaders(this->m_file_stat.st_size);
 
-        // 分散写对象初始化，涉及到两块内存区
-        this->m_iv[0].iov_base = this->m_write_buf;
-        this->m_iv[0].iov_len = this->m_write_index;
-        this->m_iv[1].iov_base = this->m_file_address;
-        this->m_iv[1].iov_len = this->m_file_stat.st_size;
-        this->m_iv_count = 2;
-
-        this->bytes_to_send = this->m_write_index + this->m_file_stat.st_size;
+        // 待发送的数据包括写缓冲区和内存映射区两部分
+        this->bytes_to_send = this->m_write_buf.size() + this->m_file_stat.st_size;
         return true;
     default:
         return false;
     }
 
     // 状态码为200以外的，需要返回给客户端的内容
-    this->m_iv[0].iov_base = this->m_write_buf;
-    this->m_iv[0].iov_len = this->m_write_index;
-    this->m_iv_count = 1;
-    this->bytes_to_send = this->m_write_index;
+    this->bytes_to_send = this->m_write_buf.size();
     return true;
 }
 
@@ -589,21 +600,22 @@ void HttpConnection::process() {
     HTTP_CODE read_ret = processRead();
     if (read_ret == NO_REQUEST) {
         // NO_REQUEST: 需要继续读取客户端请求的内容
-        modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLIN);
+        this->rearm(EPOLLIN);
         return;
     }
 
     // 生成响应
     bool write_ret = processWrite(read_ret);
     if (!write_ret) {
-        this->closeConnection();
+        this->shutdownConnection();
+        return;
     }
 
-    // 监测文件描述符写事件 
-    modifyFDEpoll(this->m_epoll_fd, this->m_sockfd, EPOLLOUT);
+    // 直接在工作线程中发送响应
+    this->flush();
 }
 
-HttpConnection::HttpConnection() {
+HttpConnection::HttpConnection() : Connection(), m_read_base(NULL), m_file_address(NULL) {
 
 }
 
@@ -1,102 +1,203 @@
 #include <string.h>
 #include <stdio.h>
 #include "http_kvs_connection.h"
+#include "server_stats.h"
+#include "binary_connection.h"
 
-
-// 外部函数声明
-extern void modifyFDEpoll(int epoll_fd, int fd, int event_num);
-
-HttpKvsConnection::HttpKvsConnection() : HttpConnection() {
+HttpKvsConnection::HttpKvsConnection() : HttpConnection(), m_websocket(false), m_ws_closing(false) {
 }
 
 HttpKvsConnection::~HttpKvsConnection() {
 }
 
-// JSON解析
-bool HttpKvsConnection::parseJsonField(const char* json, const char* field, char* value, int max_len) {
-    if (json == NULL || field == NULL || value == NULL) {
-        return false;
-    }
-
-    // 查找字段名
-    char search_pattern[256];
-    snprintf(search_pattern, sizeof(search_pattern), "\"%s\"", field);
+void HttpKvsConnection::init() {
+    HttpConnection::init();
+    this->m_websocket = false;
+    this->m_ws_closing = false;
+}
 
-    const char* field_pos = strstr(json, search_pattern);
-    if (field_pos == NULL) {
-        return false;
+// 升级之后不再是 HTTP 响应，发送完成后保持连接，不重置状态
+bool HttpKvsConnection::onWriteComplete() {
+    if (this->m_websocket) {
+        return !this->m_ws_closing;
     }
+    return HttpConnection::onWriteComplete();
+}
 
-    // 查找冒号后的值
-    const char* colon_pos = strchr(field_pos, ':');
-    if (colon_pos == NULL) {
-        return false;
+// 移交给新进程时只需要知道是否已经升级，正在关闭的 WebSocket 连接不移交
+int HttpKvsConnection::protocolState() const {
+    if (this->m_websocket) {
+        return this->m_ws_closing ? -1 : 1;
     }
+    return 0;
+}
 
-    // 跳过空白字符
-    colon_pos++;
-    while (*colon_pos == ' ' || *colon_pos == '\t') {
-        colon_pos++;
+/*
+    按请求首行分类：GET /api/kv/ 为读，其他 GET（统计、指标、WebSocket 升级、404）为管理，POST 为写；
+    解析器只接受 GET 和 POST，其他方法的请求会被拒绝，也按写处理
+    WebSocket 帧中可能是任意命令，按写处理
+*/
+int HttpKvsConnection::requestLane() const {
+    if (this->m_websocket) {
+        return LANE_WRITE;
+    }
+    const char* p = NULL;
+    size_t len = this->peekRead(&p);
+    if (len <= 4 || memcmp(p, "GET ", 4) != 0) {
+        return LANE_WRITE;
     }
+    if (len >= 12 && memcmp(p + 4, "/api/kv/", 8) == 0) {
+        return LANE_READ;
+    }
+    return LANE_ADMIN;
+}
 
-    // 提取值
-    if (*colon_pos == '"') {
-        // 字符串值
-        colon_pos++;
-        const char* end_quote = strchr(colon_pos, '"');
-        if (end_quote == NULL) {
+/*
+    GET /api/kv/{engine}/{key}：URL 路径中的 key，到 '?' 为止；
+    key 含有 URL 编码时不解码，当作没有路由 key，由收到请求的工作线程转发给 key 的所有者
+    POST /api/kv：请求体（或者第一个命令）中第一个 "key" 字段的字符串，含有转义时同样放弃
+    JSON 字符串中的引号都经过转义，"key" 后面跟冒号的位置只能是字段名
+*/
+bool HttpKvsConnection::routingKey(const char** key, size_t* len) const {
+    if (this->m_websocket) {
+        return false;
+    }
+    const char* p = NULL;
+    size_t n = this->peekRead(&p);
+    const char* end = p + n;
+    if (n > 12 && memcmp(p, "GET /api/kv/", 12) == 0) {
+        const char* k = p + 12;
+        while (k < end && *k != '/' && *k != ' ' && *k != '?') {
+            ++k;
+        }
+        if (k == end || *k != '/') {
             return false;
         }
-        int len = end_quote - colon_pos;
-        if (len >= max_len) {
-            len = max_len - 1;
+        const char* k_end = ++k;
+        while (k_end < end && *k_end != ' ' && *k_end != '?') {
+            if (*k_end == '%' || *k_end == '+' || *k_end == '\r') {
+                return false;
+            }
+            ++k_end;
         }
-        strncpy(value, colon_pos, len);
-        value[len] = '\0';
+        if (k_end == end || k_end == k) {
+            return false;
+        }
+        *key = k;
+        *len = k_end - k;
         return true;
     }
-    else {
-        // 非字符串值
-        int i = 0;
-        while (*colon_pos != ',' && *colon_pos != '}' && *colon_pos != '\0' && i < max_len - 1) {
-            if (*colon_pos != ' ' && *colon_pos != '\t' && *colon_pos != '\n') {
-                value[i++] = *colon_pos;
-            }
-            colon_pos++;
+    if (n <= 13 || memcmp(p, "POST /api/kv ", 13) != 0) {
+        return false;
+    }
+
+    const char* body = (const char*)memmem(p, n, "\r\n\r\n", 4);
+    const char* field = body != NULL ? (const char*)memmem(body, end - body, "\"key\"", 5) : NULL;
+    if (field == NULL) {
+        return false;
+    }
+    const char* k = field + 5;
+    while (k < end && (*k == ' ' || *k == ':')) {
+        ++k;
+    }
+    if (k == end || *k != '"') {
+        return false;
+    }
+    const char* k_end = ++k;
+    while (k_end < end && *k_end != '"') {
+        if (*k_end == '\\') {
+            return false;
         }
-        value[i] = '\0';
-        return i > 0;
+        ++k_end;
     }
+    if (k_end == end) {
+        return false;
+    }
+    *key = k;
+    *len = k_end - k;
+    return true;
 }
 
-// 处理kv存储请求
-HttpConnection::HTTP_CODE HttpKvsConnection::processKvsRequest() {
-    // 从请求体中解析JSON
-    char cmd[32] = { 0 };
-    char key[256] = { 0 };
-    char value[512] = { 0 };
+void HttpKvsConnection::restoreState(int state) {
+    if (state == 1) {
+        this->m_websocket = true;
+        this->m_push_enabled.store(true, std::memory_order_relaxed);
+    }
+}
 
-    // 假设请求体在m_read_buf的末尾部分
-    char* json_body = m_read_buf + m_checked_index;
+// 升级之后按通用的方式发送写缓冲区
+HttpKvsConnection::WRITE_RESULT HttpKvsConnection::sendBuffered() {
+    if (this->m_websocket) {
+        return Connection::sendBuffered();
+    }
+    return HttpConnection::sendBuffered();
+}
 
-    // 解析JSON字段
-    if (!parseJsonField(json_body, "cmd", cmd, sizeof(cmd))) {
-        return BAD_REQUEST;
+// 执行一个命令对象，缺少 cmd 或 key 时返回 -1
+int HttpKvsConnection::executeCommand(const json_command_t& command, ChainBuffer* response) {
+    if (command.cmd.data == NULL || command.key.data == NULL) {
+        return -1;
     }
 
-    if (!parseJsonField(json_body, "key", key, sizeof(key))) {
-        return BAD_REQUEST;
+    // value是可选的，空字符串视为没有值
+    bool has_value = command.value.data != NULL && command.value.len > 0;
+    return kvs_handle_command(command.cmd.data, command.key.data, has_value ? command.value.data : NULL, response);
+}
+
+/*
+    执行请求体中的命令，字段值直接引用请求体
+    - 单个命令对象：响应为一个 JSON 对象，格式错误时返回 -1
+    - 命令数组：依次执行，响应为对应的 JSON 数组；中途遇到格式错误时，数组末尾追加一个错误对象并停止
+*/
+int HttpKvsConnection::executeJsonCommand(char* json_body, size_t len, ChainBuffer* response) {
+    json_reader_t reader;
+    if (json_request_begin(&reader, json_body, len) != 0) {
+        return -1;
     }
 
-    // value是可选的
-    parseJsonField(json_body, "value", value, sizeof(value));
+    json_command_t command;
+    if (!reader.is_array) {
+        if (json_request_next(&reader, &command) != 1 || reader.done < 0) {
+            return -1;
+        }
+        return executeCommand(command, response);
+    }
+
+    static const char invalid_json[] = "{\"status\":\"ERROR\",\"message\":\"Invalid parameters\"}";
+    static const char malformed_json[] = "{\"status\":\"ERROR\",\"message\":\"Malformed JSON\"}";
 
-    // 调用kv存储处理函数
-    char response_json[4096] = { 0 };
-    int json_len = kvs_handle_command(cmd, key,
-        value[0] != '\0' ? value : NULL, response_json);
+    size_t before = response->size();
+    int count = 0;
+    int ret = 0;
+    response->append("[", 1);
+    while ((ret = json_request_next(&reader, &command)) == 1) {
+        if (count++ > 0) {
+            response->append(",", 1);
+        }
+        if (executeCommand(command, response) < 0) {
+            response->append(invalid_json, sizeof(invalid_json) - 1);
+        }
+    }
+    if (ret < 0) {
+        if (count > 0) {
+            response->append(",", 1);
+        }
+        response->append(malformed_json, sizeof(malformed_json) - 1);
+    }
+    response->append("]", 1);
+    return static_cast<int>(response->size() - before);
+}
+
+// 处理kv存储请求
+HttpConnection::HTTP_CODE HttpKvsConnection::processKvsRequest() {
+    // 请求体在读缓冲区中请求头之后的位置，字段值直接引用读缓冲区，不再拷贝到定长数组中
+    ChainBuffer response_json;
+    int json_len = executeJsonCommand(m_read_base + m_checked_index, m_content_length, &response_json);
 
-    if (json_len <= 0) {
+    if (json_len < 0) {
+        return BAD_REQUEST;
+    }
+    if (json_len == 0) {
         return INTERNAL_ERROR;
     }
 
@@ -104,6 +205,37 @@ HttpConnection::HTTP_CODE HttpKvsConnection::processKvsRequest() {
     return writeJsonResponse(response_json) ? GET_REQUEST : INTERNAL_ERROR;
 }
 
+// 200 JSON 响应的状态行和固定的响应头（含 CORS 支持），只有 Content-Length 和 Connection 按请求填写
+static const char json_ok_head[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type\r\n"
+    "Content-Length: ";
+static const char json_etag_head[] = "\r\nETag: ";
+// 缓存可以保存响应，但每次都要带 If-None-Match 重新验证
+static const char json_etag_tail[] = "\r\nCache-Control: no-cache\r\nAccess-Control-Expose-Headers: ETag";
+static const char json_keep_alive_tail[] = "\r\nConnection: keep-alive\r\n\r\n";
+static const char json_close_tail[] = "\r\nConnection: close\r\n\r\n";
+
+// JSON响应的状态行和响应头，按片段拷贝，不经过格式化
+void HttpKvsConnection::addJsonHeaders(int content_len, const char* etag) {
+    m_write_buf.append(json_ok_head, sizeof(json_ok_head) - 1);
+    m_write_buf.appendDecimal(content_len);
+    if (etag != NULL) {
+        m_write_buf.append(json_etag_head, sizeof(json_etag_head) - 1);
+        m_write_buf.append(etag, strlen(etag));
+        m_write_buf.append(json_etag_tail, sizeof(json_etag_tail) - 1);
+    }
+    if (m_keep_alive) {
+        m_write_buf.append(json_keep_alive_tail, sizeof(json_keep_alive_tail) - 1);
+    }
+    else {
+        m_write_buf.append(json_close_tail, sizeof(json_close_tail) - 1);
+    }
+}
+
 // 生成JSON响应
 bool HttpKvsConnection::writeJsonResponse(const char* json_content) {
     if (json_content == NULL) {
@@ -112,27 +244,122 @@ bool HttpKvsConnection::writeJsonResponse(const char* json_content) {
 
     int content_len = strlen(json_content);
 
-    // 添加响应状态行
-    addStatusLine(200, "OK");
+    // 添加响应状态行和响应头
+    addJsonHeaders(content_len);
 
-    // 添加响应头
+    // 添加响应体
+    addContent(json_content, content_len);
+
+    bytes_to_send = m_write_buf.size();
+    return true;
+}
+
+bool HttpKvsConnection::writeJsonResponse(ChainBuffer& json_content) {
+    addJsonHeaders(json_content.size());
+
+    // 响应体的块整体挂到响应头之后
+    m_write_buf.appendChain(json_content);
+
+    bytes_to_send = m_write_buf.size();
+    return true;
+}
+
+// 200 以外的 JSON 响应头
+void HttpKvsConnection::addJsonStatusHeaders(int status_num, const char* status_title, int content_len) {
+    addStatusLine(status_num, status_title);
     addResponse("Content-Type: application/json\r\n");
-    addResponse("Access-Control-Allow-Origin: *\r\n");  // CORS支持
-    addResponse("Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n");
-    addResponse("Access-Control-Allow-Headers: Content-Type\r\n");
+    addResponse("Access-Control-Allow-Origin: *\r\n");
     addContentLength(content_len);
     addKeepAlive();
     addBlankLine();
+}
 
-    // 添加响应体
-    addContent(json_content);
+// 304 只有响应头，客户端和代理继续使用缓存的响应体
+void HttpKvsConnection::addNotModified(const char* etag) {
+    static const char not_modified_head[] = "HTTP/1.1 304 Not Modified\r\nAccess-Control-Allow-Origin: *\r\nETag: ";
+    m_write_buf.append(not_modified_head, sizeof(not_modified_head) - 1);
+    m_write_buf.append(etag, strlen(etag));
+    m_write_buf.append(json_etag_tail, sizeof(json_etag_tail) - 1);
+    m_write_buf.append("\r\n", 2);
+    addKeepAlive();
+    addBlankLine();
+}
 
-    // 设置分散写对象
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_index;
-    m_iv_count = 1;
+// 原地解码 URL 中的 %XX，返回 false 表示编码不合法
+static bool decodeUrlComponent(char* text, size_t* len) {
+    char* w = text;
+    for (char* p = text; *p != '\0'; ++p) {
+        if (*p != '%') {
+            *w++ = *p;
+            continue;
+        }
+        int value = 0;
+        for (int i = 1; i <= 2; ++i) {
+            char c = p[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= c - '0';
+            }
+            else if (c >= 'a' && c <= 'f') {
+                value |= c - 'a' + 10;
+            }
+            else if (c >= 'A' && c <= 'F') {
+                value |= c - 'A' + 10;
+            }
+            else {
+                return false;
+            }
+        }
+        *w++ = (char)value;
+        p += 2;
+    }
+    *len = w - text;
+    return true;
+}
+
+/*
+    GET /api/kv/{engine}/{key}：engine 为 array、rbtree 或 hash，key 按 URL 编码
+    响应与 POST 的 GET 命令相同（不附带统计信息），带上由 key 的版本号生成的 ETag；
+    If-None-Match 与当前 ETag 相同时回复 304，代理和浏览器的缓存可以直接使用之前的响应体
+*/
+bool HttpKvsConnection::processKvsGet() {
+    static const char bad_path_json[] = "{\"status\":\"ERROR\",\"message\":\"Expected /api/kv/{array|rbtree|hash}/{key}\"}";
+
+    char* engine_name = m_url + 8;
+    char* slash = strchr(engine_name, '/');
+    int engine = slash != NULL ? kvs_engine_lookup(engine_name, slash - engine_name) : -1;
+    size_t key_len = 0;
+    if (engine < 0 || !decodeUrlComponent(slash + 1, &key_len) || key_len == 0) {
+        addJsonStatusHeaders(404, "Not Found", sizeof(bad_path_json) - 1);
+        addContent(bad_path_json, sizeof(bad_path_json) - 1);
+        bytes_to_send = m_write_buf.size();
+        return true;
+    }
 
-    bytes_to_send = m_write_index;
+    ChainBuffer body;
+    char etag[KVS_ETAG_MAX_LEN];
+    bool not_modified = false;
+    int status = kvs_handle_get(engine, slash + 1, key_len, m_if_none_match, etag, &not_modified, &body);
+    if (status < 0) {
+        return false;
+    }
+
+    if (not_modified) {
+        addNotModified(etag);
+    }
+    else if (status == KVS_STATUS_OK) {
+        addJsonHeaders(body.size(), etag);
+        m_write_buf.appendChain(body);
+    }
+    else if (status == KVS_STATUS_NO_EXIST) {
+        addJsonStatusHeaders(404, "Not Found", body.size());
+        m_write_buf.appendChain(body);
+    }
+    else {
+        addJsonStatusHeaders(500, "Internal Server Error", body.size());
+        m_write_buf.appendChain(body);
+    }
+    bytes_to_send = m_write_buf.size();
     return true;
 }
 
@@ -141,32 +368,29 @@ bool HttpKvsConnection::writeNotFoundResponse() {
     const char* error_json =
         "{\"status\":\"ERROR\","
         "\"message\":\"API endpoint not found. This is a backend API server. "
-        "Supported endpoints: POST /api/kv, GET /api/stats\"}";
+        "Supported endpoints: POST /api/kv, GET /api/kv/{engine}/{key}, GET /api/stats, GET /api/metrics, GET /api/ws\"}";
 
-    addStatusLine(404, "Not Found");
-    addResponse("Content-Type: application/json\r\n");
-    addResponse("Access-Control-Allow-Origin: *\r\n");
-    addContentLength(strlen(error_json));
-    addKeepAlive();
-    addBlankLine();
+    addJsonStatusHeaders(404, "Not Found", strlen(error_json));
     addContent(error_json);
 
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_index;
-    m_iv_count = 1;
-    bytes_to_send = m_write_index;
+    bytes_to_send = m_write_buf.size();
 
     return true;
 }
 
 // 重写process方法
 void HttpKvsConnection::process() {
+    if (m_websocket) {
+        processWebSocket();
+        return;
+    }
+
     // 解析HTTP请求
     HTTP_CODE read_ret = processRead();
 
     if (read_ret == NO_REQUEST) {
         // 需要继续读取客户端请求的内容
-        modifyFDEpoll(m_epoll_fd, m_sockfd, EPOLLIN);
+        rearm(EPOLLIN);
         return;
     }
 
@@ -178,22 +402,237 @@ void HttpKvsConnection::process() {
         read_ret = processKvsRequest();
         write_ret = (read_ret == GET_REQUEST);
     }
+    else if (m_method == GET && m_url != NULL && strncmp(m_url, "/api/kv/", 8) == 0) {
+        // GET: /api/kv/{engine}/{key} - 可缓存的条件读取
+        write_ret = processKvsGet();
+    }
     else if (m_method == GET && m_url != NULL && strcmp(m_url, "/api/stats") == 0) {
         // GET: /api/stats - 统计信息
-        char stats_json[2048] = { 0 };
+        char stats_json[KVS_STATS_MAX_LEN];
         kvs_get_stats(stats_json);
         write_ret = writeJsonResponse(stats_json);
     }
+    else if (m_method == GET && m_url != NULL && strcmp(m_url, "/api/metrics") == 0) {
+        // GET: /api/metrics - 服务器运行指标（队列深度、拒绝数等）
+        ChainBuffer metrics_json;
+        write_ret = server_stats_json(&metrics_json) > 0 && writeJsonResponse(metrics_json);
+    }
+    else if (m_method == GET && m_url != NULL && strcmp(m_url, "/api/ws") == 0) {
+        // GET: /api/ws - 升级为 WebSocket，握手不合法时关闭连接
+        write_ret = upgradeWebSocket();
+    }
     else {
         // 其他请求返回404 JSON错误（不再尝试读取静态文件）
         write_ret = writeNotFoundResponse();
     }
 
     if (!write_ret) {
-        closeConnection();
+        shutdownConnection();
+        return;
+    }
+
+    // 和握手请求一起读到的帧在边沿触发下不会再有 EPOLLIN，直接处理，回复跟在 101 后面一起发送
+    if (m_websocket && !m_read_buf.empty()) {
+        processWebSocket();
+        return;
+    }
+
+    // 直接在工作线程中发送响应
+    flush();
+}
+
+// WebSocket 握手：回复 101，之后连接上的数据按帧处理
+bool HttpKvsConnection::upgradeWebSocket() {
+    char accept_key[WS_ACCEPT_KEY_SIZE];
+    if (!m_upgrade_websocket || m_ws_key == NULL ||
+        ws_accept_key(m_ws_key, strlen(m_ws_key), accept_key) != 0) {
+        return false;
+    }
+
+    addStatusLine(101, "Switching Protocols");
+    addResponse("Upgrade: websocket\r\n");
+    addResponse("Connection: Upgrade\r\n");
+    addResponse("Sec-WebSocket-Accept: %s\r\n", accept_key);
+    addBlankLine();
+
+    // 握手请求之后的数据已经是帧，留在读缓冲区中
+    m_read_buf.consume(m_checked_index);
+    m_read_base = NULL;
+    m_websocket = true;
+    m_push_enabled.store(true, std::memory_order_relaxed);
+
+    bytes_to_send = m_write_buf.size();
+    return true;
+}
+
+void HttpKvsConnection::addWsFrame(int opcode, const char* data, size_t len) {
+    char header[WS_MAX_HEADER_SIZE];
+    m_write_buf.append(header, ws_frame_header(header, opcode, len));
+    if (len > 0) {
+        m_write_buf.append(data, len);
+    }
+}
+
+// 负载的块直接挂到帧头之后，不拷贝
+void HttpKvsConnection::addWsFrame(int opcode, ChainBuffer& payload) {
+    char header[WS_MAX_HEADER_SIZE];
+    m_write_buf.append(header, ws_frame_header(header, opcode, payload.size()));
+    m_write_buf.appendChain(payload);
+}
+
+void HttpKvsConnection::addWsClose(int code) {
+    char payload[2] = { (char)(code >> 8), (char)(code & 0xFF) };
+    addWsFrame(WS_OP_CLOSE, payload, sizeof(payload));
+    m_ws_closing = true;
+    m_push_enabled.store(false, std::memory_order_relaxed);
+}
+
+// 文本帧：一条 JSON 命令或命令数组，回复一个文本帧
+void HttpKvsConnection::executeWsText(char* payload, size_t len) {
+    ChainBuffer response_json;
+    int json_len = executeJsonCommand(payload, len, &response_json);
+
+    if (json_len < 0) {
+        static const char error_json[] = "{\"status\":\"ERROR\",\"message\":\"Invalid command\"}";
+        addWsFrame(WS_OP_TEXT, error_json, sizeof(error_json) - 1);
+        return;
+    }
+    addWsFrame(WS_OP_TEXT, response_json);
+}
+
+// 二进制帧：一个或多个完整的二进制协议请求帧，所有响应合成一个二进制帧
+void HttpKvsConnection::executeWsBinary(char* payload, size_t len) {
+    ChainBuffer responses;
+    const char* p = payload;
+    const char* end = payload + len;
+    while (p < end) {
+        BinaryHeader request;
+        size_t need = 0;
+        long frame_len = BinaryConnection::frameLength(p, end, &request, &need);
+        if (frame_len <= 0) {
+            // 二进制协议的帧不能跨 WebSocket 消息
+            addWsClose(WS_CLOSE_PROTOCOL_ERROR);
+            return;
+        }
+        const char* key = p + BIN_HEADER_SIZE;
+        BinaryConnection::executeRequest(request, key, key + request.key_len, &responses);
+        p += frame_len;
+    }
+
+    if (!responses.empty()) {
+        addWsFrame(WS_OP_BINARY, responses);
+    }
+}
+
+// 由线程池中的工作线程调用，处理读缓冲区中所有完整的帧
+void HttpKvsConnection::processWebSocket() {
+    char* base = m_read_buf.linearize(1);
+    if (base == NULL) {
+        shutdownConnection();
         return;
     }
 
-    // 监测文件描述符写事件
-    modifyFDEpoll(m_epoll_fd, m_sockfd, EPOLLOUT);
+    char* p = base;
+    char* end = base + m_read_buf.size();
+    size_t need = 0;
+    while (p < end && !m_ws_closing) {
+        ws_frame_t frame;
+        int ret = ws_parse_frame(p, end - p, MAX_REQUEST_SIZE, &frame, &need);
+        if (ret == 0) {
+            break;
+        }
+        if (ret < 0) {
+            addWsClose(WS_CLOSE_PROTOCOL_ERROR);
+            break;
+        }
+
+        switch (frame.opcode) {
+        case WS_OP_TEXT:
+        case WS_OP_BINARY:
+            if (!frame.fin) {
+                // 不支持分片的消息，浏览器发送的命令都很短，不会分片
+                addWsClose(WS_CLOSE_UNSUPPORTED);
+            }
+            else if (frame.opcode == WS_OP_TEXT) {
+                executeWsText(frame.payload, frame.payload_len);
+            }
+            else {
+                executeWsBinary(frame.payload, frame.payload_len);
+            }
+            break;
+        case WS_OP_PING:
+            addWsFrame(WS_OP_PONG, frame.payload, frame.payload_len);
+            break;
+        case WS_OP_PONG:
+            break;
+        case WS_OP_CLOSE:
+            // 原样带回客户端的状态码
+            addWsFrame(WS_OP_CLOSE, frame.payload, frame.payload_len >= 2 ? 2 : 0);
+            m_ws_closing = true;
+            m_push_enabled.store(false, std::memory_order_relaxed);
+            break;
+        case WS_OP_CONTINUATION:
+            addWsClose(WS_CLOSE_UNSUPPORTED);
+            break;
+        default:
+            addWsClose(WS_CLOSE_PROTOCOL_ERROR);
+            break;
+        }
+        p += frame.frame_len;
+    }
+
+    m_read_buf.consume(p - base);
+    if (m_ws_closing) {
+        m_read_buf.clear();
+    }
+    else if (need > m_read_buf.size()) {
+        // 不完整的大帧：按头部中的长度一次预留连续空间
+        if (m_read_buf.linearize(need - m_read_buf.size() + 1) == NULL) {
+            shutdownConnection();
+            return;
+        }
+    }
+
+    if (m_write_buf.empty()) {
+        rearm(EPOLLIN);
+        return;
+    }
+
+    bytes_to_send = m_write_buf.size();
+    flush();
+}
+
+// 服务器过载：WebSocket 连接回复关闭帧 1013（稍后重试），HTTP 连接回复 503
+void HttpKvsConnection::rejectOverloaded(int retry_after_s) {
+    if (!m_websocket) {
+        HttpConnection::rejectOverloaded(retry_after_s);
+        return;
+    }
+
+    m_read_buf.clear();
+    if (!m_ws_closing) {
+        addWsClose(WS_CLOSE_TRY_AGAIN);
+    }
+    bytes_to_send = m_write_buf.size();
+}
+
+// 超出限流速率：WebSocket 连接没有 429，和过载一样回复关闭帧 1013
+void HttpKvsConnection::rejectRateLimited(int retry_after_s) {
+    if (!m_websocket) {
+        HttpConnection::rejectRateLimited(retry_after_s);
+        return;
+    }
+    rejectOverloaded(retry_after_s);
+}
+
+/*
+    由主线程在取得连接的所有权之后调用，推送一个文本帧
+    写缓冲区中可能还有没有发送完的数据，新的帧追加在后面
+*/
+bool HttpKvsConnection::push(const char* data, size_t len) {
+    if (!m_ws_closing) {
+        addWsFrame(WS_OP_TEXT, data, len);
+    }
+    bytes_to_send = m_write_buf.size();
+    return write();
 }
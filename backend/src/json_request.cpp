@@ -0,0 +1,365 @@
+#include <string.h>
+#include "json_request.h"
+#include "simd_scan.h"
+
+static inline char* skip_ws(char* p, char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        ++p;
+    }
+    return p;
+}
+
+// 读取 \u 之后的 4 位十六进制数
+static bool parse_hex4(const char* p, const char* end, unsigned* code) {
+    if (end - p < 4) {
+        return false;
+    }
+    unsigned value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        }
+        else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        }
+        else {
+            return false;
+        }
+    }
+    *code = value;
+    return true;
+}
+
+static char* put_utf8(char* w, unsigned code) {
+    if (code < 0x80) {
+        *w++ = (char)code;
+    }
+    else if (code < 0x800) {
+        *w++ = (char)(0xC0 | (code >> 6));
+        *w++ = (char)(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000) {
+        *w++ = (char)(0xE0 | (code >> 12));
+        *w++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *w++ = (char)(0x80 | (code & 0x3F));
+    }
+    else {
+        *w++ = (char)(0xF0 | (code >> 18));
+        *w++ = (char)(0x80 | ((code >> 12) & 0x3F));
+        *w++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *w++ = (char)(0x80 | (code & 0x3F));
+    }
+    return w;
+}
+
+/*
+    解码 p 处的一个转义序列（p 指向反斜杠之后），结果写到 w
+    @return 转义序列之后的位置，NULL 表示转义不合法
+*/
+static char* decode_escape(char* p, char* end, char** w) {
+    if (p >= end) {
+        return NULL;
+    }
+    char c = *p++;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+        *(*w)++ = c;
+        return p;
+    case 'b':
+        *(*w)++ = '\b';
+        return p;
+    case 'f':
+        *(*w)++ = '\f';
+        return p;
+    case 'n':
+        *(*w)++ = '\n';
+        return p;
+    case 'r':
+        *(*w)++ = '\r';
+        return p;
+    case 't':
+        *(*w)++ = '\t';
+        return p;
+    case 'u':
+        break;
+    default:
+        return NULL;
+    }
+
+    unsigned code = 0;
+    if (!parse_hex4(p, end, &code)) {
+        return NULL;
+    }
+    p += 4;
+    if (code >= 0xD800 && code <= 0xDBFF) {
+        // 高代理项之后必须紧跟低代理项
+        unsigned low = 0;
+        if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !parse_hex4(p + 2, end, &low) ||
+            low < 0xDC00 || low > 0xDFFF) {
+            return NULL;
+        }
+        p += 6;
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+    else if ((code >= 0xDC00 && code <= 0xDFFF) || code == 0) {
+        // 单独的低代理项不合法；字段值按 C 字符串执行，不能包含 NUL
+        return NULL;
+    }
+    *w = put_utf8(*w, code);
+    return p;
+}
+
+/*
+    解析字符串，p 指向开头的引号，view 为解码后的内容
+    没有转义字符时只查找结束引号；有转义字符时从第一个反斜杠开始原地解码，每一段普通字符整体搬移
+    @return 结束引号之后的位置，NULL 表示格式错误
+*/
+static char* parse_string(char* p, char* end, json_view_t* view) {
+    char* start = ++p;
+    p = scan_find2(p, end, '"', '\\');
+    if (p == end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        view->data = start;
+        view->len = p - start;
+        return p + 1;
+    }
+
+    char* w = p;
+    while (true) {
+        // p 指向反斜杠
+        p = decode_escape(p + 1, end, &w);
+        if (p == NULL) {
+            return NULL;
+        }
+        char* next = scan_find2(p, end, '"', '\\');
+        if (next == end) {
+            return NULL;
+        }
+        memmove(w, p, next - p);
+        w += next - p;
+        p = next;
+        if (*p == '"') {
+            view->data = start;
+            view->len = w - start;
+            return p + 1;
+        }
+    }
+}
+
+// 跳过字符串，不解码
+static char* skip_string(char* p, char* end) {
+    ++p;
+    while (true) {
+        p = scan_find2(p, end, '"', '\\');
+        if (p == end) {
+            return NULL;
+        }
+        if (*p == '"') {
+            return p + 1;
+        }
+        p += 2;     // 反斜杠和被转义的字符
+        if (p > end) {
+            return NULL;
+        }
+    }
+}
+
+// 跳过一个值（字符串、嵌套的对象或数组、数字和字面量），返回值之后的位置
+static char* skip_value(char* p, char* end) {
+    if (*p == '"') {
+        return skip_string(p, end);
+    }
+
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            char c = *p;
+            if (c == '"') {
+                p = skip_string(p, end);
+                if (p == NULL) {
+                    return NULL;
+                }
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                ++depth;
+            }
+            else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    return p + 1;
+                }
+            }
+            ++p;
+        }
+        return NULL;
+    }
+
+    char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+        *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+        ++p;
+    }
+    return p > start ? p : NULL;
+}
+
+// 顶层字段名按长度和内容匹配
+static json_view_t* match_field(json_command_t* command, const json_view_t& name) {
+    if (name.len == 3) {
+        if (memcmp(name.data, "cmd", 3) == 0) {
+            return &command->cmd;
+        }
+        if (memcmp(name.data, "key", 3) == 0) {
+            return &command->key;
+        }
+    }
+    else if (name.len == 5 && memcmp(name.data, "value", 5) == 0) {
+        return &command->value;
+    }
+    return NULL;
+}
+
+// 解析一个命令对象，p 指向左花括号，返回右花括号之后的位置
+static char* parse_object(char* p, char* end, json_command_t* command) {
+    memset(command, 0, sizeof(*command));
+
+    p = skip_ws(p + 1, end);
+    if (p < end && *p == '}') {
+        return p + 1;
+    }
+
+    while (true) {
+        if (p >= end || *p != '"') {
+            return NULL;
+        }
+        json_view_t name;
+        p = parse_string(p, end, &name);
+        if (p == NULL) {
+            return NULL;
+        }
+        p = skip_ws(p, end);
+        if (p >= end || *p != ':') {
+            return NULL;
+        }
+        p = skip_ws(p + 1, end);
+        if (p >= end) {
+            return NULL;
+        }
+
+        json_view_t* field = match_field(command, name);
+        if (field == NULL) {
+            p = skip_value(p, end);
+        }
+        else if (*p == '"') {
+            p = parse_string(p, end, field);
+        }
+        else {
+            // 数字、字面量、对象和数组取原始文本
+            char* start = p;
+            p = skip_value(p, end);
+            if (p != NULL) {
+                field->data = start;
+                field->len = p - start;
+                if (field->len == 4 && memcmp(start, "null", 4) == 0) {
+                    field->data = NULL;
+                    field->len = 0;
+                }
+            }
+        }
+        if (p == NULL) {
+            return NULL;
+        }
+
+        p = skip_ws(p, end);
+        if (p >= end) {
+            return NULL;
+        }
+        if (*p == '}') {
+            return p + 1;
+        }
+        if (*p != ',') {
+            return NULL;
+        }
+        p = skip_ws(p + 1, end);
+    }
+}
+
+static void terminate(json_view_t* view) {
+    if (view->data != NULL) {
+        view->data[view->len] = '\0';
+    }
+}
+
+int json_request_begin(json_reader_t* reader, char* body, size_t len) {
+    reader->end = body + len;
+    reader->p = skip_ws(body, reader->end);
+    reader->is_array = 0;
+    reader->done = 0;
+
+    if (reader->p >= reader->end) {
+        return -1;
+    }
+    if (*reader->p == '{') {
+        return 0;
+    }
+    if (*reader->p != '[') {
+        return -1;
+    }
+
+    reader->is_array = 1;
+    reader->p = skip_ws(reader->p + 1, reader->end);
+    if (reader->p < reader->end && *reader->p == ']') {
+        reader->p = skip_ws(reader->p + 1, reader->end);
+        reader->done = reader->p == reader->end ? 1 : -1;
+    }
+    return 0;
+}
+
+int json_request_next(json_reader_t* reader, json_command_t* command) {
+    if (reader->done != 0) {
+        return reader->done > 0 ? 0 : -1;
+    }
+
+    char* end = reader->end;
+    if (reader->p >= end || *reader->p != '{') {
+        reader->done = -1;
+        return -1;
+    }
+    char* p = parse_object(reader->p, end, command);
+    if (p == NULL) {
+        reader->done = -1;
+        return -1;
+    }
+
+    // 整个对象解析完成之后再加结束符：数字等原始文本之后的分隔符在解析时还要用到
+    terminate(&command->cmd);
+    terminate(&command->key);
+    terminate(&command->value);
+
+    p = skip_ws(p, end);
+    if (reader->is_array) {
+        if (p < end && *p == ',') {
+            p = skip_ws(p + 1, end);
+        }
+        else if (p < end && *p == ']') {
+            p = skip_ws(p + 1, end);
+            reader->done = p == end ? 1 : -1;
+        }
+        else {
+            reader->done = -1;
+        }
+    }
+    else {
+        reader->done = p == end ? 1 : -1;
+    }
+    reader->p = p;
+    return 1;
+}
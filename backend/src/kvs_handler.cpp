@@ -1,8 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
 #include <shared_mutex>
+#include <thread>
+#include <string>
+#include <utility>
+#include <new>
 #include "kvs_handler.h"
+#include "simd_scan.h"
+#include "mpmcqueue.h"
 
 
 void* kvs_malloc(size_t size) {
@@ -13,60 +23,139 @@ void kvs_free(void* ptr) {
     free(ptr);
 }
 
-// kv cmd
-enum {
-    KVS_CMD_START = 0,
-
-    // array
-    KVS_CMD_SET = KVS_CMD_START,
-    KVS_CMD_GET,
-    KVS_CMD_DEL,
-    KVS_CMD_MOD,
-    KVS_CMD_EXIST,
-
-    // rbtree
-    KVS_CMD_RSET,
-    KVS_CMD_RGET,
-    KVS_CMD_RDEL,
-    KVS_CMD_RMOD,
-    KVS_CMD_REXIST,
-
-    // hash
-    KVS_CMD_HSET,
-    KVS_CMD_HGET,
-    KVS_CMD_HDEL,
-    KVS_CMD_HMOD,
-    KVS_CMD_HEXIST,
-
-    KVS_CMD_COUNT,
+char* kvs_dup(const char* data, size_t len) {
+    char* copy = (char*)kvs_malloc(len + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    if (len > 0) {
+        memcpy(copy, data, len);
+    }
+    copy[len] = '\0';
+    return copy;
+}
+
+kvs_counter_t global_kvs_counters[KVS_ENGINE_COUNT];
+
+static bool kvs_embed_stats = true;
+
+// part of every ETag, so versions handed out before a restart never match
+static unsigned long kvs_boot_id = 0;
+
+// engine names in the order of KVS_ENGINE_*
+static const char* const kvs_engine_names[KVS_ENGINE_COUNT] = { "array", "rbtree", "hash" };
+
+void kvs_set_embed_stats(bool enable) {
+    kvs_embed_stats = enable;
+}
+
+// status names and messages of the JSON responses, indexed by KVS_OP_* and KVS_STATUS_*
+static const char* const kvs_status_names[] = {
+    "OK", "EXIST", "NO_EXIST", "FULL", "ERROR", "ERROR"
 };
 
-// 命令字符串
-const char* command[] = {
-    "SET", "GET", "DEL", "MOD", "EXIST",
-    "RSET", "RGET", "RDEL", "RMOD", "REXIST",
-    "HSET", "HGET", "HDEL", "HMOD", "HEXIST"
+static const char* const kvs_messages[KVS_OP_COUNT][KVS_STATUS_VALUE_REQUIRED + 1] = {
+    // SET
+    { "Set successfully", "Key already exists", "Key not found", "Storage full", "Failed to set", "Value required" },
+    // GET (OK carries the value)
+    { "", "Key exists", "Key not found", "Storage full", "Failed to get", "Value required" },
+    // DEL
+    { "Deleted successfully", "Key exists", "Key not found", "Storage full", "Failed to delete", "Value required" },
+    // MOD
+    { "Modified successfully", "Key exists", "Key not found", "Storage full", "Failed to modify", "Value required" },
+    // EXIST (OK means the key exists)
+    { "Key exists", "Key exists", "Key not found", "Storage full", "Failed to check", "Value required" },
 };
 
+static inline bool appendLiteral(ChainBuffer* response, const char* str) {
+    return response->append(str, strlen(str));
+}
+
+/*
+    GET callback, runs under the engine read lock: the value is JSON-escaped straight into the response
+    the value may contain quotes, backslashes and control characters (decoded from the request)
+*/
+static void appendJsonValue(const char* value, size_t len, void* arg) {
+    static const char hex[] = "0123456789abcdef";
+    static const char prefix[] = "{\"status\":\"OK\",\"message\":\"";
+    ChainBuffer* response = static_cast<ChainBuffer*>(arg);
+
+    response->append(prefix, sizeof(prefix) - 1);
+    const char* span = value;
+    const char* end = value + len;
+    for (const char* p = value; p < end; ++p) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        // the run of characters that need no escaping is appended at once
+        response->append(span, p - span);
+        if (c == '"' || c == '\\') {
+            char escaped[2] = { '\\', (char)c };
+            response->append(escaped, 2);
+        }
+        else {
+            char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F] };
+            response->append(escaped, 6);
+        }
+        span = p + 1;
+    }
+    response->append(span, end - span);
+    response->append("\"", 1);
+}
+
+#if ENABLE_ARRAY
+kvs_array_t global_array;
+#endif
+
+#if ENABLE_RBTREE
+kvs_rbtree_t global_rbtree;
+#endif
+
+#if ENABLE_HASH
+kvs_hash_t global_hash;
+#endif
+
+// shared-nothing partitions, defined with the command dispatch below
+static int kvs_partition_create(int count);
+static void kvs_partition_destroy(void);
+static void kvs_partition_regions(kvs_region_cb cb, void* arg);
+static long kvs_partition_count_of(int engine);
+
+// random per process: versions restart at 1 on a cold start, and two cold starts
+// within the same second must still produce different ETags
+static unsigned long kvs_new_boot_id(void) {
+    unsigned long id = 0;
+    if (getrandom(&id, sizeof(id), GRND_NONBLOCK) == (ssize_t)sizeof(id) && id != 0) {
+        return id;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return ((unsigned long)now.tv_sec * 1000000000UL + (unsigned long)now.tv_nsec) ^
+        ((unsigned long)getpid() << 32);
+}
+
 // init kvstore
-int init_kvengine(void) {
+int init_kvengine(int partitions) {
+    kvs_boot_id = kvs_new_boot_id();
+    if (partitions > 0) {
+        return kvs_partition_create(partitions);
+    }
+
 #if ENABLE_ARRAY
-    memset(&global_array, 0, sizeof(kvs_array_t));
-    if (-1 == kvs_array_create(&global_array)) {
+    if (-1 == global_array.create()) {
         return -1;
     }
 #endif
 
 #if ENABLE_RBTREE
-    memset(&global_rbtree, 0, sizeof(kvs_rbtree_t));
-    if (-1 == kvs_rbtree_create(&global_rbtree)) {
+    if (-1 == global_rbtree.create()) {
         return -1;
     }
 #endif
 
 #if ENABLE_HASH
-    memset(&global_hash, 0, sizeof(kvs_hash_t));
-    if (-1 == kvs_hash_create(&global_hash)) {
+    if (-1 == global_hash.create()) {
         return -1;
     }
 #endif
@@ -74,19 +163,52 @@ int init_kvengine(void) {
     return 0;
 }
 
+// enumerate preallocated engine tables
+void kvs_engine_regions(kvs_region_cb cb, void* arg) {
+    if (cb == NULL) {
+        return;
+    }
+
+#if ENABLE_ARRAY
+    global_array.regions(cb, arg);
+#endif
+
+#if ENABLE_HASH
+    global_hash.regions(cb, arg);
+#endif
+    kvs_partition_regions(cb, arg);
+}
+
 // destroy kvstore
 void destroy_kvengine(void) {
 #if ENABLE_ARRAY
-    kvs_array_destroy(&global_array);
+    global_array.destroy();
 #endif
 
 #if ENABLE_RBTREE
-    kvs_rbtree_destroy(&global_rbtree);
+    global_rbtree.destroy();
 #endif
 
 #if ENABLE_HASH
-    kvs_hash_destroy(&global_hash);
+    global_hash.destroy();
 #endif
+    kvs_partition_destroy();
+}
+
+// copy a string literal without its terminator
+#define PUT_LITERAL(p, str) (memcpy((p), (str), sizeof(str) - 1), (p) + sizeof(str) - 1)
+
+static char* putEngineStats(char* p, const char* name_json, int engine, long max) {
+    long count = global_kvs_counters[engine].count.load(std::memory_order_relaxed) + kvs_partition_count_of(engine);
+    p += strlen(strcpy(p, name_json));
+    p = PUT_LITERAL(p, "{\"count\":");
+    p += formatDecimal(p, count);
+    p = PUT_LITERAL(p, ",\"max\":");
+    p += formatDecimal(p, max);
+    p = PUT_LITERAL(p, ",\"remaining\":");
+    p += formatDecimal(p, max - count);
+    *p++ = '}';
+    return p;
 }
 
 // get kv statistical info
@@ -95,375 +217,835 @@ int kvs_get_stats(char* response) {
         return -1;
     }
 
-    int array_count = 0, array_max = KVS_ARRAY_SIZE;
-    int hash_count = 0, hash_max = KVS_HASH_SIZE;
-    int rbtree_count = 0, rbtree_max = KVS_RBTREE_SIZE;
+    char* p = response;
+    p = PUT_LITERAL(p, "{\"status\":\"OK\",\"data\":{");
+    p = putEngineStats(p, "\"array\":", KVS_ENGINE_ARRAY, KVS_ARRAY_SIZE);
+    p = putEngineStats(p, ",\"hash\":", KVS_ENGINE_HASH, KVS_HASH_SIZE);
+    p = putEngineStats(p, ",\"rbtree\":", KVS_ENGINE_RBTREE, KVS_RBTREE_SIZE);
+    p = PUT_LITERAL(p, "}}");
+    *p = '\0';
+    return static_cast<int>(p - response);
+}
 
-#if ENABLE_ARRAY
-    {
-        std::shared_lock<std::shared_mutex> lock(global_array_rwlock);
-        array_count = global_array.total;
+/**
+ * cmd: SET/GET/DEL/MOD/EXIST/RSET/RGET/HSET/HGET...
+ * key: [value](GET/DEL/EXIST haven't value)
+ * response: json type, appended to the response buffer (no size limit)
+ * {"status":"...","message":"...","data":{stats}}, assembled from fixed strings without formatting
+ * @return the size of response str
+ */
+int kvs_handle_command(const char* cmd, const char* key, const char* value, ChainBuffer* response) {
+    if (response == NULL) {
+        return -1;
     }
-#endif
 
-#if ENABLE_HASH
-    {
-        std::shared_lock<std::shared_mutex> lock(global_hash_rwlock);
-        hash_count = global_hash.count;
+    size_t before = response->size();
+    if (cmd == NULL || key == NULL) {
+        appendLiteral(response, "{\"status\":\"ERROR\",\"message\":\"Invalid parameters\"}");
+        return static_cast<int>(response->size() - before);
     }
-#endif
 
-#if ENABLE_RBTREE
-    {
-        std::shared_lock<std::shared_mutex> lock(global_rbtree_rwlock);
-        rbtree_count = global_rbtree.count;
+    int cmd_type = kvs_command_lookup(cmd);
+    if (cmd_type < 0) {
+        appendLiteral(response, "{\"status\":\"ERROR\",\"message\":\"Unknown command\"}");
+        return static_cast<int>(response->size() - before);
     }
-#endif
 
-    return sprintf(response,
-        "{\"status\":\"OK\",\"data\":{"
-        "\"array\":{\"count\":%d,\"max\":%d,\"remaining\":%d},"
-        "\"hash\":{\"count\":%d,\"max\":%d,\"remaining\":%d},"
-        "\"rbtree\":{\"count\":%d,\"max\":%d,\"remaining\":%d}"
-        "}}",
-        array_count, array_max, array_max - array_count,
-        hash_count, hash_max, hash_max - hash_count,
-        rbtree_count, rbtree_max, rbtree_max - rbtree_count
-    );
-}
+    int op = kvs_command_op(cmd_type);
+    int status = kvs_execute(cmd_type, key, strlen(key), value, value != NULL ? strlen(value) : 0,
+        appendJsonValue, response);
+    if (status < 0) {
+        // the engine is disabled at compile time
+        appendLiteral(response, "{\"status\":\"ERROR\",\"message\":\"Unsupported command\"}");
+        return static_cast<int>(response->size() - before);
+    }
+    if (status == KVS_STATUS_VALUE_REQUIRED) {
+        appendLiteral(response, "{\"status\":\"ERROR\",\"message\":\"Value required\"}");
+        return static_cast<int>(response->size() - before);
+    }
 
-/**
- * cmd: SET/GET/DEL/MOD/EXIST/RSET/RGET/HSET/HGET...
- * key: [value](GET/DEL/EXIST haven't value)
- * response: json type
- * @return the size of response str
- */
-int kvs_handle_command(const char* cmd, const char* key, const char* value, char* response) {
-    if (cmd == NULL || key == NULL || response == NULL) {
-        return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Invalid parameters\"}");
+    if (op != KVS_OP_GET || status != KVS_STATUS_OK) {
+        // EXIST reports a found key as status EXIST
+        const char* name = (op == KVS_OP_EXIST && status == KVS_STATUS_OK) ? "EXIST" : kvs_status_names[status];
+        appendLiteral(response, "{\"status\":\"");
+        appendLiteral(response, name);
+        appendLiteral(response, "\",\"message\":\"");
+        appendLiteral(response, kvs_messages[op][status]);
+        response->append("\"", 1);
     }
 
-    // 查找命令类型
-    int cmd_type = KVS_CMD_START;
-    for (cmd_type = KVS_CMD_START; cmd_type < KVS_CMD_COUNT; ++cmd_type) {
-        if (strcmp(cmd, command[cmd_type]) == 0) {
-            break;
+    if (kvs_embed_stats) {
+        char data_json[KVS_STATS_MAX_LEN];
+        int len = kvs_get_stats(data_json);
+        appendLiteral(response, ",\"data\":");
+        response->append(data_json, len);
+    }
+    if (!response->append("}", 1)) {
+        return -1;
+    }
+    return static_cast<int>(response->size() - before);
+}
+
+/*
+    command registry, resolved at compile time
+    - names are indexed by KVS_CMD_* (lower case, compared case-insensitively)
+    - lookup hashes the first byte, the byte at len - 3 and the length into a 64-slot table,
+      then checks the one candidate: its length first, then its bytes, no string comparison loop
+      (names of other lengths can hash to an occupied slot, e.g. "srxx" lands on "set")
+    - handlers are instantiated per engine and operation from kvs_engine<>, a disabled engine has none
+    a new operation needs its KVS_CMD_* entries, names here and a branch in kvs_run();
+    the build fails if a name collides with another one
+*/
+static constexpr const char* kvs_command_names[KVS_CMD_COUNT] = {
+    "set", "get", "del", "mod", "exist",
+    "rset", "rget", "rdel", "rmod", "rexist",
+    "hset", "hget", "hdel", "hmod", "hexist"
+};
+
+#define KVS_COMMAND_SLOTS 64
+#define KVS_COMMAND_MIN_LEN 3
+
+static constexpr unsigned kvs_command_hash(const char* name, size_t len) {
+    return ((unsigned char)(name[0] | 0x20) * 3 + (unsigned char)(name[len - 3] | 0x20) + len) &
+        (KVS_COMMAND_SLOTS - 1);
+}
+
+typedef struct kvs_command_slots_s {
+    signed char slot[KVS_COMMAND_SLOTS];    // KVS_CMD_*, -1 if empty
+    size_t len[KVS_CMD_COUNT];              // name length of each KVS_CMD_*
+    bool collision;
+} kvs_command_slots_t;
+
+static constexpr kvs_command_slots_t kvs_build_command_slots() {
+    kvs_command_slots_t table = {};
+    for (int i = 0; i < KVS_COMMAND_SLOTS; ++i) {
+        table.slot[i] = -1;
+    }
+    for (int cmd_type = KVS_CMD_START; cmd_type < KVS_CMD_COUNT; ++cmd_type) {
+        size_t len = std::char_traits<char>::length(kvs_command_names[cmd_type]);
+        table.len[cmd_type] = len;
+        unsigned h = kvs_command_hash(kvs_command_names[cmd_type], len);
+        if (len < KVS_COMMAND_MIN_LEN || table.slot[h] != -1) {
+            table.collision = true;
         }
+        table.slot[h] = (signed char)cmd_type;
     }
+    return table;
+}
+
+static constexpr kvs_command_slots_t kvs_command_slots = kvs_build_command_slots();
+static_assert(!kvs_command_slots.collision, "command names collide in kvs_command_hash(), change its multipliers");
 
-    if (cmd_type >= KVS_CMD_COUNT) {
-        return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Unknown command\"}");
+static constexpr int kvs_command_find(const char* cmd, size_t len) {
+    if (cmd == NULL || len < KVS_COMMAND_MIN_LEN) {
+        return -1;
     }
 
-    int ret = 0;
-    char* result = NULL;
-    char data_json[2048] = { 0 };
+    int cmd_type = kvs_command_slots.slot[kvs_command_hash(cmd, len)];
+    if (cmd_type < 0 || len != kvs_command_slots.len[cmd_type]) {
+        return -1;
+    }
+    return scan_equals_lower(cmd, kvs_command_names[cmd_type], len) ? cmd_type : -1;
+}
 
-    switch (cmd_type) {
-#if ENABLE_ARRAY
-        // Array
-    case KVS_CMD_SET:
-        if (value == NULL) {
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Value required\"}");
-        }
-        ret = kvs_array_set(&global_array, (char*)key, (char*)value);
-        if (ret == -1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to set\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Set successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"EXIST\",\"message\":\"Key already exists\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 2) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"FULL\",\"message\":\"Array storage full\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        break;
+// lookup checks: exact names in any case, and names of another length that share a slot with a command
+static_assert(kvs_command_find("SET", 3) == KVS_CMD_SET && kvs_command_find("hExIsT", 6) == KVS_CMD_HEXIST,
+    "command lookup must be case-insensitive");
+static_assert(kvs_command_slots.slot[kvs_command_hash("srxx", 4)] == KVS_CMD_SET &&
+    kvs_command_slots.slot[kvs_command_hash("gfxx", 4)] == KVS_CMD_GET &&
+    kvs_command_slots.slot[kvs_command_hash("sxxxxnxx", 8)] == KVS_CMD_SET,
+    "the length checks below need names that collide with a command");
+static_assert(kvs_command_find("srxx", 4) == -1 && kvs_command_find("gfxx", 4) == -1 &&
+    kvs_command_find("elxx", 4) == -1 && kvs_command_find("dcxx", 4) == -1 && kvs_command_find("mlxx", 4) == -1 &&
+    kvs_command_find("sxxxxnxx", 8) == -1 && kvs_command_find("gxxxxbxx", 8) == -1 &&
+    kvs_command_find("mxxxxhxx", 8) == -1,
+    "a name of another length must not match (or be read past) the command in its slot");
+static_assert(kvs_command_find("se\r", 3) == -1 && kvs_command_find("set-", 4) == -1,
+    "command lookup must compare the bytes exactly apart from letter case");
 
-    case KVS_CMD_GET:
-        result = kvs_array_get(&global_array, (char*)key);
-        if (result == NULL) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"%s\",\"data\":%s}",
-                result, strchr(data_json, '{'));
-        }
-        break;
+int kvs_command_lookup_n(const char* cmd, size_t len) {
+    return kvs_command_find(cmd, len);
+}
 
-    case KVS_CMD_DEL:
-        ret = kvs_array_del(&global_array, (char*)key);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Deleted successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to delete\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        break;
+int kvs_command_lookup(const char* cmd) {
+    if (cmd == NULL) {
+        return -1;
+    }
+    return kvs_command_lookup_n(cmd, strlen(cmd));
+}
 
-    case KVS_CMD_MOD:
-        if (value == NULL) {
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Value required\"}");
-        }
-        ret = kvs_array_mod(&global_array, (char*)key, (char*)value);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Modified successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to modify\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        break;
+// arguments of one command, the same for every engine and operation
+typedef struct kvs_request_s {
+    const char* key;
+    size_t key_len;
+    const char* value;
+    size_t value_len;
+    kvs_version_t* version;     // GET only, may be NULL
+    kvs_value_cb cb;            // GET only
+    void* arg;
+    bool upsert;                // SET only: overwrite an existing key instead of failing with EXIST
+} kvs_request_t;
 
-    case KVS_CMD_EXIST:
-        ret = kvs_array_exist(&global_array, (char*)key);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"EXIST\",\"message\":\"Key exists\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to check\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        break;
+/*
+    shared-nothing partitions: every engine of a partition is only touched by the thread attached to it
+    a command for another partition is handed over in a kvs_message_t that lives on the sender's stack
+*/
+typedef struct kvs_message_s {
+    int cmd_type;
+    const kvs_request_t* request;
+    int result;
+    std::atomic<bool> done;     // set by the owner after result, the sender may return
+} kvs_message_t;
+
+#define KVS_EXTERNAL_QUEUE 64   // commands from threads that own no partition, per partition
+
+typedef struct kvs_partition_s {
+#if ENABLE_ARRAY
+    KvEngine<ArrayIndex, MallocAlloc, NoLock> array;
+#endif
+#if ENABLE_RBTREE
+    KvEngine<RbtreeIndex, SlabAlloc, NoLock> rbtree;
+#endif
+#if ENABLE_HASH
+    KvEngine<ChainHashIndex, SlabAlloc, NoLock> hash;
+#endif
+    std::atomic<kvs_message_t*>* channels;      // one per sender partition, set by the sender, cleared by the owner
+    MpmcQueue<kvs_message_t*>* external;
+    alignas(64) std::atomic<bool> pending;      // a message may be waiting in a channel or the external queue
+    // written only by the attached thread, read by kvs_get_stats()
+    alignas(64) std::atomic<long> counts[KVS_ENGINE_COUNT];
+    std::atomic<unsigned long long> local;      // commands this thread ran on its own partition
+    std::atomic<unsigned long long> forwarded;  // commands this thread handed to another partition
+} kvs_partition_t;
+
+static kvs_partition_t* kvs_partitions = NULL;
+static int kvs_partition_total = 0;
+static std::atomic<kvs_message_t*>* kvs_channels = NULL;   // [owner][sender], a row per owner
+static kvs_notify_cb kvs_notify = NULL;
+static void* kvs_notify_arg = NULL;
+static thread_local int t_kvs_partition = -1;
+
+// the global instance and the partition instance of each engine, a disabled engine has no specialization
+template <int Engine>
+struct kvs_engine {
+    static constexpr bool enabled = false;
+};
+
+#if ENABLE_ARRAY
+template <>
+struct kvs_engine<KVS_ENGINE_ARRAY> {
+    static constexpr bool enabled = true;
+    static kvs_array_t& instance() { return global_array; }
+    static auto& partition(kvs_partition_t* p) { return p->array; }
+};
 #endif
 
 #if ENABLE_RBTREE
-        // RBTree
-    case KVS_CMD_RSET:
-        if (value == NULL) {
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Value required\"}");
-        }
-        ret = kvs_rbtree_set(&global_rbtree, (char*)key, (char*)value);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Set successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"EXIST\",\"message\":\"Key already exists\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to set\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        break;
+template <>
+struct kvs_engine<KVS_ENGINE_RBTREE> {
+    static constexpr bool enabled = true;
+    static kvs_rbtree_t& instance() { return global_rbtree; }
+    static auto& partition(kvs_partition_t* p) { return p->rbtree; }
+};
+#endif
 
-    case KVS_CMD_RGET:
-        result = kvs_rbtree_get(&global_rbtree, (char*)key);
-        if (result == NULL) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"%s\",\"data\":%s}",
-                result, strchr(data_json, '{'));
-        }
-        break;
+#if ENABLE_HASH
+template <>
+struct kvs_engine<KVS_ENGINE_HASH> {
+    static constexpr bool enabled = true;
+    static kvs_hash_t& instance() { return global_hash; }
+    static auto& partition(kvs_partition_t* p) { return p->hash; }
+};
+#endif
 
-    case KVS_CMD_RDEL:
-        ret = kvs_rbtree_del(&global_rbtree, (char*)key);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Deleted successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to delete\",\"data\":%s}",
-                strchr(data_json, '{'));
+// engine return code of one command, on the global engines or on one partition
+typedef int (*kvs_command_fn)(const kvs_request_t& request);
+typedef int (*kvs_partition_fn)(kvs_partition_t* partition, const kvs_request_t& request);
+
+template <int Op, typename E>
+static int kvs_apply(E& engine, const kvs_request_t& request) {
+    if constexpr (Op == KVS_OP_SET) {
+        if (request.upsert) {
+            return engine.upsert(request.key, request.key_len, request.value, request.value_len);
         }
-        break;
+        return engine.set(request.key, request.key_len, request.value, request.value_len);
+    }
+    else if constexpr (Op == KVS_OP_GET) {
+        return engine.get(request.key, request.key_len, request.version, request.cb, request.arg);
+    }
+    else if constexpr (Op == KVS_OP_DEL) {
+        return engine.del(request.key, request.key_len);
+    }
+    else if constexpr (Op == KVS_OP_MOD) {
+        return engine.mod(request.key, request.key_len, request.value, request.value_len);
+    }
+    else {
+        static_assert(Op == KVS_OP_EXIST, "every operation needs a handler");
+        return engine.exist(request.key, request.key_len);
+    }
+}
+
+template <int Engine, int Op>
+static int kvs_run(const kvs_request_t& request) {
+    return kvs_apply<Op>(kvs_engine<Engine>::instance(), request);
+}
 
-    case KVS_CMD_RMOD:
-        if (value == NULL) {
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Value required\"}");
+template <int Engine, int Op>
+static int kvs_run_partition(kvs_partition_t* partition, const kvs_request_t& request) {
+    return kvs_apply<Op>(kvs_engine<Engine>::partition(partition), request);
+}
+
+template <int CmdType>
+static constexpr kvs_command_fn kvs_handler_of() {
+    constexpr int engine = CmdType / KVS_OP_COUNT;
+    if constexpr (kvs_engine<engine>::enabled) {
+        return &kvs_run<engine, CmdType % KVS_OP_COUNT>;
+    }
+    else {
+        return NULL;
+    }
+}
+
+template <int CmdType>
+static constexpr kvs_partition_fn kvs_partition_handler_of() {
+    constexpr int engine = CmdType / KVS_OP_COUNT;
+    if constexpr (kvs_engine<engine>::enabled) {
+        return &kvs_run_partition<engine, CmdType % KVS_OP_COUNT>;
+    }
+    else {
+        return NULL;
+    }
+}
+
+template <size_t... CmdType>
+struct kvs_handler_table {
+    static constexpr kvs_command_fn handlers[sizeof...(CmdType)] = { kvs_handler_of<CmdType>()... };
+    static constexpr kvs_partition_fn partition_handlers[sizeof...(CmdType)] = { kvs_partition_handler_of<CmdType>()... };
+};
+
+template <size_t... CmdType>
+static constexpr const kvs_command_fn* kvs_make_handlers(std::index_sequence<CmdType...>) {
+    return kvs_handler_table<CmdType...>::handlers;
+}
+
+template <size_t... CmdType>
+static constexpr const kvs_partition_fn* kvs_make_partition_handlers(std::index_sequence<CmdType...>) {
+    return kvs_handler_table<CmdType...>::partition_handlers;
+}
+
+// handlers indexed by KVS_CMD_*, NULL if the engine is disabled at compile time
+static constexpr const kvs_command_fn* kvs_handlers = kvs_make_handlers(std::make_index_sequence<KVS_CMD_COUNT>());
+static constexpr const kvs_partition_fn* kvs_partition_handlers =
+    kvs_make_partition_handlers(std::make_index_sequence<KVS_CMD_COUNT>());
+
+// FNV-1a of the key, independent of the hash index's own slot function
+static int kvs_partition_of(const char* key, size_t key_len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < key_len; ++i) {
+        h = (h ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return (int)(h % (uint32_t)kvs_partition_total);
+}
+
+static void kvs_deliver(kvs_partition_t* partition, kvs_message_t* message) {
+    message->result = kvs_partition_handlers[message->cmd_type](partition, *message->request);
+    message->done.store(true, std::memory_order_release);
+}
+
+void kvs_partition_poll(void) {
+    int self = t_kvs_partition;
+    if (self < 0) {
+        return;
+    }
+    kvs_partition_t* partition = &kvs_partitions[self];
+    if (!partition->pending.load(std::memory_order_relaxed) ||
+        !partition->pending.exchange(false, std::memory_order_acquire)) {
+        return;
+    }
+
+    // the channel is emptied before done is set, the sender never sees its own message still in it
+    std::atomic<kvs_message_t*>* row = partition->channels;
+    for (int sender = 0; sender < kvs_partition_total; ++sender) {
+        kvs_message_t* message = row[sender].load(std::memory_order_acquire);
+        if (message != NULL) {
+            row[sender].store(NULL, std::memory_order_relaxed);
+            kvs_deliver(partition, message);
         }
-        ret = kvs_rbtree_mod(&global_rbtree, (char*)key, (char*)value);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Modified successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
+    }
+    kvs_message_t* message = NULL;
+    while (partition->external->TryPop(message)) {
+        kvs_deliver(partition, message);
+    }
+}
+
+// counters of the calling thread's partition have a single writer, no read-modify-write needed
+static void kvs_count_add(int engine, long delta) {
+    int self = t_kvs_partition;
+    if (self < 0) {
+        global_kvs_counters[engine].count.fetch_add(delta, std::memory_order_relaxed);
+        return;
+    }
+    std::atomic<long>& count = kvs_partitions[self].counts[engine];
+    count.store(count.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+static void kvs_tally(std::atomic<unsigned long long>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/*
+    run a command on the engine that owns its key
+    - no partitions: the global engine, under its lock
+    - own partition: directly, after serving what other partitions forwarded here
+    - another partition: hand the command to its owner and wait, serving our own channels meanwhile,
+      so two threads waiting on each other both make progress
+    a thread has at most one command in flight, so one slot per (owner, sender) channel is enough
+*/
+static int kvs_dispatch(int cmd_type, const kvs_request_t& request) {
+    if (kvs_partitions == NULL) {
+        return kvs_handlers[cmd_type](request);
+    }
+
+    int owner = kvs_partition_of(request.key, request.key_len);
+    int self = t_kvs_partition;
+    if (owner == self) {
+        kvs_partition_poll();
+        kvs_tally(kvs_partitions[self].local);
+        return kvs_partition_handlers[cmd_type](&kvs_partitions[self], request);
+    }
+
+    kvs_message_t message;
+    message.cmd_type = cmd_type;
+    message.request = &request;
+    message.result = -1;
+    message.done.store(false, std::memory_order_relaxed);
+
+    kvs_partition_t* target = &kvs_partitions[owner];
+    if (self >= 0) {
+        target->channels[self].store(&message, std::memory_order_release);
+        kvs_tally(kvs_partitions[self].forwarded);
+    }
+    else {
+        while (!target->external->TryPush(&message)) {
+            std::this_thread::yield();
         }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
+    }
+    target->pending.store(true, std::memory_order_seq_cst);
+    if (kvs_notify != NULL) {
+        kvs_notify(owner, kvs_notify_arg);
+    }
+
+    for (int spins = 0; !message.done.load(std::memory_order_acquire); ++spins) {
+        kvs_partition_poll();
+        if (spins < 64) {
+            CpuRelax();
         }
         else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to modify\",\"data\":%s}",
-                strchr(data_json, '{'));
+            std::this_thread::yield();
         }
-        break;
+    }
+    return message.result;
+}
 
-    case KVS_CMD_REXIST:
-        ret = kvs_rbtree_exist(&global_rbtree, (char*)key);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"EXIST\",\"message\":\"Key exists\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
+static int kvs_partition_create(int count) {
+    kvs_partitions = new (std::nothrow) kvs_partition_t[count];
+    kvs_channels = new (std::nothrow) std::atomic<kvs_message_t*>[(size_t)count * count]();
+    if (kvs_partitions == NULL || kvs_channels == NULL) {
+        return -1;
+    }
+    kvs_partition_total = count;
+
+    // the fixed tables are split so that all partitions together are as large as the shared engines
+    for (int i = 0; i < count; ++i) {
+        kvs_partition_t* partition = &kvs_partitions[i];
+#if ENABLE_ARRAY
+        if (-1 == partition->array.create((KVS_ARRAY_SIZE + count - 1) / count)) {
+            return -1;
         }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to check\",\"data\":%s}",
-                strchr(data_json, '{'));
+#endif
+#if ENABLE_RBTREE
+        if (-1 == partition->rbtree.create()) {
+            return -1;
         }
-        break;
 #endif
-
 #if ENABLE_HASH
-        // Hash
-    case KVS_CMD_HSET:
-        if (value == NULL) {
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Value required\"}");
+        if (-1 == partition->hash.create((KVS_HASH_SIZE + count - 1) / count)) {
+            return -1;
         }
-        ret = kvs_hash_set(&global_hash, (char*)key, (char*)value);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Set successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
+#endif
+        partition->channels = &kvs_channels[(size_t)i * count];
+        partition->external = new (std::nothrow) MpmcQueue<kvs_message_t*>(KVS_EXTERNAL_QUEUE);
+        if (partition->external == NULL) {
+            return -1;
         }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"EXIST\",\"message\":\"Key already exists\",\"data\":%s}",
-                strchr(data_json, '{'));
+        partition->pending.store(false, std::memory_order_relaxed);
+        for (int engine = 0; engine < KVS_ENGINE_COUNT; ++engine) {
+            partition->counts[engine].store(0, std::memory_order_relaxed);
         }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to set\",\"data\":%s}",
-                strchr(data_json, '{'));
+        partition->local.store(0, std::memory_order_relaxed);
+        partition->forwarded.store(0, std::memory_order_relaxed);
+    }
+    return 0;
+}
+
+static void kvs_partition_destroy(void) {
+    if (kvs_partitions == NULL) {
+        return;
+    }
+    for (int i = 0; i < kvs_partition_total; ++i) {
+#if ENABLE_ARRAY
+        kvs_partitions[i].array.destroy();
+#endif
+#if ENABLE_RBTREE
+        kvs_partitions[i].rbtree.destroy();
+#endif
+#if ENABLE_HASH
+        kvs_partitions[i].hash.destroy();
+#endif
+        delete kvs_partitions[i].external;
+    }
+    delete[] kvs_partitions;
+    delete[] kvs_channels;
+    kvs_partitions = NULL;
+    kvs_channels = NULL;
+    kvs_partition_total = 0;
+}
+
+static void kvs_partition_regions(kvs_region_cb cb, void* arg) {
+    for (int i = 0; i < kvs_partition_total; ++i) {
+#if ENABLE_ARRAY
+        kvs_partitions[i].array.regions(cb, arg);
+#endif
+#if ENABLE_HASH
+        kvs_partitions[i].hash.regions(cb, arg);
+#endif
+    }
+}
+
+static long kvs_partition_count_of(int engine) {
+    long count = 0;
+    for (int i = 0; i < kvs_partition_total; ++i) {
+        count += kvs_partitions[i].counts[engine].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+int kvs_partition_owner(const char* key, size_t key_len) {
+    if (kvs_partitions == NULL || key == NULL) {
+        return -1;
+    }
+    return kvs_partition_of(key, key_len);
+}
+
+void kvs_partition_attach(int index) {
+    t_kvs_partition = (index >= 0 && index < kvs_partition_total) ? index : -1;
+}
+
+void kvs_partition_set_notify(kvs_notify_cb cb, void* arg) {
+    kvs_notify_arg = arg;
+    kvs_notify = cb;
+}
+
+int kvs_partition_stats(unsigned long long* local, unsigned long long* forwarded) {
+    unsigned long long l = 0;
+    unsigned long long f = 0;
+    for (int i = 0; i < kvs_partition_total; ++i) {
+        l += kvs_partitions[i].local.load(std::memory_order_relaxed);
+        f += kvs_partitions[i].forwarded.load(std::memory_order_relaxed);
+    }
+    if (local != NULL) {
+        *local = l;
+    }
+    if (forwarded != NULL) {
+        *forwarded = f;
+    }
+    return kvs_partition_total;
+}
+
+// map the return code of an engine function to KVS_STATUS_*
+static int kvs_status_of(int op, int ret) {
+    switch (op) {
+    case KVS_OP_SET:
+        // -1: ERROR, 0: OK, 1: EXIST, 2: full
+        if (ret == 0) return KVS_STATUS_OK;
+        if (ret == 1) return KVS_STATUS_EXIST;
+        if (ret == 2) return KVS_STATUS_FULL;
+        return KVS_STATUS_ERROR;
+    case KVS_OP_GET:
+    case KVS_OP_DEL:
+    case KVS_OP_MOD:
+    case KVS_OP_EXIST:
+        // -1: ERROR, 0: OK (GET: value found, EXIST: key exists), 1: NO EXIST
+        if (ret == 0) return KVS_STATUS_OK;
+        if (ret == 1) return KVS_STATUS_NO_EXIST;
+        return KVS_STATUS_ERROR;
+    default:
+        return KVS_STATUS_ERROR;
+    }
+}
+
+/**
+ * execute a command without formatting the response
+ * @return KVS_STATUS_*, -1: invalid parameters
+ */
+static int kvs_run_command(int cmd_type, const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_value_cb cb, void* arg, bool upsert) {
+    if (cmd_type < KVS_CMD_START || cmd_type >= KVS_CMD_COUNT || key == NULL) {
+        return -1;
+    }
+
+    int op = kvs_command_op(cmd_type);
+    if ((op == KVS_OP_SET || op == KVS_OP_MOD) && value == NULL) {
+        return KVS_STATUS_VALUE_REQUIRED;
+    }
+
+    kvs_command_fn handler = kvs_handlers[cmd_type];
+    if (handler == NULL) {
+        return -1;
+    }
+
+    kvs_request_t request = { key, key_len, value, value_len, NULL, cb, arg, upsert };
+    int ret = kvs_dispatch(cmd_type, request);
+
+    // an upsert that replaced a value reports EXIST and leaves the count alone
+    int status = kvs_status_of(op, ret);
+    if (status == KVS_STATUS_OK && (op == KVS_OP_SET || op == KVS_OP_DEL)) {
+        kvs_count_add(kvs_command_engine(cmd_type), op == KVS_OP_SET ? 1 : -1);
+    }
+    return status;
+}
+
+int kvs_execute(int cmd_type, const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_value_cb cb, void* arg) {
+    return kvs_run_command(cmd_type, key, key_len, value, value_len, cb, arg, false);
+}
+
+int kvs_upsert(int cmd_type, const char* key, size_t key_len, const char* value, size_t value_len) {
+    if (kvs_command_op(cmd_type) != KVS_OP_SET) {
+        return -1;
+    }
+    return kvs_run_command(cmd_type, key, key_len, value, value_len, NULL, NULL, true);
+}
+
+int kvs_engine_lookup(const char* name, size_t len) {
+    if (name == NULL) {
+        return -1;
+    }
+
+    for (int engine = 0; engine < KVS_ENGINE_COUNT; ++engine) {
+        if (strlen(kvs_engine_names[engine]) == len && memcmp(name, kvs_engine_names[engine], len) == 0) {
+            return engine;
         }
-        break;
+    }
+    return -1;
+}
 
-    case KVS_CMD_HGET:
-        result = kvs_hash_get(&global_hash, (char*)key);
-        if (result == NULL) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
+/*
+    If-None-Match is "*" or a comma separated list of ETags, weak ones (W/"...") compare equal too
+    the stored value is always sent whole, so weak and strong comparison give the same answer
+*/
+static bool etag_matches(const char* header, const char* etag) {
+    size_t etag_len = strlen(etag);
+    const char* p = header;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            ++p;
         }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"%s\",\"data\":%s}",
-                result, strchr(data_json, '{'));
+        const char* start = p;
+        while (*p != '\0' && *p != ',') {
+            ++p;
         }
-        break;
-
-    case KVS_CMD_HDEL:
-        ret = kvs_hash_del(&global_hash, (char*)key);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Deleted successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
+        const char* end = p;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) {
+            --end;
         }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
+        if (end - start == 1 && *start == '*') {
+            return true;
         }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to delete\",\"data\":%s}",
-                strchr(data_json, '{'));
+        if (end - start > 2 && start[0] == 'W' && start[1] == '/') {
+            start += 2;
         }
-        break;
+        if ((size_t)(end - start) == etag_len && memcmp(start, etag, etag_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct kvs_get_ctx_s {
+    ChainBuffer* response;
+    int engine;
+    kvs_version_t version;      // set by the engine before the callback runs
+    const char* if_none_match;
+    char* etag;
+    bool not_modified;
+} kvs_get_ctx_t;
+
+// GET callback of kvs_handle_get, runs under the engine read lock: the ETag and the value belong together
+static void appendConditional(const char* value, size_t len, void* arg) {
+    kvs_get_ctx_t* ctx = static_cast<kvs_get_ctx_t*>(arg);
+    snprintf(ctx->etag, KVS_ETAG_MAX_LEN, "\"%c%lx-%llx\"", kvs_engine_names[ctx->engine][0],
+        kvs_boot_id, ctx->version);
 
-    case KVS_CMD_HMOD:
-        if (value == NULL) {
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Value required\"}");
+    if (ctx->if_none_match != NULL && etag_matches(ctx->if_none_match, ctx->etag)) {
+        ctx->not_modified = true;
+        return;
+    }
+    appendJsonValue(value, len, ctx->response);
+    ctx->response->append("}", 1);
+}
+
+int kvs_handle_get(int engine, const char* key, size_t key_len, const char* if_none_match,
+    char* etag, bool* not_modified, ChainBuffer* response) {
+    if (key == NULL || etag == NULL || not_modified == NULL || response == NULL) {
+        return -1;
+    }
+
+    kvs_get_ctx_t ctx = { response, engine, 0, if_none_match, etag, false };
+    etag[0] = '\0';
+
+    if (engine < 0 || engine >= KVS_ENGINE_COUNT) {
+        return -1;
+    }
+    int cmd_type = engine * KVS_OP_COUNT + KVS_OP_GET;
+    if (kvs_handlers[cmd_type] == NULL) {
+        return -1;
+    }
+
+    kvs_request_t request = { key, key_len, NULL, 0, &ctx.version, appendConditional, &ctx, false };
+    int ret = kvs_dispatch(cmd_type, request);
+
+    int status = kvs_status_of(KVS_OP_GET, ret);
+    *not_modified = ctx.not_modified;
+    if (status != KVS_STATUS_OK) {
+        appendLiteral(response, "{\"status\":\"");
+        appendLiteral(response, kvs_status_names[status]);
+        appendLiteral(response, "\",\"message\":\"");
+        appendLiteral(response, kvs_messages[KVS_OP_GET][status]);
+        appendLiteral(response, "\"}");
+    }
+    return status;
+}
+
+/*
+    hot restart: the snapshot goes through the same kvs_engine<> instances as the commands
+    restored entries keep their versions and the boot id is carried over, so ETags stay valid
+    partitions use NoLock and are read and filled from the main thread directly, so the caller must
+    guarantee no worker runs commands: the old process quiesces the pool first, the new one restores
+    before it dispatches any request (main.cpp)
+    every partition counts versions on its own, a key always maps to the same partition so its versions
+    still only grow; the snapshot carries the highest one and every partition moves forward to it
+*/
+template <int Engine>
+static kvs_version_t kvs_dump_of(kvs_entry_cb cb, void* arg) {
+    if constexpr (kvs_engine<Engine>::enabled) {
+        if (kvs_partitions == NULL) {
+            return kvs_engine<Engine>::instance().scan(cb, arg);
         }
-        ret = kvs_hash_mod(&global_hash, (char*)key, (char*)value);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"OK\",\"message\":\"Modified successfully\",\"data\":%s}",
-                strchr(data_json, '{'));
+        kvs_version_t last = 0;
+        for (int i = 0; i < kvs_partition_total; ++i) {
+            kvs_version_t version = kvs_engine<Engine>::partition(&kvs_partitions[i]).scan(cb, arg);
+            last = version > last ? version : last;
         }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
+        return last;
+    }
+    else {
+        (void)cb;
+        (void)arg;
+        return 0;
+    }
+}
+
+template <int Engine>
+static int kvs_restore_of(const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_version_t version) {
+    if constexpr (kvs_engine<Engine>::enabled) {
+        if (kvs_partitions == NULL) {
+            return kvs_engine<Engine>::instance().restore(key, key_len, value, value_len, version);
         }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to modify\",\"data\":%s}",
-                strchr(data_json, '{'));
+        kvs_partition_t* partition = &kvs_partitions[kvs_partition_of(key, key_len)];
+        return kvs_engine<Engine>::partition(partition).restore(key, key_len, value, value_len, version);
+    }
+    else {
+        (void)key;
+        (void)key_len;
+        (void)value;
+        (void)value_len;
+        (void)version;
+        return -1;
+    }
+}
+
+template <int Engine>
+static void kvs_restore_version_of(kvs_version_t version) {
+    if constexpr (kvs_engine<Engine>::enabled) {
+        kvs_engine<Engine>::instance().restoreVersion(version);
+        for (int i = 0; i < kvs_partition_total; ++i) {
+            kvs_engine<Engine>::partition(&kvs_partitions[i]).restoreVersion(version);
         }
+    }
+    else {
+        (void)version;
+    }
+}
+
+kvs_version_t kvs_dump(int engine, kvs_entry_cb cb, void* arg) {
+    switch (engine) {
+    case KVS_ENGINE_ARRAY:
+        return kvs_dump_of<KVS_ENGINE_ARRAY>(cb, arg);
+    case KVS_ENGINE_RBTREE:
+        return kvs_dump_of<KVS_ENGINE_RBTREE>(cb, arg);
+    case KVS_ENGINE_HASH:
+        return kvs_dump_of<KVS_ENGINE_HASH>(cb, arg);
+    default:
+        return 0;
+    }
+}
+
+int kvs_restore(int engine, const char* key, size_t key_len, const char* value, size_t value_len,
+    kvs_version_t version) {
+    int ret = -1;
+    switch (engine) {
+    case KVS_ENGINE_ARRAY:
+        ret = kvs_restore_of<KVS_ENGINE_ARRAY>(key, key_len, value, value_len, version);
+        break;
+    case KVS_ENGINE_RBTREE:
+        ret = kvs_restore_of<KVS_ENGINE_RBTREE>(key, key_len, value, value_len, version);
+        break;
+    case KVS_ENGINE_HASH:
+        ret = kvs_restore_of<KVS_ENGINE_HASH>(key, key_len, value, value_len, version);
         break;
+    default:
+        return -1;
+    }
 
-    case KVS_CMD_HEXIST:
-        ret = kvs_hash_exist(&global_hash, (char*)key);
-        if (ret == 0) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"EXIST\",\"message\":\"Key exists\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else if (ret == 1) {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"NO_EXIST\",\"message\":\"Key not found\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
-        else {
-            kvs_get_stats(data_json);
-            return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Failed to check\",\"data\":%s}",
-                strchr(data_json, '{'));
-        }
+    int status = kvs_status_of(KVS_OP_SET, ret);
+    if (status == KVS_STATUS_OK) {
+        global_kvs_counters[engine].count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return status;
+}
+
+void kvs_restore_version(int engine, kvs_version_t version) {
+    switch (engine) {
+    case KVS_ENGINE_ARRAY:
+        kvs_restore_version_of<KVS_ENGINE_ARRAY>(version);
+        break;
+    case KVS_ENGINE_RBTREE:
+        kvs_restore_version_of<KVS_ENGINE_RBTREE>(version);
+        break;
+    case KVS_ENGINE_HASH:
+        kvs_restore_version_of<KVS_ENGINE_HASH>(version);
         break;
-#endif
     default:
-        return sprintf(response, "{\"status\":\"ERROR\",\"message\":\"Unsupported command\"}");
+        break;
     }
+}
 
-    return 0;
+unsigned long kvs_get_boot_id(void) {
+    return kvs_boot_id;
+}
+
+void kvs_set_boot_id(unsigned long boot_id) {
+    kvs_boot_id = boot_id;
 }
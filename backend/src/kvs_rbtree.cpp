@@ -1,10 +1,17 @@
 #include"kvstore.h"
-#include <shared_mutex>
 
-kvs_rbtree_t global_rbtree;
+// 红黑树的平衡算法，节点的分配、拷贝和加锁由 KvEngine<RbtreeIndex, ...> 负责（kv_engine.h）
 
-// 读写锁
-std::shared_mutex global_rbtree_rwlock;
+#if ENABLE_KEY_CHAR
+// binary-safe key compare: bytes first, then the shorter key is smaller (same order as strcmp for text keys)
+static inline int rbtree_key_compare(const char* a, size_t a_len, const char* b, size_t b_len) {
+    int ret = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (ret != 0) {
+        return ret;
+    }
+    return (a_len < b_len) ? -1 : (a_len > b_len ? 1 : 0);
+}
+#endif
 
 rbtree_node* rbtree_mini(rbtree* T, rbtree_node* x) {
     while (x->left != T->nil) {
@@ -143,10 +150,11 @@ void rbtree_insert(rbtree* T, rbtree_node* z) {
     while (x != T->nil) {
         y = x;
 #if ENABLE_KEY_CHAR
-        if (strcmp(z->key, x->key) < 0) {
+        int cmp = rbtree_key_compare(z->key, z->key_len, x->key, x->key_len);
+        if (cmp < 0) {
             x = x->left;
         }
-        else if (strcmp(z->key, x->key) > 0) {
+        else if (cmp > 0) {
             x = x->right;
         }
         else {
@@ -170,7 +178,7 @@ void rbtree_insert(rbtree* T, rbtree_node* z) {
         T->root = z;
     }
 #if ENABLE_KEY_CHAR
-    else if (strcmp(z->key, y->key) < 0) {
+    else if (rbtree_key_compare(z->key, z->key_len, y->key, y->key_len) < 0) {
         y->left = z;
     }
 #else
@@ -301,6 +309,18 @@ rbtree_node* rbtree_delete(rbtree* T, rbtree_node* z) {
         tmp = z->value;
         z->value = y->value;
         y->value = (char*)tmp;
+
+        size_t len = z->key_len;
+        z->key_len = y->key_len;
+        y->key_len = len;
+
+        len = z->value_len;
+        z->value_len = y->value_len;
+        y->value_len = len;
+
+        kvs_version_t version = z->version;
+        z->version = y->version;
+        y->version = version;
 #else
         z->key = y->key;
         z->value = y->value;
@@ -314,15 +334,16 @@ rbtree_node* rbtree_delete(rbtree* T, rbtree_node* z) {
     return y;
 }
 
-rbtree_node* rbtree_search(rbtree* T, KEY_TYPE key) {
+rbtree_node* rbtree_search_n(rbtree* T, const char* key, size_t key_len) {
 
     rbtree_node* node = T->root;
     while (node != T->nil) {
 #if ENABLE_KEY_CHAR
-        if (strcmp(key, node->key) < 0) {
+        int cmp = rbtree_key_compare(key, key_len, node->key, node->key_len);
+        if (cmp < 0) {
             node = node->left;
         }
-        else if (strcmp(key, node->key) > 0) {
+        else if (cmp > 0) {
             node = node->right;
         }
         else {
@@ -355,186 +376,3 @@ void rbtree_traversal(rbtree* T, rbtree_node* node) {
         rbtree_traversal(T, node->right);
     }
 }
-
-
-// 5+2 SET, GET, DEL, MOD, EXIST, CREATE, DESTROY
-
-/*
-    @return
-    -1: failed, 0: success
-*/
-int kvs_rbtree_create(kvs_rbtree_t* inst) {
-    if (inst == NULL) {
-        return -1;
-    }
-
-    inst->nil = (rbtree_node*)kvs_malloc(sizeof(rbtree_node));
-    inst->nil->color = BLACK;
-    inst->root = inst->nil;
-    inst->count = 0;  // 初始化节点计数为0
-
-    return 0;
-}
-
-void kvs_rbtree_destroy(kvs_rbtree_t* inst) {
-    if (inst == NULL) {
-        return;
-    }
-
-    rbtree_node* node = NULL;
-
-    while (!(node = inst->root)) {
-        rbtree_node* mini = rbtree_mini(inst, node);
-
-        rbtree_node* cur = rbtree_delete(inst, mini);
-
-        kvs_free(cur);
-    }
-
-    kvs_free(inst->nil);
-
-    return;
-}
-
-/*
-    @return
-    -1: ERROR, 0: SUCCESS, 1: EXIST
-*/
-int kvs_rbtree_set(kvs_rbtree_t* inst, char* key, char* value) {
-    std::unique_lock<std::shared_mutex> lock(global_rbtree_rwlock);
-
-    if (!inst || !key || !value) {
-        return -1;
-    }
-
-    rbtree_node* node = rbtree_search(inst, key);
-    if (node && node != inst->nil) {
-        return 1;   // EXIST
-    }
-
-    node = (rbtree_node*)kvs_malloc(sizeof(rbtree_node));
-
-    node->key = (KEY_TYPE)kvs_malloc(strlen(key) + 1);
-
-    if (!node->key) {
-        return -1;
-    }
-    memset(node->key, 0, strlen(key) + 1);
-    strcpy(node->key, key);
-
-    node->value = (char*)kvs_malloc(strlen(value) + 1);
-    if (!node->value) {
-        return -1;
-    }
-    memset(node->value, 0, strlen(value) + 1);
-    strcpy((char*)node->value, value);
-
-    rbtree_insert(inst, node);
-    inst->count++;  // 成功插入节点，计数加1
-
-    return 0;
-}
-
-/*
-    @return
-    if NULL: NO EXIST, else: THE VALUE OF KEY
-*/
-char* kvs_rbtree_get(kvs_rbtree_t* inst, char* key) {
-    std::shared_lock<std::shared_mutex> lock(global_rbtree_rwlock);
-
-    if (!inst || !key) {
-        return NULL;
-    }
-
-    rbtree_node* node = rbtree_search(inst, key);
-
-    //printf("Key: %s, Value: %s\n", node->key, (char*)node->value);
-
-    if (node == NULL || node == inst->nil) {
-        return NULL;   // no exist
-    }
-
-    return (char*)node->value;
-}
-
-/*
-    @return
-    -1: ERROR, 0: SUCCESS, 1: NO EXIST
-*/
-int kvs_rbtree_del(kvs_rbtree_t* inst, char* key) {
-    std::unique_lock<std::shared_mutex> lock(global_rbtree_rwlock);
-
-    if (!inst || !key) {
-        return -1;
-    }
-
-    rbtree_node* node = rbtree_search(inst, key);
-
-    //printf("Key: %s, Value: %s\n", node->key, (char*)node->value);
-
-    if (node == NULL || node == inst->nil) {
-        return 1;   // no exist
-    }
-
-    rbtree_node* cur = rbtree_delete(inst, node);
-    free(cur);
-    inst->count--;  // 成功删除节点，计数减1
-
-    return 0;
-}
-
-/*
-    @return
-    -1: ERROR, 0: SUCCESS, 1: NO EXIST
-*/
-int kvs_rbtree_mod(kvs_rbtree_t* inst, char* key, char* value) {
-    std::unique_lock<std::shared_mutex> lock(global_rbtree_rwlock);
-
-    if (!inst || !key || !value) {
-        return -1;
-    }
-
-    rbtree_node* node = rbtree_search(inst, key);
-
-    //printf("Key: %s, Value: %s\n", node->key, (char*)node->value);
-
-    if (node == NULL || node == inst->nil) {
-        return 1;   // no exist
-    }
-
-    kvs_free(node->value);
-
-    node->value = (char*)kvs_malloc(strlen(value) + 1);
-    if (!node->value) {
-        return -1;
-    }
-
-    memset(node->value, 0, strlen(value) + 1);
-    strcpy((char*)node->value, value);
-
-    return 0;
-
-}
-
-/*
-    @return
-    -1: ERROR, 0: EXIST, 1: NO EXIST
-*/
-int kvs_rbtree_exist(kvs_rbtree_t* inst, char* key) {
-    std::shared_lock<std::shared_mutex> lock(global_rbtree_rwlock);
-
-    if (!inst || !key) {
-        return -1;
-    }
-
-    rbtree_node* node = rbtree_search(inst, key);
-
-    //printf("Key: %s, Value: %s\n", node->key, (char*)node->value);
-
-    if (node == NULL || node == inst->nil) {
-        return 1;   // no exist
-    }
-
-    return 0;
-}
-
@@ -6,22 +6,107 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include <signal.h>
+#include <sched.h>
+#include <atomic>
+#include <vector>
 #include "threadpool.h"
 #include "http_kvs_connection.h"
-#include "lst_timer.h"
+#include "resp_connection.h"
+#include "binary_connection.h"
+#include "timer_wheel.h"
 #include "kvs_handler.h"
+#include "objectpool.h"
+#include "server_config.h"
+#include "topology.h"
+#include "hot_restart.h"
+#include "fair_queue.h"
+#include "server_stats.h"
 
 #define MAX_FD 65535                // 支持最大的文件描述符个数
 #define MAX_EVENT_NUMBER 65535      // epoll监听的最大的IO事件数
-#define TIMESLOT 5                  // 定时器信号间隔时间
-#define MAX_THREADS 4               // 线程池最大的线程数量
+#define CONNECTION_TIMEOUT_MS 15000    // 非活跃连接的超时时间（毫秒）
+#define POOL_ADJUST_MS 1000         // 按排队时间和利用率调整工作线程数量的周期（毫秒）
+#define DISPATCH_WINDOW 8           // 每个启用的工作线程最多同时分到的任务数，其余的请求在公平调度队列中等待
+#define HANDOFF_DRAIN_MS 5000       // 热重启时等待处理中的请求完成的最长时间（毫秒），之后未完成的连接被关闭
+#define HANDOFF_POLL_MS 10          // 热重启期间 epoll_wait 的超时时间，用于检查连接是否都已空闲
+#define HANDOFF_QUIESCE_MS 1000     // 等待超时后停止投递，再等待工作线程上的请求完成的最长时间（毫秒）
+#define BUSY_POLL_BUDGET 8          // epoll 忙轮询时每次从网卡队列取出的最大包数（内核的默认值）
 
-static int pipefd[2];               // 定时器发送信号通过管道传输，0是读端，1是写端
-static SortTimerLst timer_lst;      // 定时器双向链表，一个TCP连接对应一个定时器
+// epoll 的忙轮询参数（Linux 6.9），旧的内核头文件中没有定义
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+static int pipefd[2];               // 信号通过管道传输，0是读端，1是写端
+static TimerWheel timer_wheel;      // 分层时间轮，一个TCP连接对应一个定时器
 static int epoll_fd = 0;            // epoll_create()
-HttpKvsConnection* users = new HttpKvsConnection[MAX_FD];     // 客户端的TCP连接任务类对象
-ClientData* lst_users = new ClientData[MAX_FD];         // 定时器客户端信息类对象
+
+/*
+    连接对象在 accept 时才从对象池中分配，连接关闭后归还，按文件描述符索引
+    连接对象的创建和回收只发生在主线程中，工作线程需要关闭连接时调用 shutdownConnection()
+*/
+static Connection* users[MAX_FD];               // 客户端的TCP连接任务类对象
+static ClientData* lst_users[MAX_FD];           // 定时器客户端信息类对象
+static ObjectPool<HttpKvsConnection> users_pool;
+static ObjectPool<RespConnection> resp_users_pool;
+static ObjectPool<BinaryConnection> binary_users_pool;
+static unsigned char users_protocol[MAX_FD];    // 连接使用的协议（ConnProtocol），决定连接对象归还到哪个对象池
+static ObjectPool<ClientData> lst_users_pool;
+static std::atomic<int> conn_worker[MAX_FD];    // 连接上一次被哪个工作线程处理，用于缓存亲和的任务投递
+static ServerConfig config;                     // 命令行参数
+static Topology topology;                       // CPU/NUMA 拓扑，--cpu-affinity 时使用
+
+/*
+    公平调度：读取到的请求先按客户端排队（令牌桶限流 + DRR），主线程只在线程池中的任务少于窗口时才投递
+    线程池的队列保持很短，积压的请求留在公平调度队列中，一个客户端的大量请求不会排在其他客户端前面
+    窗口满时主线程登记 dispatch_blocked，任务数降到窗口的一半时工作线程通过 dispatch_fd 唤醒主线程，
+    一次补充半个窗口，不必每完成一个任务就唤醒一次
+    请求按通道排队：窗口满了之后读通道还可以使用额外的保留窗口（--read-reserve），读请求投递到工作线程的
+    紧急收件箱，写请求和管理请求的积压不会挡住点查询
+*/
+static FairQueue fair_queue(MAX_FD);
+static std::atomic<size_t> tasks_in_flight(0);  // 已经投递、还没有处理完的任务数
+static std::atomic<bool> dispatch_blocked(false);
+static std::atomic<size_t> dispatch_resume(0);  // 任务数降到这个值时唤醒主线程
+static int dispatch_fd = -1;                    // eventfd
+static_assert(LANE_COUNT == sizeof(config.lane_weights) / sizeof(config.lane_weights[0]),
+    "ServerConfig::lane_weights must have one weight per RequestLane");
+
+/*
+    热重启（--handoff PATH）的旧进程一侧
+    新进程连上 PATH 之后进入移交状态：监听 socket 移出 epoll，空闲连接上的新请求留在内核缓冲区中，
+    处理中的请求完成后（或者等待超过 HANDOFF_DRAIN_MS）发送引擎数据、监听 socket 和空闲连接
+    引擎数据只在工作线程没有任务时发送：超时后停止投递并等待线程池中的任务完成，
+    否则已经回复客户端的写入可能不在快照中；等不到时放弃移交，旧进程继续服务
+*/
+static int handoff_listen_fd = -1;              // 等待新进程连接
+static int handoff_sock = -1;                   // 正在移交的新进程，-1 表示没有在移交
+static uint64_t handoff_deadline_ms = 0;
+static bool handed_off = false;                 // 已经移交完成，退出时不删除新进程在用的 socket 文件
+
+// 监听端口对应的协议
+enum ConnProtocol {
+    PROTO_HTTP = 0,
+    PROTO_RESP,
+    PROTO_BINARY,
+};
+
+// 线程池任务的操作码
+enum TaskOpcode {
+    TASK_PROCESS = 0,       // 解析请求并生成响应
+};
 
 // 添加信号捕捉
 void addSignal(int sig, void(handler)(int)) {
@@ -40,50 +125,721 @@ void sigHandler(int sig) {
     errno = save_errno;
 }
 
-// 超时函数处理
-void timerHandler() {
-    // 定时处理任务，实际上就是调用tick()函数
-    timer_lst.tick();
-    // 因为一次alarm调用只会引起一次SIGALRM信号，所以要重新定时，发送SIGALRM信号
-    alarm(TIMESLOT);
+/*
+    定时器回调函数，关闭超时连接的 socket 读写
+    连接可能正在被工作线程处理，这里不直接回收，等主线程收到挂断事件后统一回收
+*/
+extern void cbFunc(ClientData* user_data) {
+    user_data->timer = NULL;    // tick() 执行完回调后会删除定时器
+    shutdown(user_data->sockfd, SHUT_RDWR);
 }
 
-// 定时器回调函数，删除超时连接的socket上的注册事件
-extern void cbFunc(ClientData* user_data) {
-    users[user_data->sockfd].closeConnection();
+// 从协议对应的对象池中分配连接对象
+static Connection* createConnection(int protocol) {
+    switch (protocol) {
+    case PROTO_RESP:
+        return resp_users_pool.create();
+    case PROTO_BINARY:
+        return binary_users_pool.create();
+    default:
+        return users_pool.create();
+    }
+}
+
+static void destroyConnection(Connection* conn, int protocol) {
+    switch (protocol) {
+    case PROTO_RESP:
+        resp_users_pool.destroy(static_cast<RespConnection*>(conn));
+        break;
+    case PROTO_BINARY:
+        binary_users_pool.destroy(static_cast<BinaryConnection*>(conn));
+        break;
+    default:
+        users_pool.destroy(static_cast<HttpKvsConnection*>(conn));
+        break;
+    }
+}
+
+// 关闭连接，并将连接对象和定时器客户端信息归还到对象池
+void releaseConnection(int fd) {
+    ClientData* client = lst_users[fd];
+    if (client != NULL) {
+        if (client->timer) {
+            timer_wheel.delTimer(client->timer);
+        }
+        lst_users_pool.destroy(client);
+        lst_users[fd] = NULL;
+    }
+
+    Connection* conn = users[fd];
+    if (conn != NULL) {
+        conn->closeConnection();
+        destroyConnection(conn, users_protocol[fd]);
+        users[fd] = NULL;
+        fair_queue.removeConnection(fd);
+    }
+}
+
+// 创建监听 socket，并添加到 epoll 对象中
+static int createListenSocket(int epoll_fd, int port) {
+    int listen_fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        perror("socket");
+        exit(-1);
+    }
+
+    struct sockaddr_in server_addr;
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    // 端口复用
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    int ret = bind(listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    if (ret == -1) {
+        perror("bind");
+        exit(-1);
+    }
+
+    // 监听
+    ret = listen(listen_fd, 65535);
+    if (ret == -1) {
+        perror("listen");
+        exit(-1);
+    }
+
+    // listenfd ==> epoll
+    addFDEpoll(epoll_fd, listen_fd, false, false);
+    return listen_fd;
+}
+
+/*
+    创建 Unix 域监听 socket，并添加到 epoll 对象中
+    同一台主机上的客户端不经过 TCP/IP 协议栈，连接建立后与 TCP 连接走相同的 reactor 和连接对象
+    上次运行留下的 socket 文件先删除；路径上已有的普通文件不会被覆盖，bind 失败退出
+*/
+static int createUnixListenSocket(int epoll_fd, const char* path) {
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        perror("socket");
+        exit(-1);
+    }
+
+    struct sockaddr_un server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sun_family = AF_UNIX;
+    strncpy(server_addr.sun_path, path, sizeof(server_addr.sun_path) - 1);
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    int ret = bind(listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    if (ret == -1) {
+        perror("bind");
+        exit(-1);
+    }
+
+    ret = listen(listen_fd, 65535);
+    if (ret == -1) {
+        perror("listen");
+        exit(-1);
+    }
+
+    addFDEpoll(epoll_fd, listen_fd, false, false);
+    return listen_fd;
+}
+
+// 单调时钟的当前时间（微秒），用于 reactor 忙轮询的期限
+static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+    低延迟模式：让内核在 epoll_wait 中直接轮询网卡队列（需要 Linux 6.9 的 EPIOCSPARAMS），
+    不支持时 reactor 仍然在用户态用 0 超时的 epoll_wait 自旋
+*/
+static void enableBusyPoll(int epoll_fd) {
+    struct epoll_params params;
+    memset(&params, 0, sizeof(params));
+    params.busy_poll_usecs = config.busy_poll_us;
+    params.busy_poll_budget = BUSY_POLL_BUDGET;
+    params.prefer_busy_poll = 1;
+    if (ioctl(epoll_fd, EPIOCSPARAMS, &params) == -1) {
+        printf("busy poll: epoll busy polling not supported (%s), spinning in user space only\n", strerror(errno));
+    }
+    else {
+        printf("busy poll: reactor and idle workers spin for up to %d us before blocking\n", config.busy_poll_us);
+    }
+}
+
+/*
+    等待 epoll 事件，低延迟模式下先用 0 超时自旋 busy_poll_us，期间没有事件才阻塞
+    自旋从上一批事件处理完开始计时，连续到达的请求不经过睡眠和唤醒
+*/
+static int waitEvents(int epoll_fd, epoll_event* events, int timeout_ms) {
+    if (config.busy_poll_us > 0 && timeout_ms != 0) {
+        uint64_t deadline = monotonicUs() + config.busy_poll_us;
+        do {
+            int num = epoll_wait(epoll_fd, events, MAX_EVENT_NUMBER, 0);
+            if (num != 0) {
+                return num;
+            }
+            sched_yield();  // 与工作线程共用 CPU 时让出时间片，独占的核上立即返回
+        } while (monotonicUs() < deadline);
+    }
+    return epoll_wait(epoll_fd, events, MAX_EVENT_NUMBER, timeout_ms);
+}
+
+/*
+    为已经建立的连接分配连接对象和定时器客户端信息，并加入时间轮
+    @return 连接对象，NULL 表示连接数已满或者分配失败（socket 已关闭）
+*/
+static Connection* registerConnection(int communication_fd, int protocol, const sockaddr_in& client_addr) {
+    if (Connection::m_user_count >= MAX_FD || communication_fd >= MAX_FD) {
+        // 客户端的连接数已满
+        close(communication_fd);
+        return NULL;
+    }
+
+    Connection* conn = createConnection(protocol);
+    ClientData* client = lst_users_pool.create();
+    if (conn == NULL || client == NULL) {
+        if (conn != NULL) {
+            destroyConnection(conn, protocol);
+        }
+        lst_users_pool.destroy(client);
+        close(communication_fd);
+        return NULL;
+    }
+    if (config.busy_poll_us > 0 && client_addr.sin_family == AF_INET) {
+        // 读这个连接时在网卡队列上忙轮询，失败（没有 CAP_NET_ADMIN 时不能超过 net.core.busy_read）不影响服务
+        int usecs = config.busy_poll_us;
+        setsockopt(communication_fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+    }
+    users[communication_fd] = conn;
+    users_protocol[communication_fd] = (unsigned char)protocol;
+    lst_users[communication_fd] = client;
+    conn_worker[communication_fd].store(-1, std::memory_order_relaxed);
+    fair_queue.addConnection(communication_fd, client_addr.sin_family == AF_INET ? client_addr.sin_addr.s_addr : 0,
+        TimerWheel::nowMs());
+
+    // 客户端连接初始化
+    conn->init(communication_fd, client_addr);
+
+    // 定时器用户初始化
+    client->address = client_addr;
+    client->sockfd = communication_fd;
+
+    // 从时间轮的节点池中创建定时器
+    UtilTimer* timer = timer_wheel.createTimer();
+    timer->user_data = client;
+    timer->cb_func = cbFunc;
+    timer->expire = TimerWheel::nowMs() + CONNECTION_TIMEOUT_MS;
+    client->timer = timer;
+    timer_wheel.addTimer(timer);
+    return conn;
+}
+
+/*
+    接受新的客户端连接，protocol 为监听端口对应的协议
+    Unix 域连接没有 IP 地址，客户端地址只记录 sin_family = AF_UNIX
+*/
+static void acceptConnection(int listen_fd, int protocol, bool local = false) {
+    struct sockaddr_in client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    socklen_t addr_len = sizeof(client_addr);
+    int communication_fd = local ? accept(listen_fd, NULL, NULL) :
+        accept(listen_fd, (struct sockaddr*)&client_addr, &addr_len);
+    if (local) {
+        client_addr.sin_family = AF_UNIX;
+    }
+    if (communication_fd < 0) {
+        perror("accept");
+        printf("errno is %d.\n", errno);
+        return;
+    }
+
+    registerConnection(communication_fd, protocol, client_addr);
+}
+
+// 热重启的连接记录：旧进程移交的连接，等 reactor 初始化完成之后再注册
+struct AdoptedConnection {
+    int fd;
+    int protocol;
+    int state;
+};
+
+/*
+    新进程：连接旧进程，载入引擎数据，接收监听 socket（按用途放到 listen_fds 中）和空闲连接
+    没有旧进程时返回 false，按冷启动处理；载入数据失败时退出，不能带着不完整的数据提供服务
+*/
+static bool takeOver(const char* path, int listen_fds[HANDOFF_LISTEN_COUNT], std::vector<AdoptedConnection>& conns) {
+    int sock = handoff_connect(path);
+    if (sock == -1) {
+        return false;
+    }
+
+    uint64_t start_ms = TimerWheel::nowMs();
+    if (handoff_recv_snapshot(sock) != 0) {
+        printf("hot restart: failed to load the engine snapshot from %s\n", path);
+        exit(-1);
+    }
+
+    int fd = -1, kind = 0, state = 0;
+    int ret = 0;
+    while ((ret = handoff_recv_fd(sock, &fd, &kind, &state)) == 1) {
+        if (kind < HANDOFF_LISTEN_COUNT && listen_fds[kind] == -1) {
+            listen_fds[kind] = fd;
+        }
+        else if (kind >= HANDOFF_CONN_BASE && kind - HANDOFF_CONN_BASE <= PROTO_BINARY) {
+            conns.push_back({ fd, kind - HANDOFF_CONN_BASE, state });
+        }
+        else {
+            close(fd);
+        }
+    }
+    if (ret != 0) {
+        // 引擎数据已经载入，缺少的监听 socket 重新创建
+        printf("hot restart: file descriptor handoff was cut short\n");
+    }
+    close(sock);
+
+    printf("hot restart: took over %zu connections in %llu ms\n", conns.size(),
+        (unsigned long long)(TimerWheel::nowMs() - start_ms));
+    return true;
+}
+
+// 新进程：注册旧进程移交的连接，恢复协议状态；内核缓冲区中还没有读取的请求在注册后立即触发 EPOLLIN
+static void adoptConnection(const AdoptedConnection& adopted) {
+    struct sockaddr_in client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    socklen_t addr_len = sizeof(client_addr);
+    if (getpeername(adopted.fd, (struct sockaddr*)&client_addr, &addr_len) != 0 ||
+        client_addr.sin_family != AF_INET) {
+        memset(&client_addr, 0, sizeof(client_addr));
+        client_addr.sin_family = AF_UNIX;
+    }
+
+    Connection* conn = registerConnection(adopted.fd, adopted.protocol, client_addr);
+    if (conn != NULL) {
+        conn->restoreState(adopted.state);
+    }
+}
+
+// 没有线程在处理，也没有未处理完的请求和未发送完的响应，可以移交给新进程
+static bool handoffIdle(Connection* conn) {
+    return conn->armed() && conn->handoffState() >= 0;
+}
+
+/*
+    旧进程：新进程连上之后停止 accept，开始等待处理中的请求完成
+    监听 socket 只是移出 epoll，新连接在内核的 accept 队列中等待新进程
+*/
+static void beginHandoff(const int listen_fds[HANDOFF_LISTEN_COUNT]) {
+    int sock = handoff_accept(handoff_listen_fd);
+    if (sock == -1) {
+        return;
+    }
+    if (handoff_sock != -1) {
+        // 已经在向另一个新进程移交
+        close(sock);
+        return;
+    }
+
+    handoff_sock = sock;
+    handoff_deadline_ms = TimerWheel::nowMs() + HANDOFF_DRAIN_MS;
+    for (int role = 0; role < HANDOFF_LISTEN_COUNT; ++role) {
+        if (listen_fds[role] != -1) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fds[role], NULL);
+        }
+    }
+    printf("hot restart: new process connected, draining\n");
+}
+
+// 旧进程：所有连接都已空闲
+static bool handoffDrained() {
+    for (int fd = 0; fd < MAX_FD; ++fd) {
+        if (users[fd] != NULL && !handoffIdle(users[fd])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    旧进程：等待超时后主线程不再投递请求，阻塞等待已经投递的任务完成（最多 HANDOFF_QUIESCE_MS）
+    返回 true 时没有工作线程在执行命令，直到主线程再次投递之前引擎数据不会变化
+*/
+static bool quiesceWorkers() {
+    uint64_t deadline_ms = TimerWheel::nowMs() + HANDOFF_QUIESCE_MS;
+    while (tasks_in_flight.load(std::memory_order_seq_cst) != 0) {
+        if (TimerWheel::nowMs() >= deadline_ms) {
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+/*
+    旧进程：发送引擎数据，收到新进程的确认后发送监听 socket 和空闲连接
+    调用前线程池中没有任务（handoffDrained() 或者 quiesceWorkers()），快照包含所有已经回复的写入
+    返回 false 表示新进程没有接手，旧进程继续服务；返回 true 之后旧进程退出，
+    超过 HANDOFF_DRAIN_MS 仍未完成的连接（请求还在公平调度队列中，没有执行）在退出时关闭
+*/
+static bool finishHandoff(const int listen_fds[HANDOFF_LISTEN_COUNT]) {
+    uint64_t start_ms = TimerWheel::nowMs();
+    if (handoff_send_snapshot(handoff_sock) != 0) {
+        return false;
+    }
+
+    // 新进程已经载入数据，从这里开始不再处理任何请求
+    for (int role = 0; role < HANDOFF_LISTEN_COUNT; ++role) {
+        if (listen_fds[role] != -1) {
+            handoff_send_fd(handoff_sock, listen_fds[role], role, 0);
+        }
+    }
+
+    int moved = 0;
+    for (int fd = 0; fd < MAX_FD; ++fd) {
+        Connection* conn = users[fd];
+        if (conn == NULL || !handoffIdle(conn)) {
+            continue;
+        }
+        if (handoff_send_fd(handoff_sock, fd, HANDOFF_CONN_BASE + users_protocol[fd], conn->handoffState()) == 0) {
+            ++moved;
+        }
+        // 新进程持有同一个 socket，这里只关闭本进程的文件描述符
+        releaseConnection(fd);
+    }
+    handoff_send_end(handoff_sock);
+    close(handoff_sock);
+    handoff_sock = -1;
+    handed_off = true;
+
+    printf("hot restart: handed off %d connections in %llu ms\n", moved,
+        (unsigned long long)(TimerWheel::nowMs() - start_ms));
+    return true;
 }
 
-// 设置文件描述符非阻塞
-extern int setNonBlocking(int fd);
+// 旧进程：移交失败，监听 socket 回到 epoll，停下来的空闲连接重新注册（内核缓冲区中可能已经有请求）
+static void abortHandoff(const int listen_fds[HANDOFF_LISTEN_COUNT]) {
+    close(handoff_sock);
+    handoff_sock = -1;
+    for (int role = 0; role < HANDOFF_LISTEN_COUNT; ++role) {
+        if (listen_fds[role] != -1) {
+            addFDEpoll(epoll_fd, listen_fds[role], false, false);
+        }
+    }
+    for (int fd = 0; fd < MAX_FD; ++fd) {
+        if (users[fd] != NULL && handoffIdle(users[fd])) {
+            users[fd]->rearm(EPOLLIN);
+        }
+    }
+    printf("hot restart: new process did not take over, resuming\n");
+}
 
-// 添加文件描述符到epoll对象中
-extern void addFDEpoll(int epoll_fd, int fd, bool et, bool one_shot);
+/*
+    工作线程的任务处理函数，任务记录中只有文件描述符和操作码
+    任务在队列中时连接的 EPOLLONESHOT 没有重新注册，主线程不会回收连接对象，这里可以直接按 fd 取出
+*/
+static void runTask(const PoolTask& task, bool expired) {
+    Connection* conn = users[task.fd];
+    if (conn == NULL) {
+        return;
+    }
 
-// 从epoll对象中删除文件描述符
-extern void removeFDEpoll(int epoll_fd, int fd);
+    // 记录处理这个连接的工作线程，下一个请求继续投递给它，连接状态还在它的缓存中
+    conn_worker[task.fd].store(ThreadPool::CurrentWorker(), std::memory_order_relaxed);
 
-// 修改epoll对象中的文件描述符
-extern void modifyFDEpoll(int epoll_fd, int fd, int event_num);
+    switch (task.opcode) {
+    case TASK_PROCESS:
+        if (expired) {
+            // 排队超过期限，不再处理请求，直接发送过载响应
+            conn->rejectOverloaded(config.retry_after_s);
+            conn->flush();
+            return;
+        }
+        conn->process();
+        break;
+    }
+}
+
+static void handleTask(const PoolTask& task, bool expired) {
+    runTask(task, expired);
+
+    // 与 dispatchPending() 中登记 dispatch_blocked 配对：要么主线程看到任务数减少，要么这里看到登记
+    size_t left = tasks_in_flight.fetch_sub(1, std::memory_order_seq_cst) - 1;
+    if (left <= dispatch_resume.load(std::memory_order_relaxed) &&
+        dispatch_blocked.load(std::memory_order_seq_cst) && dispatch_blocked.exchange(false)) {
+        uint64_t one = 1;
+        ssize_t n = ::write(dispatch_fd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+/*
+    主线程直接回复拒绝响应（503 过载、429 超出速率），调用之前已经取得连接的所有权
+    @return false: 连接已经回收
+*/
+static bool rejectInReactor(int fd, Connection* conn, bool rate_limited, int retry_after_s) {
+    if (rate_limited) {
+        conn->rejectRateLimited(retry_after_s);
+    }
+    else {
+        conn->rejectOverloaded(retry_after_s);
+    }
+    if (!conn->write()) {
+        releaseConnection(fd);
+        return false;
+    }
+    return true;
+}
+
+/*
+    读取到请求之后交给公平调度队列：限流、排队，由 dispatchPending() 投递
+    @return false: 连接已经回收
+*/
+static bool submitRequest(int fd, Connection* conn) {
+    if (fair_queue.pending() >= config.queue_capacity) {
+        // 积压的请求已满，快速失败：主线程直接返回过载响应，不让请求继续堆积
+        global_server_stats.tasks_shed.fetch_add(1, std::memory_order_relaxed);
+        return rejectInReactor(fd, conn, false, config.retry_after_s);
+    }
+
+    uint64_t wait_ms = 0;
+    switch (fair_queue.submit(fd, conn->requestLane(), conn->readBytes(), TimerWheel::nowMs(), &wait_ms)) {
+    case FairQueue::FAIR_DELAYED:
+        global_server_stats.throttled.fetch_add(1, std::memory_order_relaxed);
+        global_server_stats.throttle_delay_ms.fetch_add(wait_ms, std::memory_order_relaxed);
+        return true;
+    case FairQueue::FAIR_REJECTED:
+        global_server_stats.rate_limited.fetch_add(1, std::memory_order_relaxed);
+        return rejectInReactor(fd, conn, true, (int)((wait_ms + 999) / 1000));
+    default:
+        return true;
+    }
+}
+
+static void storeSchedulerStats() {
+    global_server_stats.fair_pending.store(fair_queue.pending(), std::memory_order_relaxed);
+    for (int lane = 0; lane < LANE_COUNT; ++lane) {
+        global_server_stats.lane_pending[lane].store(fair_queue.laneQueued(lane), std::memory_order_relaxed);
+    }
+}
+
+// 按通道权重和 DRR 从公平调度队列中取出请求投递给线程池，直到线程池中的任务数达到窗口
+static void dispatchPending(ThreadPool* pool) {
+    size_t window = pool->Active() * DISPATCH_WINDOW;
+    size_t reserve = pool->Active() * config.read_reserve;
+    uint64_t now = TimerWheel::nowMs();
+    while (fair_queue.pending() > 0) {
+        // 窗口满了只投递读请求，保留窗口也满了就不再投递
+        size_t in_flight = tasks_in_flight.load(std::memory_order_relaxed);
+        unsigned lanes = in_flight < window ? FairQueue::ALL_LANES :
+            (in_flight < window + reserve ? 1u << LANE_READ : 0);
+
+        uint64_t queued_ms = 0;
+        int lane = LANE_WRITE;
+        int fd = lanes != 0 ? fair_queue.next(now, lanes, &queued_ms, &lane) : -1;
+        if (fd == -1) {
+            if (lanes == FairQueue::ALL_LANES) {
+                break;      // 只剩还在等待令牌的请求
+            }
+            // 先登记再重新检查，避免工作线程在两步之间完成任务而错过唤醒
+            dispatch_resume.store(window / 2, std::memory_order_relaxed);
+            dispatch_blocked.store(true, std::memory_order_seq_cst);
+            if (tasks_in_flight.load(std::memory_order_seq_cst) > window / 2) {
+                break;
+            }
+            dispatch_blocked.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        storeSchedulerStats();
+        Connection* conn = users[fd];
+        if (config.queue_deadline_ms > 0 && now > queued_ms + config.queue_deadline_ms) {
+            // 在公平调度队列中等待超过期限，客户端大概率已经超时
+            global_server_stats.tasks_expired.fetch_add(1, std::memory_order_relaxed);
+            rejectInReactor(fd, conn, false, config.retry_after_s);
+            continue;
+        }
+
+        // shared-nothing 模式下投递给拥有第一个 key 的工作线程，看不出 key 时按连接亲和投递
+        int worker = conn_worker[fd].load(std::memory_order_relaxed);
+        const char* key = NULL;
+        size_t key_len = 0;
+        if (config.partitions && conn->routingKey(&key, &key_len)) {
+            worker = kvs_partition_owner(key, key_len);
+        }
+        tasks_in_flight.fetch_add(1, std::memory_order_relaxed);
+        if (!pool->Post(fd, TASK_PROCESS, worker, lane == LANE_READ)) {
+            tasks_in_flight.fetch_sub(1, std::memory_order_relaxed);
+            rejectInReactor(fd, conn, false, config.retry_after_s);
+            continue;
+        }
+        global_server_stats.lane_dispatched[lane].fetch_add(1, std::memory_order_relaxed);
+    }
+    storeSchedulerStats();
+}
+
+/*
+    绑核模式下把线程放到拓扑中的第 slot 个 CPU 上（0 为 reactor，之后为工作线程）
+    线程之后分配的内存（连接缓冲区等）优先放在这个 CPU 所在的节点上
+*/
+static void placeThread(const char* name, int slot) {
+    int cpu = topology_cpu_for_slot(&topology, slot);
+    int node = topology_node_of_cpu(&topology, cpu);
+    bool pinned = topology_pin_thread(cpu) == 0;
+    bool local = topology_prefer_node(node) == 0;
+    BufferPool::setThreadNode(node);
+    printf("%s -> cpu %d, node %d%s%s\n", name, cpu, node,
+        pinned ? "" : " (pin failed)", local ? "" : " (mempolicy failed)");
+}
+
+/*
+    向所有 WebSocket 连接推送引擎的统计信息，由主线程按 --ws-push-interval-ms 调用
+    正在被工作线程处理（或者等待处理）的连接取不到所有权，跳过这一次
+*/
+static void pushStats() {
+    char stats_json[KVS_STATS_MAX_LEN];
+    if (kvs_get_stats(stats_json) <= 0) {
+        return;
+    }
+
+    // {"event":"stats","status":"OK","data":{...}}
+    char message[KVS_STATS_MAX_LEN + 32];
+    int len = snprintf(message, sizeof(message), "{\"event\":\"stats\",%s", stats_json + 1);
+    if (len <= 0 || len >= (int)sizeof(message)) {
+        return;
+    }
+
+    for (int fd = 0; fd < MAX_FD; ++fd) {
+        Connection* conn = users[fd];
+        if (conn == NULL || !conn->pushEnabled() || !conn->claim()) {
+            continue;
+        }
+        if (!conn->push(message, len)) {
+            // 发送失败，按挂断处理，由主线程收到事件后回收
+            conn->shutdownConnection();
+            continue;
+        }
+
+        // 订阅推送的连接不算非活跃连接
+        UtilTimer* timer = lst_users[fd] != NULL ? lst_users[fd]->timer : NULL;
+        if (timer) {
+            timer_wheel.adjustTimer(timer, TimerWheel::nowMs() + CONNECTION_TIMEOUT_MS);
+        }
+    }
+}
+
+/*
+    确定工作线程的数量：可用的 CPU 数量取亲和性掩码和 cgroup 配额中较小的一个
+    默认启动时留一个 CPU 给 reactor，运行中在 [1, CPU 数量] 内调整；只给 --workers 时数量固定
+*/
+static void sizeWorkers(size_t* initial, size_t* min_workers, size_t* max_workers) {
+    double quota = 0;
+    int cpus = topology_cpu_limit(&quota);
+    if (quota > 0) {
+        printf("usable cpus: %d (cgroup quota %.2f)\n", cpus, quota);
+    }
+    else {
+        printf("usable cpus: %d\n", cpus);
+    }
+
+    bool fixed = config.workers > 0 && config.min_workers == 0 && config.max_workers == 0;
+    size_t max = config.max_workers > 0 ? config.max_workers : (fixed ? config.workers : cpus);
+    size_t min = config.min_workers > 0 ? config.min_workers : (fixed ? config.workers : 1);
+    size_t start = config.workers > 0 ? config.workers : (cpus > 1 ? cpus - 1 : 1);
+    if (max > MAX_WORKERS) {
+        max = MAX_WORKERS;
+    }
+    if (min > max) {
+        min = max;
+    }
+    *initial = start < min ? min : (start > max ? max : start);
+    *min_workers = min;
+    *max_workers = max;
+    if (config.partitions) {
+        // 每个线程拥有一个分区，请求按 key 投递给它，停用的线程收不到投递，线程数量固定为上限
+        *initial = max;
+        *min_workers = max;
+    }
+}
+
+static void initWorker(size_t index) {
+    if (config.cpu_affinity) {
+        char name[32];
+        snprintf(name, sizeof(name), "worker %zu", index);
+        placeThread(name, (int)index + 1);
+    }
+    if (config.partitions) {
+        kvs_partition_attach((int)index);
+    }
+}
+
+// shared-nothing 模式：其他线程把命令转发给分区的所有者之后敲门，所有者（可能在休眠）醒来执行
+static void notifyPartition(int partition, void* arg) {
+    ((ThreadPool*)arg)->Notify((size_t)partition);
+}
+
+static void handlePartitionMail(size_t index) {
+    (void)index;
+    kvs_partition_poll();
+}
+
+// 引擎的大表交错分布到所有节点上，避免所有线程都访问同一个节点的内存
+static void interleaveRegion(void* addr, size_t len, void* arg) {
+    if (topology_interleave((const Topology*)arg, addr, len) != 0) {
+        printf("engine table %p (%zu bytes) interleave failed\n", addr, len);
+    }
+}
 
 int main(int argc, char* argv[]) {
-    if (argc <= 1) {
-        printf("Usage: %s port_number\n", basename(argv[0]));
+    // 解析端口号和运行参数
+    if (parse_server_config(argc, argv, &config) != 0) {
         exit(-1);
     }
+    int port = config.port;
+
+    if (config.cpu_affinity) {
+        if (topology_detect(&topology) != 0) {
+            printf("Failed to detect cpu topology!\n");
+            exit(-1);
+        }
+        printf("cpu topology: %d cpus, %d numa nodes\n", topology.cpu_count, topology.node_count);
+        placeThread("reactor", 0);
+    }
 
-    // 获取端口号
-    int port = atoi(argv[1]);
+    // 线程池的最大线程数决定分区的数量，先于引擎确定
+    size_t workers = 0;
+    size_t min_workers = 0;
+    size_t max_workers = 0;
+    sizeWorkers(&workers, &min_workers, &max_workers);
 
-    // 初始化KV存储
-    if (init_kvengine() != 0) {
+    // 初始化KV存储，分区模式下每个工作线程（包括暂停调度的）拥有一个分区
+    if (init_kvengine(config.partitions ? (int)max_workers : 0) != 0) {
         printf("Failed to initialize KV storage engines!\n");
         exit(-1);
     }
-    printf("kv storage engines initialized successfully.\n");
+    kvs_set_embed_stats(config.embed_stats);
+    if (config.cpu_affinity) {
+        kvs_engine_regions(interleaveRegion, &topology);
+    }
+    if (config.partitions) {
+        printf("kv storage engines initialized successfully, %zu shared-nothing partitions.\n", max_workers);
+    }
+    else {
+        printf("kv storage engines initialized successfully.\n");
+    }
 
     // 对 SIGPIPE 信号进行处理
     addSignal(SIGPIPE, SIG_IGN);
-    addSignal(SIGALRM, sigHandler);
     addSignal(SIGTERM, sigHandler);
     bool stop_server = false;
 
@@ -95,14 +851,45 @@ int main(int argc, char* argv[]) {
 
     ThreadPool* pool = nullptr;
     try {
-        pool = new ThreadPool(MAX_THREADS);
-        printf("Thread pool created with %d threads.\n", MAX_THREADS);
+        pool = new ThreadPool(workers, handleTask, config.queue_capacity, config.queue_deadline_ms,
+            config.cpu_affinity || config.partitions ? initWorker : NULL, min_workers, max_workers);
+        printf("Thread pool created with %zu threads (%zu-%zu), queue capacity %zu, queue deadline %d ms.\n",
+            workers, min_workers, max_workers, pool->QueueCapacity(), config.queue_deadline_ms);
     }
     catch (...) {
         printf("Failed to create thread pool!\n");
         exit(-1);
     }
 
+    fair_queue.setLimits(config.client_rate, config.client_burst, config.conn_rate, config.conn_burst,
+        config.throttle_delay_ms);
+    fair_queue.setLaneWeights(config.lane_weights);
+    if (config.partitions) {
+        // 窃取来的请求只能转发回所有者并等待，不如留给所有者执行
+        pool->SetStealing(false);
+        pool->SetMailHandler(handlePartitionMail);
+        kvs_partition_set_notify(notifyPartition, pool);
+    }
+    if (config.busy_poll_us > 0) {
+        enableBusyPoll(epoll_fd);
+        pool->SetIdleSpinUs(config.busy_poll_us);
+        if (topology_cpu_limit(NULL) <= 1) {
+            printf("busy poll: only one usable CPU, the reactor spin takes time away from the workers\n");
+        }
+    }
+    if (config.client_rate > 0 || config.conn_rate > 0) {
+        printf("rate limit: %d req/s per client (burst %d), %d req/s per connection (burst %d), max delay %d ms\n",
+            config.client_rate, config.client_burst, config.conn_rate, config.conn_burst, config.throttle_delay_ms);
+    }
+
+    // 工作线程完成任务后唤醒主线程继续投递公平调度队列中的请求
+    dispatch_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (dispatch_fd == -1) {
+        perror("eventfd");
+        exit(-1);
+    }
+    addFDEpoll(epoll_fd, dispatch_fd, false, false);
+
     // 创建一对相互连接的匿名套接字，适用于本地IPC，支持全双工通信
     int ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
     assert(ret != -1);
@@ -110,48 +897,89 @@ int main(int argc, char* argv[]) {
     setNonBlocking(pipefd[1]);
     addFDEpoll(epoll_fd, pipefd[0], false, false);
 
-    int listen_fd = socket(PF_INET, SOCK_STREAM, 0);
-    if (listen_fd == -1) {
-        perror("socket");
-        exit(-1);
+    // 热重启：先从旧进程接手引擎数据和监听 socket，旧进程的监听 socket 沿用它绑定的端口和路径
+    int inherited[HANDOFF_LISTEN_COUNT] = { -1, -1, -1, -1 };
+    std::vector<AdoptedConnection> adopted;
+    bool hot_restart = config.handoff_path != NULL && takeOver(config.handoff_path, inherited, adopted);
+    bool enabled[HANDOFF_LISTEN_COUNT] = { true, config.resp_port > 0, config.binary_port > 0, config.unix_path != NULL };
+    for (int role = 0; role < HANDOFF_LISTEN_COUNT; ++role) {
+        if (inherited[role] != -1 && enabled[role]) {
+            addFDEpoll(epoll_fd, inherited[role], false, false);
+        }
+        else if (inherited[role] != -1) {
+            close(inherited[role]);
+            inherited[role] = -1;
+        }
     }
 
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
-
-    // 端口复用
-    int reuse = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    int listen_fd = inherited[HANDOFF_LISTEN_HTTP] != -1 ? inherited[HANDOFF_LISTEN_HTTP] :
+        createListenSocket(epoll_fd, port);
 
-    int ret1 = bind(listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
-    if (ret1 == -1) {
-        perror("bind");
-        exit(-1);
+    // RESP 端口、二进制协议端口与 HTTP 端口共用 reactor、线程池和 KV 引擎
+    int resp_listen_fd = inherited[HANDOFF_LISTEN_RESP];
+    if (config.resp_port > 0 && resp_listen_fd == -1) {
+        resp_listen_fd = createListenSocket(epoll_fd, config.resp_port);
+    }
+    int binary_listen_fd = inherited[HANDOFF_LISTEN_BINARY];
+    if (config.binary_port > 0 && binary_listen_fd == -1) {
+        binary_listen_fd = createListenSocket(epoll_fd, config.binary_port);
+    }
+    int unix_listen_fd = inherited[HANDOFF_LISTEN_UNIX];
+    if (config.unix_path != NULL && unix_listen_fd == -1) {
+        unix_listen_fd = createUnixListenSocket(epoll_fd, config.unix_path);
     }
+    const int listen_fds[HANDOFF_LISTEN_COUNT] = { listen_fd, resp_listen_fd, binary_listen_fd, unix_listen_fd };
 
-    // 监听
-    int ret2 = listen(listen_fd, 65535);
-    if (ret2 == -1) {
-        perror("listen");
+    // 初始化 Connection 的 static 参数
+    Connection::m_epoll_fd = epoll_fd;
+
+    // 时间轮由 timerfd 驱动，不再使用 alarm() 和 SIGALRM
+    int timer_fd = timer_wheel.init();
+    if (timer_fd == -1) {
+        perror("timerfd_create");
         exit(-1);
     }
+    addFDEpoll(epoll_fd, timer_fd, false, false);
+    bool timeout = false;
+    uint64_t next_push_ms = TimerWheel::nowMs() + config.ws_push_interval_ms;
+    uint64_t next_adjust_ms = TimerWheel::nowMs() + POOL_ADJUST_MS;
 
-    // listenfd ==> epoll
-    addFDEpoll(epoll_fd, listen_fd, false, false);
-
-    // 初始化 HttpConnection 的 static 参数
-    HttpConnection::m_epoll_fd = epoll_fd;
+    // 旧进程移交的连接，注册之后才开始处理
+    for (size_t i = 0; i < adopted.size(); ++i) {
+        adoptConnection(adopted[i]);
+    }
 
-    bool timeout = false;
-    alarm(TIMESLOT);
+    // 等待下一次热重启的新进程
+    if (config.handoff_path != NULL) {
+        handoff_listen_fd = handoff_listen(config.handoff_path);
+        if (handoff_listen_fd == -1) {
+            printf("hot restart: cannot listen on %s\n", config.handoff_path);
+        }
+        else {
+            addFDEpoll(epoll_fd, handoff_listen_fd, false, false);
+        }
+    }
 
-    printf("kv webserver started on port %d\n", port);
+    printf("kv webserver %s on port %d\n", hot_restart ? "restarted" : "started", port);
+    if (resp_listen_fd != -1) {
+        printf("resp listener started on port %d\n", config.resp_port);
+    }
+    if (binary_listen_fd != -1) {
+        printf("binary listener started on port %d\n", config.binary_port);
+    }
+    if (unix_listen_fd != -1) {
+        printf("http listener started on unix socket %s\n", config.unix_path);
+    }
 
     // 检测 epoll 对象中的 IO 缓冲区变化
     while (!stop_server) {
-        int num = epoll_wait(epoll_fd, events, MAX_EVENT_NUMBER, -1);
+        // 有等待令牌的请求时，最多睡到它到期
+        int wait_ms = handoff_sock != -1 ? HANDOFF_POLL_MS : -1;
+        int delay_ms = fair_queue.pending() > 0 ? fair_queue.timeoutMs(TimerWheel::nowMs()) : -1;
+        if (delay_ms >= 0 && (wait_ms < 0 || delay_ms < wait_ms)) {
+            wait_ms = delay_ms;
+        }
+        int num = waitEvents(epoll_fd, events, wait_ms);
         if ((num < 0) && (errno != EINTR)) {
             // 被中断，或者 epoll_wait() 出错
             printf("epoll failure.\n");
@@ -162,39 +990,35 @@ int main(int argc, char* argv[]) {
         for (int i = 0; i < num; ++i) {
             int sockfd = events[i].data.fd;
             if (sockfd == listen_fd) {
-                struct sockaddr_in client_addr;
-                socklen_t addr_len = sizeof(client_addr);
-                int communication_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &addr_len);
-                if (communication_fd < 0) {
-                    perror("accept");
-                    printf("errno is %d.\n", errno);
-                    continue;
-                }
-
-                if (HttpConnection::m_user_count >= MAX_FD) {
-                    // 客户端的连接数已满
-                    close(communication_fd);
-                    continue;
-                }
-
-                // 客户端连接初始化
-                users[communication_fd].init(communication_fd, client_addr);
-
-                // 定时器用户初始化
-                lst_users[communication_fd].address = client_addr;
-                lst_users[communication_fd].sockfd = communication_fd;
-
-                // 创建定时器
-                UtilTimer* timer = new UtilTimer;
-                timer->user_data = &lst_users[communication_fd];
-                timer->cb_func = cbFunc;
-                time_t cur = time(NULL);    // 获取当前系统时间
-                timer->expire = cur + 3 * TIMESLOT;
-                lst_users[communication_fd].timer = timer;
-                timer_lst.addTimer(timer);
+                acceptConnection(listen_fd, PROTO_HTTP);
+            }
+            else if (resp_listen_fd != -1 && sockfd == resp_listen_fd) {
+                acceptConnection(resp_listen_fd, PROTO_RESP);
+            }
+            else if (binary_listen_fd != -1 && sockfd == binary_listen_fd) {
+                acceptConnection(binary_listen_fd, PROTO_BINARY);
+            }
+            else if (unix_listen_fd != -1 && sockfd == unix_listen_fd) {
+                acceptConnection(unix_listen_fd, PROTO_HTTP, true);
+            }
+            else if (handoff_listen_fd != -1 && sockfd == handoff_listen_fd) {
+                beginHandoff(listen_fds);
             }
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                users[sockfd].closeConnection();
+                releaseConnection(sockfd);
+            }
+            else if ((sockfd == timer_fd) && (events[i].events & EPOLLIN)) {
+                // 用timeout标记有定时任务需要处理，但不立即处理定时任务
+                uint64_t expirations = 0;
+                ssize_t n = ::read(timer_fd, &expirations, sizeof(expirations));
+                (void)n;
+                timeout = true;
+            }
+            else if (sockfd == dispatch_fd) {
+                // 线程池中有任务完成，窗口有空位，投递在下面统一进行
+                uint64_t count = 0;
+                ssize_t n = ::read(dispatch_fd, &count, sizeof(count));
+                (void)n;
             }
             else if ((sockfd == pipefd[0]) && (events[i].events & EPOLLIN)) {
                 // 处理信号
@@ -206,10 +1030,6 @@ int main(int argc, char* argv[]) {
                 else {
                     for (int i = 0; i < ret; ++i) {
                         switch (signals[i]) {
-                        case SIGALRM:
-                            // 用timeout标记有定时任务需要处理，但不立即处理定时任务
-                            timeout = true;
-                            break;
                         case SIGTERM:
                             stop_server = true;
                         }
@@ -218,54 +1038,127 @@ int main(int argc, char* argv[]) {
             }
             else if (events[i].events & EPOLLIN) {
                 // 通信文件描述符读缓冲区有数据
-                UtilTimer* timer = lst_users[sockfd].timer;
-                if (users[sockfd].read()) {
-                    int fd = sockfd;
-                    pool->Post([fd]()->void { users[fd].process(); });
+                Connection* conn = users[sockfd];
+                if (conn == NULL) {
+                    continue;
+                }
+                if (handoff_sock != -1 && handoffIdle(conn)) {
+                    // 移交期间不读取空闲连接上的新请求，数据留在内核缓冲区中交给新进程
+                    continue;
+                }
+                conn->claim();
+                UtilTimer* timer = lst_users[sockfd]->timer;
+                if (conn->read()) {
+                    // 请求先进入公平调度队列；线程池的窗口还有空位时立即投递，窗口满时留在队列中按 DRR 等待
+                    if (!submitRequest(sockfd, conn)) {
+                        continue;
+                    }
+                    dispatchPending(pool);
 
-                    // 成功读取数据，更新定时器
+                    // 成功读取数据，更新定时器（延长超时时间是 O(1) 的）
                     if (timer) {
-                        time_t cur = time(NULL);
-                        timer->expire = cur + 3 * TIMESLOT;
-                        timer_lst.adjustTimer(timer);
+                        timer_wheel.adjustTimer(timer, TimerWheel::nowMs() + CONNECTION_TIMEOUT_MS);
                     }
                 }
                 else {
-                    // 客户端关闭连接，移除定时器
-                    if (timer) {
-                        timer_lst.delTimer(timer);
-                    }
-                    users[sockfd].closeConnection();
+                    // 客户端关闭连接，移除定时器，回收连接对象
+                    releaseConnection(sockfd);
                 }
             }
             else if (events[i].events & EPOLLOUT) {
-                if (!users[sockfd].write()) {
+                Connection* conn = users[sockfd];
+                if (conn == NULL) {
+                    continue;
+                }
+                conn->claim();
+                if (!conn->write()) {
                     // 如果客户端的 keep-alive = false，只写一次 HTTP 响应
-                    users[sockfd].closeConnection();
+                    releaseConnection(sockfd);
                 }
             }
         }
 
+        // 工作线程腾出了窗口，或者有等待令牌到期的请求，按 DRR 继续投递
+        if (fair_queue.pending() > 0) {
+            dispatchPending(pool);
+        }
+
         // 处理定时事件，I/O有更高优先级
         if (timeout) {
-            timerHandler();
+            timer_wheel.tick();
             timeout = false;
+
+            // 有 WebSocket 连接时时间轮中一定有定时器，推送跟随时间轮的 tick
+            uint64_t now = TimerWheel::nowMs();
+            if (config.ws_push_interval_ms > 0 && now >= next_push_ms && handoff_sock == -1) {
+                pushStats();
+                next_push_ms = now + config.ws_push_interval_ms;
+            }
+
+            // 没有连接时时间轮停止，调整随之暂停；恢复后的第一次调整把这段空闲时间也算进利用率
+            if (now >= next_adjust_ms) {
+                size_t before = pool->Active();
+                size_t after = pool->Adjust();
+                if (after != before) {
+                    printf("worker pool: %zu -> %zu active (queue wait %llu us, utilization %u%%)\n", before, after,
+                        (unsigned long long)pool->AvgWaitUs(), pool->Utilization());
+                }
+                next_adjust_ms = now + POOL_ADJUST_MS;
+
+                fair_queue.collect(now);
+                global_server_stats.fair_clients.store(fair_queue.clients(), std::memory_order_relaxed);
+            }
+        }
+
+        // 热重启：处理中的请求都已完成，或者等待超时后线程池中的任务都已完成
+        if (handoff_sock != -1 && (handoffDrained() || TimerWheel::nowMs() >= handoff_deadline_ms)) {
+            if (!quiesceWorkers()) {
+                printf("hot restart: requests still running after %d ms\n", HANDOFF_DRAIN_MS + HANDOFF_QUIESCE_MS);
+                abortHandoff(listen_fds);
+            }
+            else if (finishHandoff(listen_fds)) {
+                stop_server = true;
+            }
+            else {
+                abortHandoff(listen_fds);
+            }
         }
     }
 
+    // 线程池对象，先等待工作线程退出，再回收连接对象
+    delete pool;
+
+    // 工作任务对象和定时器用户信息对象
+    for (int fd = 0; fd < MAX_FD; ++fd) {
+        releaseConnection(fd);
+    }
+
     close(epoll_fd);
     close(listen_fd);
+    if (resp_listen_fd != -1) {
+        close(resp_listen_fd);
+    }
+    if (binary_listen_fd != -1) {
+        close(binary_listen_fd);
+    }
+    if (unix_listen_fd != -1) {
+        close(unix_listen_fd);
+        if (!handed_off) {
+            unlink(config.unix_path);
+        }
+    }
+    if (handoff_sock != -1) {
+        close(handoff_sock);
+    }
+    if (handoff_listen_fd != -1) {
+        close(handoff_listen_fd);
+        if (!handed_off) {
+            unlink(config.handoff_path);
+        }
+    }
     close(pipefd[1]);
     close(pipefd[0]);
-
-    // 工作任务对象
-    delete[] users;
-
-    // 定时器用户信息对象
-    delete[] lst_users;
-
-    // 线程池对象
-    delete pool;
+    close(dispatch_fd);
 
     destroy_kvengine();
 
@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <stdarg.h>
+#include "resp_connection.h"
+
+RespConnection::RespConnection() : Connection(), m_proto(2), m_close_after_write(false) {
+
+}
+
+RespConnection::~RespConnection() {
+
+}
+
+void RespConnection::init() {
+    this->m_proto = 2;
+    this->m_close_after_write = false;
+    this->bytes_to_send = 0;
+    this->bytes_have_send = 0;
+    this->m_read_buf.clear();
+    this->m_write_buf.clear();
+}
+
+bool RespConnection::onWriteComplete() {
+    return !this->m_close_after_write;
+}
+
+// 移交给新进程的连接保留 HELLO 协商的协议版本
+int RespConnection::protocolState() const {
+    return this->m_close_after_write ? -1 : this->m_proto;
+}
+
+void RespConnection::restoreState(int state) {
+    if (state == 2 || state == 3) {
+        this->m_proto = state;
+    }
+}
+
+// 按第一条命令的命令名分类：引擎的 GET/EXIST 和连接相关的命令为读，其余为写
+int RespConnection::requestLane() const {
+    const char* p = NULL;
+    size_t len = this->peekRead(&p);
+    if (len == 0) {
+        return LANE_WRITE;
+    }
+    const char* end = p + len;
+    const char* name = p;
+    if (*p == '*') {
+        // *N\r\n$len\r\nNAME\r\n
+        const char* line = (const char*)memchr(p, '\n', len);
+        if (line == NULL || line + 1 >= end || line[1] != '$') {
+            return LANE_WRITE;
+        }
+        line = (const char*)memchr(line + 1, '\n', end - line - 1);
+        if (line == NULL) {
+            return LANE_WRITE;
+        }
+        name = line + 1;
+    }
+    const char* name_end = name;
+    while (name_end < end && *name_end != ' ' && *name_end != '\r' && *name_end != '\n') {
+        ++name_end;
+    }
+    if (name_end == end) {
+        return LANE_WRITE;
+    }
+
+    static const char* const cheap[] = { "PING", "ECHO", "HELLO", "COMMAND", "SELECT", "QUIT", "EXISTS" };
+    size_t name_len = name_end - name;
+    for (size_t i = 0; i < sizeof(cheap) / sizeof(cheap[0]); ++i) {
+        if (strlen(cheap[i]) == name_len && strncasecmp(name, cheap[i], name_len) == 0) {
+            return LANE_READ;
+        }
+    }
+    int cmd_type = kvs_command_lookup_n(name, name_len);
+    if (cmd_type >= 0 && (kvs_command_op(cmd_type) == KVS_OP_GET || kvs_command_op(cmd_type) == KVS_OP_EXIST)) {
+        return LANE_READ;
+    }
+    return LANE_WRITE;
+}
+
+// *N\r\n$len\r\nNAME\r\n$len\r\nKEY\r\n 中的 KEY，内联命令为第二个单词
+bool RespConnection::routingKey(const char** key, size_t* len) const {
+    const char* p = NULL;
+    size_t n = this->peekRead(&p);
+    if (n == 0) {
+        return false;
+    }
+    const char* end = p + n;
+    if (*p != '*') {
+        const char* k = (const char*)memchr(p, ' ', n);
+        if (k == NULL) {
+            return false;
+        }
+        while (k < end && *k == ' ') {
+            ++k;
+        }
+        const char* k_end = k;
+        while (k_end < end && *k_end != ' ' && *k_end != '\r' && *k_end != '\n') {
+            ++k_end;
+        }
+        if (k_end == end || k_end == k) {
+            return false;
+        }
+        *key = k;
+        *len = k_end - k;
+        return true;
+    }
+
+    // 跳过数组头和命令名的长度行、命令名，停在 key 的长度行
+    const char* line = p;
+    for (int i = 0; i < 3; ++i) {
+        line = (const char*)memchr(line, '\n', end - line);
+        if (line == NULL || ++line >= end) {
+            return false;
+        }
+    }
+    if (*line != '$') {
+        return false;
+    }
+    size_t key_len = 0;
+    const char* digit = line + 1;
+    while (digit < end && *digit >= '0' && *digit <= '9' && key_len < 65536) {
+        key_len = key_len * 10 + (*digit - '0');
+        ++digit;
+    }
+    if (end - digit < 2 || digit[0] != '\r' || digit[1] != '\n' || (size_t)(end - digit - 2) < key_len) {
+        return false;
+    }
+    *key = digit + 2;
+    *len = key_len;
+    return true;
+}
+
+#define ECHO_NAME_MAX 128       // 错误回复中回显的命令名的最大长度
+
+/*
+    错误回复中回显客户端给出的命令名：最多 ECHO_NAME_MAX 字节，不可打印的字节（包括 \r\n）换成空格，
+    避免客户端在 -ERR 行中注入其他回复，打乱流水线中后续命令的回复
+    out 至少 ECHO_NAME_MAX + 1 字节
+*/
+static const char* printableName(const char* name, int len, char* out) {
+    int n = len < ECHO_NAME_MAX ? len : ECHO_NAME_MAX;
+    for (int i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)name[i];
+        out[i] = (c >= 0x20 && c < 0x7f) ? (char)c : ' ';
+    }
+    out[n] = '\0';
+    return out;
+}
+
+// 解析 [p, end) 中以 \r\n 结尾的十进制整数，成功时 next 指向 \r\n 之后
+static RespConnection::PARSE_RESULT parseLineNumber(char* p, char* end, long long* value, char** next) {
+    char* cr = (char*)memchr(p, '\r', end - p);
+    if (cr == NULL || cr + 1 >= end) {
+        // 数字行最长 20 多个字符，超过还没有 \r\n 就是协议错误
+        return (end - p > 32) ? RespConnection::PARSE_ERROR : RespConnection::PARSE_INCOMPLETE;
+    }
+    if (cr[1] != '\n' || cr == p) {
+        return RespConnection::PARSE_ERROR;
+    }
+
+    long long v = 0;
+    bool negative = false;
+    char* q = p;
+    if (*q == '-') {
+        negative = true;
+        ++q;
+    }
+    if (q == cr) {
+        return RespConnection::PARSE_ERROR;
+    }
+    for (; q < cr; ++q) {
+        if (*q < '0' || *q > '9' || v > (1LL << 40)) {
+            return RespConnection::PARSE_ERROR;
+        }
+        v = v * 10 + (*q - '0');
+    }
+    *value = negative ? -v : v;
+    *next = cr + 2;
+    return RespConnection::PARSE_OK;
+}
+
+// 多条批量命令：*<参数个数>\r\n，每个参数为 $<长度>\r\n<数据>\r\n
+RespConnection::PARSE_RESULT RespConnection::parseMultiBulk(char* p, char* end, Command* cmd, char** next,
+    size_t* need) {
+    char* start = p;
+    long long count = 0;
+    *need = 0;
+
+    PARSE_RESULT ret = parseLineNumber(p + 1, end, &count, &p);
+    if (ret != PARSE_OK) {
+        return ret;
+    }
+    if (count > MAX_MULTIBULK) {
+        return PARSE_ERROR;
+    }
+
+    cmd->argc = 0;
+    for (long long i = 0; i < count; ++i) {
+        if (p >= end) {
+            return PARSE_INCOMPLETE;
+        }
+        if (*p != '$') {
+            return PARSE_ERROR;
+        }
+
+        long long len = 0;
+        ret = parseLineNumber(p + 1, end, &len, &p);
+        if (ret != PARSE_OK) {
+            return ret;
+        }
+        if (len < 0 || len > MAX_REQUEST_SIZE) {
+            return PARSE_ERROR;
+        }
+
+        if (end - p < len + 2) {
+            // 参数的长度已知，让调用者一次预留足够的连续空间，避免大值分多次到达时反复搬移
+            *need = (p - start) + len + 2;
+            return PARSE_INCOMPLETE;
+        }
+        if (p[len] != '\r' || p[len + 1] != '\n') {
+            return PARSE_ERROR;
+        }
+
+        if (cmd->argc < MAX_ARGS) {
+            cmd->argv[cmd->argc] = p;
+            cmd->argl[cmd->argc] = (int)len;
+            ++cmd->argc;
+        }
+        p += len + 2;
+    }
+
+    // 命令完整之后才修改读缓冲区：用 \r 的位置存放字符串结束符
+    for (int i = 0; i < cmd->argc; ++i) {
+        cmd->argv[i][cmd->argl[i]] = '\0';
+    }
+    *next = p;
+    return PARSE_OK;
+}
+
+// 内联命令：一行以空白分隔的参数，例如 telnet 中输入的 "PING\r\n"
+RespConnection::PARSE_RESULT RespConnection::parseInline(char* p, char* end, Command* cmd, char** next) {
+    char* lf = (char*)memchr(p, '\n', end - p);
+    if (lf == NULL) {
+        return (end - p > MAX_INLINE_SIZE) ? PARSE_ERROR : PARSE_INCOMPLETE;
+    }
+
+    char* line_end = (lf > p && lf[-1] == '\r') ? lf - 1 : lf;
+    cmd->argc = 0;
+    char* q = p;
+    while (q < line_end) {
+        while (q < line_end && (*q == ' ' || *q == '\t')) {
+            ++q;
+        }
+        if (q >= line_end) {
+            break;
+        }
+        char* arg = q;
+        while (q < line_end && *q != ' ' && *q != '\t') {
+            ++q;
+        }
+        if (cmd->argc < MAX_ARGS) {
+            cmd->argv[cmd->argc] = arg;
+            cmd->argl[cmd->argc] = (int)(q - arg);
+            ++cmd->argc;
+        }
+    }
+
+    for (int i = 0; i < cmd->argc; ++i) {
+        cmd->argv[i][cmd->argl[i]] = '\0';
+    }
+    *next = lf + 1;
+    return PARSE_OK;
+}
+
+void RespConnection::addSimple(const char* str) {
+    this->m_write_buf.appendFormat("+%s\r\n", str);
+}
+
+void RespConnection::addError(const char* format, ...) {
+    va_list arg_list;
+    va_start(arg_list, format);
+    this->m_write_buf.append("-", 1);
+    this->m_write_buf.vappendFormat(format, arg_list);
+    this->m_write_buf.append("\r\n", 2);
+    va_end(arg_list);
+}
+
+void RespConnection::addInteger(long long value) {
+    this->m_write_buf.appendFormat(":%lld\r\n", value);
+}
+
+void RespConnection::addBulk(const char* data, size_t len) {
+    this->m_write_buf.appendFormat("$%zu\r\n", len);
+    this->m_write_buf.append(data, len);
+    this->m_write_buf.append("\r\n", 2);
+}
+
+void RespConnection::addNull() {
+    if (this->m_proto >= 3) {
+        this->m_write_buf.append("_\r\n", 3);
+    }
+    else {
+        this->m_write_buf.append("$-1\r\n", 5);
+    }
+}
+
+void RespConnection::addArrayHeader(int count) {
+    this->m_write_buf.appendFormat("*%d\r\n", count);
+}
+
+// RESP2 没有 map 类型，回复键值交替的数组
+void RespConnection::addMapHeader(int count) {
+    if (this->m_proto >= 3) {
+        this->m_write_buf.appendFormat("%%%d\r\n", count);
+    }
+    else {
+        this->m_write_buf.appendFormat("*%d\r\n", count * 2);
+    }
+}
+
+// HELLO [protover]：切换协议版本，回复服务器信息
+void RespConnection::executeHello(Command* cmd) {
+    if (cmd->argc >= 2) {
+        int version = atoi(cmd->argv[1]);
+        if (version != 2 && version != 3) {
+            this->addError("NOPROTO unsupported protocol version");
+            return;
+        }
+        this->m_proto = version;
+    }
+
+    this->addMapHeader(6);
+    this->addBulk("server", 6);
+    this->addBulk("kv-webserver", 12);
+    this->addBulk("version", 7);
+    this->addBulk("1.0.0", 5);
+    this->addBulk("proto", 5);
+    this->addInteger(this->m_proto);
+    this->addBulk("id", 2);
+    this->addInteger(this->m_sockfd);
+    this->addBulk("mode", 4);
+    this->addBulk("standalone", 10);
+    this->addBulk("role", 4);
+    this->addBulk("master", 6);
+}
+
+/*
+    执行 KV 命令
+    - 键和值按长度传给引擎，可以包含任意字节
+    - SET 与 Redis 一致，键已存在时覆盖
+    - GET 返回批量字符串，不存在时返回空值
+    - DEL/MOD/EXIST 返回 1 或 0
+*/
+void RespConnection::executeKvs(int cmd_type, Command* cmd) {
+    int op = kvs_command_op(cmd_type);
+    int expected = (op == KVS_OP_SET || op == KVS_OP_MOD) ? 3 : 2;
+    if (cmd->argc != expected) {
+        char name[ECHO_NAME_MAX + 1];
+        this->addError("ERR wrong number of arguments for '%s' command",
+            printableName(cmd->argv[0], cmd->argl[0], name));
+        return;
+    }
+
+    // 值在引擎的读锁内直接追加到写缓冲区，不需要先拷贝出来
+    auto on_value = [](const char* value, size_t len, void* arg) {
+        static_cast<RespConnection*>(arg)->addBulk(value, len);
+    };
+
+    const char* value = (expected == 3) ? cmd->argv[2] : NULL;
+    size_t value_len = (expected == 3) ? cmd->argl[2] : 0;
+    // SET 覆盖已有的键：查找和写入在引擎的同一次写操作中完成，中间不会插入其他线程的 DEL
+    int status = (op == KVS_OP_SET) ?
+        kvs_upsert(cmd_type, cmd->argv[1], cmd->argl[1], value, value_len) :
+        kvs_execute(cmd_type, cmd->argv[1], cmd->argl[1], value, value_len, on_value, this);
+
+    if (status < 0) {
+        this->addError("ERR invalid parameters");
+        return;
+    }
+    if (status == KVS_STATUS_FULL) {
+        this->addError("ERR storage full");
+        return;
+    }
+    if (status == KVS_STATUS_ERROR) {
+        this->addError("ERR engine error");
+        return;
+    }
+
+    switch (op) {
+    case KVS_OP_SET:
+        // KVS_STATUS_OK 为新插入，KVS_STATUS_EXIST 为覆盖了已有的值
+        this->addSimple("OK");
+        break;
+    case KVS_OP_GET:
+        if (status != KVS_STATUS_OK) {
+            this->addNull();
+        }
+        break;
+    default:
+        this->addInteger(status == KVS_STATUS_OK ? 1 : 0);
+        break;
+    }
+}
+
+// 执行一条命令，连接相关的命令在这里处理，其余交给 KV 引擎
+void RespConnection::execute(Command* cmd) {
+    if (cmd->argc == 0) {
+        return;
+    }
+
+    const char* name = cmd->argv[0];
+    if (strcasecmp(name, "PING") == 0) {
+        if (cmd->argc > 1) {
+            this->addBulk(cmd->argv[1], cmd->argl[1]);
+        }
+        else {
+            this->addSimple("PONG");
+        }
+    }
+    else if (strcasecmp(name, "ECHO") == 0) {
+        if (cmd->argc != 2) {
+            char echo[ECHO_NAME_MAX + 1];
+            this->addError("ERR wrong number of arguments for '%s' command", printableName(name, cmd->argl[0], echo));
+        }
+        else {
+            this->addBulk(cmd->argv[1], cmd->argl[1]);
+        }
+    }
+    else if (strcasecmp(name, "QUIT") == 0) {
+        this->addSimple("OK");
+        this->m_close_after_write = true;
+    }
+    else if (strcasecmp(name, "HELLO") == 0) {
+        this->executeHello(cmd);
+    }
+    else if (strcasecmp(name, "COMMAND") == 0) {
+        // redis-cli 启动时查询命令表，返回空数组即可
+        this->addArrayHeader(0);
+    }
+    else if (strcasecmp(name, "SELECT") == 0) {
+        if (cmd->argc == 2 && strcmp(cmd->argv[1], "0") == 0) {
+            this->addSimple("OK");
+        }
+        else {
+            this->addError("ERR DB index is out of range");
+        }
+    }
+    else {
+        // EXISTS 是 Redis 的命令名，等同于 EXIST
+        int cmd_type = strcasecmp(name, "EXISTS") == 0 ? KVS_CMD_EXIST : kvs_command_lookup_n(name, cmd->argl[0]);
+        if (cmd_type < 0) {
+            char echo[ECHO_NAME_MAX + 1];
+            this->addError("ERR unknown command '%s'", printableName(name, cmd->argl[0], echo));
+            return;
+        }
+        this->executeKvs(cmd_type, cmd);
+    }
+}
+
+// 服务器过载：流水线中的命令无法逐条回复，回复一个错误后关闭连接，客户端重连后重试
+void RespConnection::rejectOverloaded(int retry_after_s) {
+    this->m_read_buf.clear();
+    this->m_write_buf.clear();
+    this->addError("BUSY server overloaded, retry in %d seconds", retry_after_s);
+    this->m_close_after_write = true;
+    this->bytes_to_send = this->m_write_buf.size();
+}
+
+// 由线程池中的工作线程调用，处理读缓冲区中所有完整的命令
+void RespConnection::process() {
+    char* base = this->m_read_buf.linearize(1);
+    if (base == NULL) {
+        this->shutdownConnection();
+        return;
+    }
+
+    char* p = base;
+    char* end = base + this->m_read_buf.size();
+    size_t need = 0;
+    while (p < end && !this->m_close_after_write) {
+        Command cmd;
+        char* next = NULL;
+        PARSE_RESULT ret = (*p == '*') ? this->parseMultiBulk(p, end, &cmd, &next, &need)
+            : this->parseInline(p, end, &cmd, &next);
+        if (ret == PARSE_INCOMPLETE) {
+            break;
+        }
+        if (ret == PARSE_ERROR) {
+            this->addError("ERR Protocol error");
+            this->m_close_after_write = true;
+            p = end;
+            break;
+        }
+
+        this->execute(&cmd);
+        p = next;
+        need = 0;
+    }
+
+    this->m_read_buf.consume(p - base);
+    if (this->m_close_after_write) {
+        this->m_read_buf.clear();
+    }
+    else if (need > this->m_read_buf.size()) {
+        // 不完整的大参数：提前预留连续空间，后续数据直接读到后面
+        if (this->m_read_buf.linearize(need - this->m_read_buf.size() + 1) == NULL) {
+            this->shutdownConnection();
+            return;
+        }
+    }
+
+    if (this->m_write_buf.empty()) {
+        // 没有完整的命令，继续读取
+        this->rearm(EPOLLIN);
+        return;
+    }
+
+    this->bytes_to_send = this->m_write_buf.size();
+    this->flush();
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <sys/un.h>
+#include "server_config.h"
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s port_number [options]\n", prog);
+    printf("  --queue-capacity N       max queued requests before answering 503, rounded up to a power of two (default 4096)\n");
+    printf("  --queue-deadline-ms N    drop requests that waited longer than N ms in the queue, 0 = never (default 500)\n");
+    printf("  --retry-after N          Retry-After seconds sent with 503 responses (default 1)\n");
+    printf("  --cpu-affinity           pin the reactor and workers to cores and place memory by NUMA node\n");
+    printf("  --resp-port N            also serve the KV engines over the Redis protocol (RESP2/RESP3) on port N\n");
+    printf("  --binary-port N          also serve the KV engines over the length-prefixed binary protocol on port N\n");
+    printf("  --ws-push-interval-ms N  push engine stats to WebSocket clients every N ms, 0 = never (default 1000)\n");
+    printf("  --no-embed-stats         leave engine stats out of /api/kv responses (use /api/stats or the WebSocket push)\n");
+    printf("  --unix-socket PATH       also serve HTTP on a Unix domain socket at PATH, for clients on the same host\n");
+    printf("  --handoff PATH           hot restart: take over sockets, idle connections and data from the process\n");
+    printf("                           listening on PATH, then listen on PATH for the next restart\n");
+    printf("  --workers N              start with N worker threads, fixed unless --min-workers/--max-workers are given\n");
+    printf("                           (default: usable CPUs - 1 from the affinity mask and cgroup quota, adjusted at runtime)\n");
+    printf("  --min-workers N          lower bound when adjusting the worker count (default 1)\n");
+    printf("  --max-workers N          upper bound when adjusting the worker count (default: usable CPUs)\n");
+    printf("  --client-rate N          requests per second allowed per client IP, 0 = unlimited (default 0)\n");
+    printf("  --client-burst N         burst size of the per-client token bucket (default: same as --client-rate)\n");
+    printf("  --conn-rate N            requests per second allowed per connection, 0 = unlimited (default 0)\n");
+    printf("  --conn-burst N           burst size of the per-connection token bucket (default: same as --conn-rate)\n");
+    printf("  --throttle-delay-ms N    delay requests over the rate by up to N ms before answering 429 (default 1000)\n");
+    printf("  --lane-weights R,W,A     scheduling weights of the read, write and admin request lanes (default 8,2,1)\n");
+    printf("  --read-reserve N         extra in-flight reads allowed per worker once writes fill the window (default 4)\n");
+    printf("  --busy-poll-us N         low-latency mode: the reactor and idle workers spin for up to N us before blocking,\n");
+    printf("                           with SO_BUSY_POLL and epoll busy polling where supported, 0 = off (default 0)\n");
+    printf("  --partitions             shared-nothing mode: split the keyspace into one lock-free engine partition\n");
+    printf("                           per worker thread (fixed at the maximum worker count); requests are posted to\n");
+    printf("                           the owner of their first key, other commands are passed to their owner\n");
+}
+
+int parse_server_config(int argc, char* argv[], ServerConfig* config) {
+    config->port = 0;
+    config->queue_capacity = 4096;
+    config->queue_deadline_ms = 500;
+    config->retry_after_s = 1;
+    config->cpu_affinity = false;
+    config->resp_port = 0;
+    config->binary_port = 0;
+    config->ws_push_interval_ms = 1000;
+    config->embed_stats = true;
+    config->unix_path = NULL;
+    config->handoff_path = NULL;
+    config->workers = 0;
+    config->min_workers = 0;
+    config->max_workers = 0;
+    config->client_rate = 0;
+    config->client_burst = 0;
+    config->conn_rate = 0;
+    config->conn_burst = 0;
+    config->throttle_delay_ms = 1000;
+    config->lane_weights[0] = 8;
+    config->lane_weights[1] = 2;
+    config->lane_weights[2] = 1;
+    config->read_reserve = 4;
+    config->busy_poll_us = 0;
+    config->partitions = false;
+    bool lane_weights_ok = true;
+
+    enum {
+        OPT_QUEUE_CAPACITY = 256,
+        OPT_QUEUE_DEADLINE,
+        OPT_RETRY_AFTER,
+        OPT_CPU_AFFINITY,
+        OPT_RESP_PORT,
+        OPT_BINARY_PORT,
+        OPT_WS_PUSH_INTERVAL,
+        OPT_NO_EMBED_STATS,
+        OPT_UNIX_SOCKET,
+        OPT_HANDOFF,
+        OPT_WORKERS,
+        OPT_MIN_WORKERS,
+        OPT_MAX_WORKERS,
+        OPT_CLIENT_RATE,
+        OPT_CLIENT_BURST,
+        OPT_CONN_RATE,
+        OPT_CONN_BURST,
+        OPT_THROTTLE_DELAY,
+        OPT_LANE_WEIGHTS,
+        OPT_READ_RESERVE,
+        OPT_BUSY_POLL,
+        OPT_PARTITIONS,
+    };
+
+    static const struct option long_options[] = {
+        { "queue-capacity", required_argument, NULL, OPT_QUEUE_CAPACITY },
+        { "queue-deadline-ms", required_argument, NULL, OPT_QUEUE_DEADLINE },
+        { "retry-after", required_argument, NULL, OPT_RETRY_AFTER },
+        { "cpu-affinity", no_argument, NULL, OPT_CPU_AFFINITY },
+        { "resp-port", required_argument, NULL, OPT_RESP_PORT },
+        { "binary-port", required_argument, NULL, OPT_BINARY_PORT },
+        { "ws-push-interval-ms", required_argument, NULL, OPT_WS_PUSH_INTERVAL },
+        { "no-embed-stats", no_argument, NULL, OPT_NO_EMBED_STATS },
+        { "unix-socket", required_argument, NULL, OPT_UNIX_SOCKET },
+        { "handoff", required_argument, NULL, OPT_HANDOFF },
+        { "workers", required_argument, NULL, OPT_WORKERS },
+        { "min-workers", required_argument, NULL, OPT_MIN_WORKERS },
+        { "max-workers", required_argument, NULL, OPT_MAX_WORKERS },
+        { "client-rate", required_argument, NULL, OPT_CLIENT_RATE },
+        { "client-burst", required_argument, NULL, OPT_CLIENT_BURST },
+        { "conn-rate", required_argument, NULL, OPT_CONN_RATE },
+        { "conn-burst", required_argument, NULL, OPT_CONN_BURST },
+        { "throttle-delay-ms", required_argument, NULL, OPT_THROTTLE_DELAY },
+        { "lane-weights", required_argument, NULL, OPT_LANE_WEIGHTS },
+        { "read-reserve", required_argument, NULL, OPT_READ_RESERVE },
+        { "busy-poll-us", required_argument, NULL, OPT_BUSY_POLL },
+        { "partitions", no_argument, NULL, OPT_PARTITIONS },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case OPT_QUEUE_CAPACITY:
+            config->queue_capacity = strtoul(optarg, NULL, 10);
+            break;
+        case OPT_QUEUE_DEADLINE:
+            config->queue_deadline_ms = atoi(optarg);
+            break;
+        case OPT_RETRY_AFTER:
+            config->retry_after_s = atoi(optarg);
+            break;
+        case OPT_CPU_AFFINITY:
+            config->cpu_affinity = true;
+            break;
+        case OPT_RESP_PORT:
+            config->resp_port = atoi(optarg);
+            break;
+        case OPT_BINARY_PORT:
+            config->binary_port = atoi(optarg);
+            break;
+        case OPT_WS_PUSH_INTERVAL:
+            config->ws_push_interval_ms = atoi(optarg);
+            break;
+        case OPT_NO_EMBED_STATS:
+            config->embed_stats = false;
+            break;
+        case OPT_UNIX_SOCKET:
+            config->unix_path = optarg;
+            break;
+        case OPT_HANDOFF:
+            config->handoff_path = optarg;
+            break;
+        case OPT_WORKERS:
+            config->workers = atoi(optarg);
+            break;
+        case OPT_MIN_WORKERS:
+            config->min_workers = atoi(optarg);
+            break;
+        case OPT_MAX_WORKERS:
+            config->max_workers = atoi(optarg);
+            break;
+        case OPT_CLIENT_RATE:
+            config->client_rate = atoi(optarg);
+            break;
+        case OPT_CLIENT_BURST:
+            config->client_burst = atoi(optarg);
+            break;
+        case OPT_CONN_RATE:
+            config->conn_rate = atoi(optarg);
+            break;
+        case OPT_CONN_BURST:
+            config->conn_burst = atoi(optarg);
+            break;
+        case OPT_THROTTLE_DELAY:
+            config->throttle_delay_ms = atoi(optarg);
+            break;
+        case OPT_LANE_WEIGHTS: {
+            int n = 0;
+            lane_weights_ok = sscanf(optarg, "%d,%d,%d%n", &config->lane_weights[0], &config->lane_weights[1],
+                &config->lane_weights[2], &n) == 3 && optarg[n] == '\0';
+            break;
+        }
+        case OPT_READ_RESERVE:
+            config->read_reserve = atoi(optarg);
+            break;
+        case OPT_BUSY_POLL:
+            config->busy_poll_us = atoi(optarg);
+            break;
+        case OPT_PARTITIONS:
+            config->partitions = true;
+            break;
+        default:
+            print_usage(basename(argv[0]));
+            return -1;
+        }
+    }
+
+    // 剩余的位置参数是端口号
+    if (optind >= argc) {
+        print_usage(basename(argv[0]));
+        return -1;
+    }
+    config->port = atoi(argv[optind]);
+
+    size_t max_path = sizeof(((sockaddr_un*)0)->sun_path);
+    if (config->port <= 0 || config->queue_capacity == 0 ||
+        config->queue_deadline_ms < 0 || config->retry_after_s < 0 ||
+        config->resp_port < 0 || config->resp_port == config->port ||
+        config->binary_port < 0 || config->binary_port == config->port ||
+        (config->binary_port > 0 && config->binary_port == config->resp_port) ||
+        config->ws_push_interval_ms < 0 ||
+        (config->unix_path != NULL && (config->unix_path[0] == '\0' || strlen(config->unix_path) >= max_path)) ||
+        (config->handoff_path != NULL && (config->handoff_path[0] == '\0' || strlen(config->handoff_path) >= max_path)) ||
+        (config->unix_path != NULL && config->handoff_path != NULL && strcmp(config->unix_path, config->handoff_path) == 0) ||
+        config->workers < 0 || config->workers > MAX_WORKERS ||
+        config->min_workers < 0 || config->max_workers < 0 || config->max_workers > MAX_WORKERS ||
+        (config->max_workers > 0 && config->min_workers > config->max_workers) ||
+        config->client_rate < 0 || config->client_burst < 0 || config->conn_rate < 0 || config->conn_burst < 0 ||
+        config->throttle_delay_ms < 0 || config->throttle_delay_ms > 60000 ||
+        !lane_weights_ok || config->lane_weights[0] < 0 || config->lane_weights[1] < 0 || config->lane_weights[2] < 0 ||
+        config->lane_weights[0] > 1000 || config->lane_weights[1] > 1000 || config->lane_weights[2] > 1000 ||
+        config->lane_weights[0] + config->lane_weights[1] + config->lane_weights[2] == 0 ||
+        config->read_reserve < 0 || config->read_reserve > 1024 ||
+        config->busy_poll_us < 0 || config->busy_poll_us > 1000000) {
+        print_usage(basename(argv[0]));
+        return -1;
+    }
+
+    return 0;
+}
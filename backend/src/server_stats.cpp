@@ -0,0 +1,56 @@
+#include "server_stats.h"
+#include "threadpool.h"
+#include "kvs_handler.h"
+
+ServerStats global_server_stats = {};
+
+int server_stats_json(ChainBuffer* response) {
+    if (response == NULL) {
+        return -1;
+    }
+
+    const ThreadPool* pool = global_server_stats.pool;
+    unsigned long long partition_local = 0;
+    unsigned long long partition_forwarded = 0;
+    int partitions = kvs_partition_stats(&partition_local, &partition_forwarded);
+    size_t before = response->size();
+    bool ret = response->appendFormat(
+        "{\"status\":\"OK\",\"data\":{"
+        "\"queue\":{\"depth\":%zu,\"capacity\":%zu,\"deadline_ms\":%d,"
+        "\"posted\":%llu,\"shed\":%llu,\"expired\":%llu},"
+        "\"workers\":{\"count\":%zu,\"min\":%zu,\"max\":%zu,\"utilization\":%u,\"queue_wait_us\":%llu,"
+        "\"stolen\":%llu},"
+        "\"scheduler\":{\"pending\":%zu,\"clients\":%zu,\"throttled\":%llu,\"throttle_delay_ms\":%llu,"
+        "\"rate_limited\":%llu,"
+        "\"lanes\":{\"read\":{\"pending\":%zu,\"dispatched\":%llu},\"write\":{\"pending\":%zu,\"dispatched\":%llu},"
+        "\"admin\":{\"pending\":%zu,\"dispatched\":%llu}}},"
+        "\"partitions\":{\"count\":%d,\"local\":%llu,\"forwarded\":%llu}"
+        "}}",
+        pool != NULL ? pool->QueueDepth() : 0,
+        global_server_stats.queue_capacity,
+        global_server_stats.queue_deadline_ms,
+        global_server_stats.tasks_posted.load(std::memory_order_relaxed),
+        global_server_stats.tasks_shed.load(std::memory_order_relaxed),
+        global_server_stats.tasks_expired.load(std::memory_order_relaxed),
+        pool != NULL ? pool->Active() : 0,
+        pool != NULL ? pool->MinActive() : 0,
+        pool != NULL ? pool->Size() : 0,
+        pool != NULL ? pool->Utilization() : 0,
+        pool != NULL ? (unsigned long long)pool->AvgWaitUs() : 0ULL,
+        global_server_stats.tasks_stolen.load(std::memory_order_relaxed),
+        global_server_stats.fair_pending.load(std::memory_order_relaxed),
+        global_server_stats.fair_clients.load(std::memory_order_relaxed),
+        global_server_stats.throttled.load(std::memory_order_relaxed),
+        global_server_stats.throttle_delay_ms.load(std::memory_order_relaxed),
+        global_server_stats.rate_limited.load(std::memory_order_relaxed),
+        global_server_stats.lane_pending[0].load(std::memory_order_relaxed),
+        global_server_stats.lane_dispatched[0].load(std::memory_order_relaxed),
+        global_server_stats.lane_pending[1].load(std::memory_order_relaxed),
+        global_server_stats.lane_dispatched[1].load(std::memory_order_relaxed),
+        global_server_stats.lane_pending[2].load(std::memory_order_relaxed),
+        global_server_stats.lane_dispatched[2].load(std::memory_order_relaxed),
+        partitions, partition_local, partition_forwarded
+    );
+
+    return ret ? static_cast<int>(response->size() - before) : -1;
+}
@@ -1,40 +1,374 @@
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include "threadpool.h"
-#include "blockingqueue.h"
+#include "mpmcqueue.h"
+#include "server_stats.h"
 #include<memory>
 
+static const int IDLE_SPIN_ROUNDS = 64;        // 睡眠之前的窃取轮数
+static const uint64_t GROW_WAIT_US = 1000;     // 平均排队时间超过它时启用一个线程
+static const uint64_t SHRINK_WAIT_US = 100;    // 平均排队时间低于它时才考虑停用线程
+static const unsigned GROW_UTILIZATION = 85;   // 利用率（百分比）超过它时启用一个线程
+static const unsigned SHRINK_UTILIZATION = 50; // 少一个线程时利用率不超过它才停用线程
+
+static thread_local int t_worker_index = -1;            // 当前线程的编号
+
+struct alignas(64) ThreadPool::WorkerSlot {
+    MpmcQueue<PoolTask> urgent;             // 主线程投递的紧急任务
+    MpmcQueue<PoolTask> inbox;              // 主线程投递的任务
+    std::atomic<int> futex;                 // futex 等待字，每次唤醒加一
+    std::atomic<bool> sleeping;             // 是否正在睡眠（或准备睡眠）
+    std::atomic<bool> mail;                 // 有 Notify() 还没有处理
+    uint32_t rand_state;                    // 选择窃取对象的随机数状态，只被本线程使用
+    // 以下计数只被本线程写入，Adjust() 读取
+    std::atomic<uint64_t> busy_ns;          // 执行任务的累计时间
+    std::atomic<uint64_t> wait_us;          // 执行的任务在队列中等待的累计时间
+    std::atomic<uint64_t> tasks;            // 执行的任务数
+
+    WorkerSlot(size_t inbox_capacity, uint32_t seed)
+        : urgent(inbox_capacity), inbox(inbox_capacity), futex(0), sleeping(false), mail(false), rand_state(seed),
+        busy_ns(0), wait_us(0), tasks(0) {}
+
+    void Wake() {
+        futex.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, reinterpret_cast<int*>(&futex), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+};
+
+// 单调时钟的当前时间（纳秒）
+static inline uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline uint64_t monotonicUs() {
+    return monotonicNs() / 1000;
+}
+
+// 只有本线程写入的计数器，不需要原子的读-改-写
+static inline void addCounter(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// xorshift 随机数
+static inline uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
 // 初始化线程池
-ThreadPool::ThreadPool(size_t threads_num) {
-    m_task_queue = std::make_unique<BlockingQueuePro<std::function<void()>>>();
-    for (size_t i = 0;i < threads_num;++i) {
+ThreadPool::ThreadPool(size_t threads_num, TaskHandler handler, size_t queue_capacity, int deadline_ms,
+    WorkerInit init, size_t min_threads, size_t max_threads)
+    : m_handler(handler), m_init(init), m_mail(NULL), m_deadline_ms(deadline_ms > 0 ? deadline_ms : 0),
+    m_next(0), m_idle(0), m_stop(false), m_active(0), m_min_active(0), m_last_adjust_ns(monotonicNs()),
+    m_last_busy_ns(0), m_last_wait_us(0), m_last_tasks(0), m_utilization(0), m_avg_wait_us(0), m_spin_us(0),
+    m_steal(true), m_exited(0) {
+    if (threads_num == 0) {
+        threads_num = 1;
+    }
+    if (min_threads == 0 || min_threads > threads_num) {
+        min_threads = threads_num;
+    }
+    if (max_threads < threads_num) {
+        max_threads = threads_num;
+    }
+    m_min_active = min_threads;
+    m_active.store(threads_num, std::memory_order_relaxed);
+
+    // 按上限创建所有线程，停用的线程的收件箱在主线程投递时作为溢出的去处，总容量不随 active 变化
+    size_t per_worker = (queue_capacity + max_threads - 1) / max_threads;
+    for (size_t i = 0; i < max_threads; ++i) {
+        m_workers.emplace_back(new WorkerSlot(per_worker, 2654435761u * (i + 1)));
+    }
+    m_inbox_capacity = m_workers[0]->inbox.Capacity();
+
+    global_server_stats.pool = this;
+    global_server_stats.queue_capacity = QueueCapacity();
+    global_server_stats.queue_deadline_ms = deadline_ms;
+
+    for (size_t i = 0;i < max_threads;++i) {
         // 创建线程，基于Cpp
-        m_threads.emplace_back([this]()-> void {Worker();});
+        m_threads.emplace_back([this, i]()-> void {Worker(i);});
+    }
+}
+
+// 检查排队期限并执行任务
+void ThreadPool::Run(const PoolTask& task) {
+    uint64_t start = monotonicNs();
+    uint64_t waited = start / 1000 - task.enqueue_us;
+
+    // 排队超过期限的任务不再执行，客户端大概率已经超时，执行只会进一步拖慢后面的请求
+    bool expired = m_deadline_ms > 0 && waited > m_deadline_ms * 1000;
+    if (expired) {
+        global_server_stats.tasks_expired.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_handler(task, expired);
+
+    WorkerSlot& self = *m_workers[t_worker_index];
+    addCounter(self.busy_ns, monotonicNs() - start);
+    addCounter(self.wait_us, waited);
+    addCounter(self.tasks, 1);
+}
+
+// 随机选择起点，依次尝试其他工作线程：先偷紧急任务，再偷收件箱中的任务
+bool ThreadPool::TrySteal(size_t index, PoolTask& task) {
+    size_t n = m_workers.size();
+    if (n <= 1) {
+        return false;
     }
+
+    size_t start = nextRandom(m_workers[index]->rand_state) % n;
+    for (size_t k = 0; k < n; ++k) {
+        size_t victim = (start + k) % n;
+        if (victim == index) {
+            continue;
+        }
+        WorkerSlot& slot = *m_workers[victim];
+        if (slot.urgent.TryPop(task) || slot.inbox.TryPop(task)) {
+            global_server_stats.tasks_stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
 }
 
-// 线程逻辑函数，从工作队列中取出任务
-void ThreadPool::Worker() {
+// 有 Notify() 时调用处理函数
+void ThreadPool::HandleMail(size_t index) {
+    WorkerSlot& self = *m_workers[index];
+    if (self.mail.load(std::memory_order_relaxed) && self.mail.exchange(false, std::memory_order_acquire)) {
+        MailHandler mail = m_mail.load(std::memory_order_acquire);
+        if (mail != NULL) {
+            mail(index);
+        }
+    }
+}
+
+// 线程逻辑函数，优先处理自己的队列，空闲时窃取其他线程的任务
+void ThreadPool::Worker(size_t index) {
+    t_worker_index = (int)index;
+    if (m_init != NULL) {
+        m_init(index);
+    }
+    WorkerSlot& self = *m_workers[index];
+    int spin_rounds = std::thread::hardware_concurrency() > 1 ? IDLE_SPIN_ROUNDS : 1;
+
     while (1) {
-        std::function<void()> task;
-        if (!m_task_queue->Pop(task)) {
-            break;
+        PoolTask task;
+        HandleMail(index);
+
+        // 紧急任务优先，其次是主线程投递的普通任务
+        if (self.urgent.TryPop(task) || self.inbox.TryPop(task)) {
+            Run(task);
+            continue;
+        }
+
+        // 停用的线程不窃取，自己的队列空了就睡眠
+        bool parked = index >= m_active.load(std::memory_order_acquire);
+        bool steal = m_steal.load(std::memory_order_relaxed);
+        bool found = false;
+        for (int i = 0; i < spin_rounds && !found && !parked && steal; ++i) {
+            found = TrySteal(index, task);
+            if (!found) {
+                CpuRelax();
+            }
+        }
+
+        // 低延迟模式：继续自旋到期限，期间投递的任务不需要 futex 唤醒
+        unsigned spin_us = spin_rounds > 1 ? m_spin_us.load(std::memory_order_relaxed) : 0;
+        if (!found && !parked && spin_us > 0) {
+            uint64_t deadline = monotonicUs() + spin_us;
+            while (!found && !m_stop.load(std::memory_order_relaxed) && monotonicUs() < deadline) {
+                found = self.urgent.TryPop(task) || self.inbox.TryPop(task) ||
+                    (steal && TrySteal(index, task));
+                if (!found) {
+                    CpuRelax();
+                }
+            }
+        }
+        if (found) {
+            Run(task);
+            continue;
+        }
+
+        // 先登记为睡眠状态，再读取 futex 值并重新检查队列，避免丢失唤醒
+        // 停用的线程也登记 sleeping（溢出到它收件箱的任务要唤醒它），但不计入 m_idle
+        self.sleeping.store(true, std::memory_order_seq_cst);
+        if (!parked) {
+            m_idle.fetch_add(1, std::memory_order_seq_cst);
+        }
+        int futex_val = self.futex.load(std::memory_order_seq_cst);
+        bool has_work = self.urgent.Size() > 0 || self.inbox.Size() > 0 ||
+            self.mail.load(std::memory_order_seq_cst);
+        bool stop = m_stop.load(std::memory_order_acquire);
+        bool activated = parked && index < m_active.load(std::memory_order_seq_cst);
+        if (!has_work && !stop && !activated) {
+            syscall(SYS_futex, reinterpret_cast<int*>(&self.futex), FUTEX_WAIT_PRIVATE, futex_val, NULL, NULL, 0);
+        }
+        if (!parked) {
+            m_idle.fetch_sub(1, std::memory_order_relaxed);
+        }
+        self.sleeping.store(false, std::memory_order_relaxed);
+
+        if (stop && !has_work) {
+            break;      // 线程池销毁，自己的队列已经处理完
+        }
+    }
+
+    // 其他线程还在执行最后的任务，期间发给本线程的消息继续处理，所有线程都处理完之后才退出
+    m_exited.fetch_add(1, std::memory_order_seq_cst);
+    while (m_exited.load(std::memory_order_seq_cst) < m_workers.size()) {
+        HandleMail(index);
+        std::this_thread::yield();
+    }
+
+    t_worker_index = -1;
+}
+
+// 唤醒一个睡眠的工作线程去窃取任务
+void ThreadPool::WakeIdle(size_t except) {
+    if (m_idle.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    size_t active = m_active.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < active; ++i) {
+        if (i != except && m_workers[i]->sleeping.load(std::memory_order_relaxed)) {
+            m_workers[i]->Wake();
+            return;
         }
-        task();
     }
 }
 
 // 向工作队列中加入任务
-void ThreadPool::Post(std::function<void()> task) {
-    m_task_queue->Push(task);
+bool ThreadPool::Post(int fd, int opcode, int worker, bool urgent) {
+    PoolTask task = { fd, opcode, monotonicUs() };
+    size_t n = m_workers.size();
+    size_t active = m_active.load(std::memory_order_relaxed);
+    size_t target = (worker >= 0 && (size_t)worker < active) ?
+        (size_t)worker : m_next.fetch_add(1, std::memory_order_relaxed) % active;
+
+    // 目标线程的收件箱满了就改投其他线程（最后才轮到停用的线程），放弃缓存亲和性，总比拒绝请求好
+    for (size_t k = 0; k < n; ++k) {
+        size_t i = k < active ? (target + k) % active : k;
+        WorkerSlot& slot = *m_workers[i];
+        MpmcQueue<PoolTask>& queue = urgent ? slot.urgent : slot.inbox;
+        if (!queue.TryPush(task)) {
+            continue;
+        }
+        global_server_stats.tasks_posted.fetch_add(1, std::memory_order_relaxed);
+
+        // 与 Worker() 中登记睡眠状态配对：要么这里看到它在睡眠，要么它睡眠前能看到这个任务
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (slot.sleeping.load(std::memory_order_relaxed)) {
+            slot.Wake();
+        }
+        else {
+            // 目标线程正忙，让空闲的线程来窃取
+            WakeIdle(i);
+        }
+        return true;
+    }
+
+    global_server_stats.tasks_shed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+// 通知工作线程处理消息
+void ThreadPool::Notify(size_t index) {
+    if (index >= m_workers.size()) {
+        return;
+    }
+    WorkerSlot& slot = *m_workers[index];
+    if (slot.mail.exchange(true, std::memory_order_seq_cst)) {
+        return;     // 上一次通知还没有处理，线程醒着或者即将被唤醒
+    }
+    // 与 Worker() 中登记睡眠状态配对，同 Post()
+    if (slot.sleeping.load(std::memory_order_seq_cst)) {
+        slot.Wake();
+    }
+}
+
+// 修改参与调度的线程数量
+void ThreadPool::SetActive(size_t n) {
+    size_t old = m_active.exchange(n, std::memory_order_seq_cst);
+    // 与 Worker() 中的 activated 检查配对：要么它睡眠前看到新的 active，要么这里的唤醒让它醒来
+    for (size_t i = old; i < n; ++i) {
+        m_workers[i]->Wake();
+    }
+}
+
+// 按上一个周期的排队时间和利用率增减一个线程
+size_t ThreadPool::Adjust() {
+    uint64_t now = monotonicNs();
+    uint64_t busy = 0;
+    uint64_t wait = 0;
+    uint64_t tasks = 0;
+    for (const auto& slot : m_workers) {
+        busy += slot->busy_ns.load(std::memory_order_relaxed);
+        wait += slot->wait_us.load(std::memory_order_relaxed);
+        tasks += slot->tasks.load(std::memory_order_relaxed);
+    }
+    uint64_t elapsed = now - m_last_adjust_ns;
+    uint64_t busy_delta = busy - m_last_busy_ns;
+    uint64_t wait_delta = wait - m_last_wait_us;
+    uint64_t tasks_delta = tasks - m_last_tasks;
+    m_last_adjust_ns = now;
+    m_last_busy_ns = busy;
+    m_last_wait_us = wait;
+    m_last_tasks = tasks;
+
+    size_t active = m_active.load(std::memory_order_relaxed);
+    if (elapsed == 0) {
+        return active;
+    }
+    // 停用的线程处理剩余任务的时间也算在内，利用率可能略高于 100%
+    unsigned utilization = (unsigned)(busy_delta * 100 / (elapsed * active));
+    uint64_t avg_wait = tasks_delta > 0 ? wait_delta / tasks_delta : 0;
+    m_utilization.store(utilization, std::memory_order_relaxed);
+    m_avg_wait_us.store(avg_wait, std::memory_order_relaxed);
+
+    if (active < m_workers.size() && (avg_wait > GROW_WAIT_US || utilization > GROW_UTILIZATION)) {
+        SetActive(active + 1);
+    }
+    else if (active > m_min_active && avg_wait < SHRINK_WAIT_US &&
+        busy_delta * 100 <= elapsed * (active - 1) * SHRINK_UTILIZATION) {
+        SetActive(active - 1);
+    }
+    return m_active.load(std::memory_order_relaxed);
+}
+
+int ThreadPool::CurrentWorker() {
+    return t_worker_index;
+}
+
+size_t ThreadPool::QueueDepth() const {
+    size_t depth = 0;
+    for (const auto& slot : m_workers) {
+        depth += slot->urgent.Size() + slot->inbox.Size();
+    }
+    return depth;
 }
 
 // 销毁线程池
 ThreadPool::~ThreadPool() {
 
-    m_task_queue->Cancel();
+    m_stop.store(true, std::memory_order_release);
+    for (auto& slot : m_workers) {
+        slot->Wake();   // 通知睡眠的所有线程退出
+    }
 
     for (auto& thread : m_threads) {
         if (thread.joinable()) {
             thread.join();  // 主线程等待子线程执行结束，让OS回收子线程资源
         }
     }
-}
\ No newline at end of file
+
+    if (global_server_stats.pool == this) {
+        global_server_stats.pool = NULL;
+    }
+}
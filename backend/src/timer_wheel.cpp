@@ -0,0 +1,214 @@
+#include <unistd.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include "timer_wheel.h"
+
+// 超时时间（毫秒）向上取整到 tick
+static inline uint64_t toTick(uint64_t ms) {
+    return (ms + TimerWheel::TICK_MS - 1) / TimerWheel::TICK_MS;
+}
+
+// 初始化槽位的哨兵节点
+static inline void initSlot(UtilTimer* slot) {
+    slot->prev = slot;
+    slot->next = slot;
+}
+
+uint64_t TimerWheel::nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+TimerWheel::TimerWheel() : m_current(0), m_count(0), m_timer_fd(-1) {
+    for (int i = 0; i < ROOT_SIZE; ++i) {
+        initSlot(&this->m_root[i]);
+    }
+    for (int l = 0; l < LEVELS; ++l) {
+        for (int i = 0; i < LEVEL_SIZE; ++i) {
+            initSlot(&this->m_levels[l][i]);
+        }
+    }
+    this->m_current = nowMs() / TICK_MS;
+}
+
+// 时间轮被销毁时，定时器节点随节点池一起释放
+TimerWheel::~TimerWheel() {
+    if (this->m_timer_fd != -1) {
+        close(this->m_timer_fd);
+    }
+}
+
+int TimerWheel::init() {
+    this->m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    return this->m_timer_fd;
+}
+
+void TimerWheel::armTimerFd(bool enable) {
+    if (this->m_timer_fd == -1) {
+        return;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (enable) {
+        spec.it_value.tv_sec = TICK_MS / 1000;
+        spec.it_value.tv_nsec = (TICK_MS % 1000) * 1000000;
+        spec.it_interval = spec.it_value;
+    }
+    timerfd_settime(this->m_timer_fd, 0, &spec, NULL);
+}
+
+UtilTimer* TimerWheel::createTimer() {
+    return this->m_pool.create();
+}
+
+// 根据超时时间与当前 tick 的距离，挂到第 0 层或者上面某一层的槽中
+void TimerWheel::link(UtilTimer* timer) {
+    uint64_t expires = toTick(timer->expire);
+    if (expires < this->m_current) {
+        // 已经超时，放到下一个要处理的槽中
+        expires = this->m_current;
+    }
+
+    uint64_t delta = expires - this->m_current;
+    UtilTimer* slot = NULL;
+    if (delta < static_cast<uint64_t>(ROOT_SIZE)) {
+        slot = &this->m_root[expires & (ROOT_SIZE - 1)];
+    }
+    else {
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (1ULL << (ROOT_BITS + (level + 1) * LEVEL_BITS))) {
+            ++level;
+        }
+        if (delta >= (1ULL << (ROOT_BITS + LEVELS * LEVEL_BITS))) {
+            // 超出时间轮的范围，放到最高层能表示的最远位置，cascade 时会再次分配
+            expires = this->m_current + (1ULL << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+        }
+        slot = &this->m_levels[level][(expires >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1)];
+    }
+
+    // 插入到槽位链表的尾部
+    timer->next = slot;
+    timer->prev = slot->prev;
+    slot->prev->next = timer;
+    slot->prev = timer;
+}
+
+void TimerWheel::unlink(UtilTimer* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;   // 取下的结点指针指向置 NULL，防止野指针的出现
+}
+
+// 将目标定时器 Timer 添加到时间轮中
+void TimerWheel::addTimer(UtilTimer* timer) {
+    if (timer == NULL) {
+        return;
+    }
+
+    if (this->m_count == 0) {
+        // 时间轮为空时 timerfd 是停止的，当前 tick 可能已经落后，直接对齐到现在
+        this->m_current = nowMs() / TICK_MS;
+        this->armTimerFd(true);
+    }
+
+    this->link(timer);
+    ++this->m_count;
+}
+
+void TimerWheel::adjustTimer(UtilTimer* timer, uint64_t expire) {
+    if (timer == NULL) {
+        return;
+    }
+
+    if (expire >= timer->expire) {
+        // 超时时间延长，惰性调整，所在的槽到期时再重新分配
+        timer->expire = expire;
+        return;
+    }
+
+    this->unlink(timer);
+    timer->expire = expire;
+    this->link(timer);
+}
+
+// 将目标定时器 timer 从时间轮中删除
+void TimerWheel::delTimer(UtilTimer* timer) {
+    if (timer == NULL) {
+        return;
+    }
+
+    this->unlink(timer);
+    this->m_pool.destroy(timer);
+    if (--this->m_count == 0) {
+        this->armTimerFd(false);
+    }
+}
+
+// 把第 level 层（从第 1 层开始计数）的 index 号槽中的定时器取下，重新挂到下层
+int TimerWheel::cascade(int level, int index) {
+    UtilTimer* slot = &this->m_levels[level][index];
+    UtilTimer* timer = slot->next;
+    initSlot(slot);
+
+    while (timer != slot) {
+        UtilTimer* next = timer->next;
+        this->link(timer);
+        timer = next;
+    }
+    return index;
+}
+
+/*
+    处理从上一次 tick 到现在之间的每一个 tick：
+    第 0 层转完一圈时先 cascade，再处理第 0 层当前槽中的定时器
+*/
+void TimerWheel::tick() {
+    uint64_t now = nowMs() / TICK_MS;
+
+    while (this->m_current <= now && this->m_count > 0) {
+        int index = this->m_current & (ROOT_SIZE - 1);
+        if (index == 0) {
+            for (int l = 0; l < LEVELS; ++l) {
+                int level_index = (this->m_current >> (ROOT_BITS + l * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+                if (this->cascade(l, level_index) != 0) {
+                    break;
+                }
+            }
+        }
+
+        // 先把当前槽整体摘下来，回调函数和重新挂载都不会影响正在遍历的链表
+        UtilTimer pending;
+        UtilTimer* slot = &this->m_root[index];
+        initSlot(&pending);
+        if (slot->next != slot) {
+            pending.next = slot->next;
+            pending.prev = slot->prev;
+            pending.next->prev = &pending;
+            pending.prev->next = &pending;
+            initSlot(slot);
+        }
+
+        uint64_t expired_tick = this->m_current++;
+        while (pending.next != &pending) {
+            UtilTimer* timer = pending.next;
+            this->unlink(timer);
+
+            if (toTick(timer->expire) > expired_tick) {
+                // 超时时间被延长过，重新挂到新的槽上
+                this->link(timer);
+                continue;
+            }
+
+            // 调用定时器的回调函数，以执行定时任务，然后归还定时器节点
+            timer->cb_func(timer->user_data);
+            this->m_pool.destroy(timer);
+            --this->m_count;
+        }
+    }
+
+    if (this->m_count == 0) {
+        this->armTimerFd(false);
+    }
+}
@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "topology.h"
+
+// 解析 cpulist 格式（例如 "0-3,8-11"），把其中允许运行的 CPU 加入拓扑
+static void add_cpulist(Topology* topo, const char* list, int node, const cpu_set_t* allowed) {
+    const char* p = list;
+    while (*p != '\0' && *p != '\n') {
+        char* end = NULL;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        if (*p == ',') {
+            ++p;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu) {
+            if (cpu < 0 || cpu >= TOPOLOGY_MAX_CPUS || topo->cpu_count >= TOPOLOGY_MAX_CPUS) {
+                continue;
+            }
+            if (!CPU_ISSET(cpu, allowed)) {
+                continue;
+            }
+            topo->cpus[topo->cpu_count++] = (int)cpu;
+            topo->cpu_node[cpu] = node;
+            if (node < TOPOLOGY_MAX_NODES && !(topo->node_mask & (1UL << node))) {
+                topo->node_mask |= 1UL << node;
+                ++topo->node_count;
+            }
+        }
+    }
+}
+
+int topology_detect(Topology* topo) {
+    if (topo == NULL) {
+        return -1;
+    }
+    memset(topo, 0, sizeof(Topology));
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+
+    // 按节点读取 CPU 列表
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; ++node) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* fp = fopen(path, "r");
+        if (fp == NULL) {
+            continue;
+        }
+        char line[4096];
+        if (fgets(line, sizeof(line), fp) != NULL) {
+            add_cpulist(topo, line, node, &allowed);
+        }
+        fclose(fp);
+    }
+
+    // 没有 NUMA 信息，所有允许运行的 CPU 都属于节点 0
+    if (topo->cpu_count == 0) {
+        for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                topo->cpus[topo->cpu_count++] = cpu;
+            }
+        }
+        topo->node_count = 1;
+        topo->node_mask = 1UL;
+    }
+
+    return topo->cpu_count > 0 ? 0 : -1;
+}
+
+int topology_cpu_for_slot(const Topology* topo, int slot) {
+    if (topo == NULL || topo->cpu_count == 0 || slot < 0) {
+        return -1;
+    }
+    return topo->cpus[slot % topo->cpu_count];
+}
+
+int topology_node_of_cpu(const Topology* topo, int cpu) {
+    if (topo == NULL || cpu < 0 || cpu >= TOPOLOGY_MAX_CPUS) {
+        return 0;
+    }
+    return topo->cpu_node[cpu];
+}
+
+int topology_pin_thread(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int topology_prefer_node(int node) {
+    if (node < 0 || node >= TOPOLOGY_MAX_NODES) {
+        return -1;
+    }
+    unsigned long mask = 1UL << node;
+    // glibc 没有封装 NUMA 内存策略的系统调用，直接调用，不依赖 libnuma
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int topology_interleave(const Topology* topo, void* addr, size_t len) {
+    if (topo == NULL || addr == NULL || len == 0) {
+        return -1;
+    }
+    if (topo->node_count <= 1) {
+        return 0;
+    }
+
+    // mbind 要求起始地址按页对齐
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(page - 1);
+    size_t length = (uintptr_t)addr + len - start;
+
+    unsigned long mask = topo->node_mask;
+    if (syscall(SYS_mbind, start, length, MPOL_INTERLEAVE, &mask, sizeof(mask) * 8, MPOL_MF_MOVE) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// 读取 cgroup v2 的 cpu.max（"max 100000" 或者 "150000 100000"），没有配额时返回 0
+static double read_cpu_max(const char* dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max", dir);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char quota[32];
+    unsigned long period = 0;
+    int n = fscanf(fp, "%31s %lu", quota, &period);
+    fclose(fp);
+    if (n != 2 || period == 0 || strcmp(quota, "max") == 0) {
+        return 0;
+    }
+    return strtod(quota, NULL) / period;
+}
+
+// cgroup v2：配额由进程所在的 cgroup 和它的所有上级共同限制，取最小值
+static double cgroup_v2_quota(void) {
+    FILE* fp = fopen("/proc/self/cgroup", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char line[512];
+    char dir[512] = "";
+    bool found = false;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        // v2 的条目为 "0::/path"
+        if (strncmp(line, "0::", 3) == 0) {
+            snprintf(dir, sizeof(dir), "%s", line + 3);
+            dir[strcspn(dir, "\n")] = '\0';
+            found = true;
+            break;
+        }
+    }
+    fclose(fp);
+    if (!found) {
+        return 0;
+    }
+
+    double limit = 0;
+    while (true) {
+        double quota = read_cpu_max(strcmp(dir, "/") == 0 ? "" : dir);
+        if (quota > 0 && (limit == 0 || quota < limit)) {
+            limit = quota;
+        }
+        char* slash = strrchr(dir, '/');
+        if (slash == NULL || slash == dir) {
+            if (dir[0] != '\0' && strcmp(dir, "/") != 0) {
+                strcpy(dir, "/");       // 最后检查根 cgroup（容器中通常就是容器自己的 cgroup）
+                continue;
+            }
+            break;
+        }
+        *slash = '\0';
+    }
+    return limit;
+}
+
+// cgroup v1：quota 为 -1 表示不限制
+static double cgroup_v1_quota(void) {
+    static const char* const dirs[] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); ++i) {
+        char path[128];
+        long quota = 0;
+        long period = 0;
+        snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dirs[i]);
+        FILE* fp = fopen(path, "r");
+        if (fp == NULL) {
+            continue;
+        }
+        int n = fscanf(fp, "%ld", &quota);
+        fclose(fp);
+        snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dirs[i]);
+        fp = fopen(path, "r");
+        if (fp == NULL) {
+            continue;
+        }
+        n += fscanf(fp, "%ld", &period);
+        fclose(fp);
+        if (n == 2 && quota > 0 && period > 0) {
+            return (double)quota / period;
+        }
+    }
+    return 0;
+}
+
+int topology_cpu_limit(double* quota) {
+    int cpus = 0;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        cpus = CPU_COUNT(&allowed);
+    }
+    if (cpus <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        cpus = online > 0 ? (int)online : 1;
+    }
+
+    double limit = cgroup_v2_quota();
+    if (limit == 0) {
+        limit = cgroup_v1_quota();
+    }
+    if (quota != NULL) {
+        *quota = limit;
+    }
+    if (limit > 0) {
+        int quota_cpus = (int)limit;
+        if (quota_cpus < limit) {
+            ++quota_cpus;       // 1.5 个 CPU 的配额可以让 2 个线程同时运行
+        }
+        if (quota_cpus < cpus) {
+            cpus = quota_cpus;
+        }
+    }
+    return cpus > 0 ? cpus : 1;
+}
@@ -0,0 +1,199 @@
+#include <stdint.h>
+#include <string.h>
+#include "websocket.h"
+
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+int ws_parse_frame(char* data, size_t len, size_t max_payload, ws_frame_t* frame, size_t* need) {
+    *need = 0;
+    if (len < 2) {
+        return 0;
+    }
+
+    const unsigned char* p = (const unsigned char*)data;
+    if (p[0] & 0x70) {
+        return -1;      // 没有协商扩展，RSV 位必须为 0
+    }
+    if (!(p[1] & 0x80)) {
+        return -1;      // 客户端的帧必须带掩码
+    }
+
+    frame->fin = (p[0] & 0x80) != 0;
+    frame->opcode = p[0] & 0x0F;
+
+    size_t header_len = 2;
+    uint64_t payload_len = p[1] & 0x7F;
+    if (payload_len == 126) {
+        header_len += 2;
+        if (len < header_len) {
+            return 0;
+        }
+        payload_len = ((uint64_t)p[2] << 8) | p[3];
+    }
+    else if (payload_len == 127) {
+        header_len += 8;
+        if (len < header_len) {
+            return 0;
+        }
+        payload_len = 0;
+        for (int i = 0; i < 8; ++i) {
+            payload_len = (payload_len << 8) | p[2 + i];
+        }
+    }
+
+    // 控制帧不能分片，负载不超过 125 字节
+    if ((frame->opcode & 0x08) && (!frame->fin || payload_len > WS_MAX_CONTROL_PAYLOAD)) {
+        return -1;
+    }
+    if (payload_len > max_payload) {
+        return -1;
+    }
+
+    const unsigned char* mask = p + header_len;
+    header_len += 4;
+    size_t total = header_len + (size_t)payload_len;
+    if (len < total) {
+        *need = total;
+        return 0;
+    }
+
+    frame->payload = data + header_len;
+    frame->payload_len = (size_t)payload_len;
+    frame->frame_len = total;
+
+    unsigned char* payload = (unsigned char*)frame->payload;
+    for (size_t i = 0; i < frame->payload_len; ++i) {
+        payload[i] ^= mask[i & 3];
+    }
+    return 1;
+}
+
+size_t ws_frame_header(char* out, int opcode, size_t payload_len) {
+    unsigned char* p = (unsigned char*)out;
+    p[0] = (unsigned char)(0x80 | (opcode & 0x0F));
+    if (payload_len < 126) {
+        p[1] = (unsigned char)payload_len;
+        return 2;
+    }
+    if (payload_len <= 0xFFFF) {
+        p[1] = 126;
+        p[2] = (unsigned char)(payload_len >> 8);
+        p[3] = (unsigned char)payload_len;
+        return 4;
+    }
+    p[1] = 127;
+    uint64_t n = payload_len;
+    for (int i = 7; i >= 0; --i) {
+        p[2 + i] = (unsigned char)n;
+        n >>= 8;
+    }
+    return 10;
+}
+
+// SHA-1，只用于握手，输入很短，不追求性能
+static uint32_t sha1_rol(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const unsigned char* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+            ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = sha1_rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = sha1_rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = sha1_rol(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+// data 不超过 119 字节（填充后最多两个块）
+static void sha1_short(const unsigned char* data, size_t len, unsigned char digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    unsigned char buf[128];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, data, len);
+    buf[len] = 0x80;
+
+    size_t blocks = (len + 9 + 63) / 64;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; ++i) {
+        buf[blocks * 64 - 1 - i] = (unsigned char)(bits >> (i * 8));
+    }
+    for (size_t i = 0; i < blocks; ++i) {
+        sha1_block(h, buf + i * 64);
+    }
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = (unsigned char)(h[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(h[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(h[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)h[i];
+    }
+}
+
+static size_t base64_encode(const unsigned char* data, size_t len, char* out) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t n = (uint32_t)data[i] << 16;
+        if (i + 1 < len) {
+            n |= (uint32_t)data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            n |= data[i + 2];
+        }
+        out[o++] = table[(n >> 18) & 0x3F];
+        out[o++] = table[(n >> 12) & 0x3F];
+        out[o++] = i + 1 < len ? table[(n >> 6) & 0x3F] : '=';
+        out[o++] = i + 2 < len ? table[n & 0x3F] : '=';
+    }
+    out[o] = '\0';
+    return o;
+}
+
+int ws_accept_key(const char* client_key, size_t key_len, char* out) {
+    // 客户端的 key 是 16 字节随机数的 base64 编码，固定 24 个字符
+    if (client_key == NULL || key_len != 24) {
+        return -1;
+    }
+
+    unsigned char input[64];
+    memcpy(input, client_key, key_len);
+    memcpy(input + key_len, WS_GUID, sizeof(WS_GUID) - 1);
+
+    unsigned char digest[20];
+    sha1_short(input, key_len + sizeof(WS_GUID) - 1, digest);
+    base64_encode(digest, sizeof(digest), out);
+    return 0;
+}
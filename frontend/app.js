@@ -2,11 +2,18 @@
 const API_BASE = '/kv/api';
 const KV_ENDPOINT = `${API_BASE}/kv`;
 const STATS_ENDPOINT = `${API_BASE}/stats`;
+const WS_ENDPOINT = `${location.protocol === 'https:' ? 'wss' : 'ws'}://${location.host}${API_BASE}/ws`;
+const WS_RECONNECT_MS = 3000;
+
+// WebSocket连接：命令和响应在同一个连接上按顺序对应，统计信息由服务器定时推送
+let socket = null;
+const pendingCommands = [];
 
 // 页面加载完成后初始化
 document.addEventListener('DOMContentLoaded', function () {
     // 初始加载统计信息
     loadStats();
+    connectSocket();
 
     // 监听回车键提交
     document.getElementById('command-input').addEventListener('keypress', function (e) {
@@ -30,6 +37,72 @@ async function loadStats() {
     }
 }
 
+// 建立WebSocket连接，断开后定时重连，期间命令退回到HTTP请求
+function connectSocket() {
+    if (!('WebSocket' in window)) {
+        return;
+    }
+
+    const ws = new WebSocket(WS_ENDPOINT);
+
+    ws.onopen = function () {
+        socket = ws;
+    };
+
+    ws.onmessage = function (event) {
+        let data;
+        try {
+            data = JSON.parse(event.data);
+        } catch (error) {
+            console.error('Invalid message:', error);
+            return;
+        }
+
+        // 服务器推送的统计信息
+        if (data.event === 'stats') {
+            if (data.status === 'OK' && data.data) {
+                updateStats(data.data);
+            }
+            return;
+        }
+
+        // 命令的响应，按发送顺序对应
+        const pending = pendingCommands.shift();
+        if (pending) {
+            pending.resolve(data);
+        }
+    };
+
+    ws.onclose = function () {
+        if (socket === ws) {
+            socket = null;
+        }
+        while (pendingCommands.length > 0) {
+            pendingCommands.shift().reject(new Error('WebSocket closed'));
+        }
+        setTimeout(connectSocket, WS_RECONNECT_MS);
+    };
+}
+
+// 发送命令：WebSocket可用时复用连接，否则发送POST请求
+async function sendCommand(requestData) {
+    if (socket && socket.readyState === WebSocket.OPEN) {
+        return new Promise(function (resolve, reject) {
+            pendingCommands.push({ resolve: resolve, reject: reject });
+            socket.send(JSON.stringify(requestData));
+        });
+    }
+
+    const response = await fetch(KV_ENDPOINT, {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/json',
+        },
+        body: JSON.stringify(requestData)
+    });
+    return response.json();
+}
+
 // 更新统计信息显示
 function updateStats(stats) {
     // 更新Array统计
@@ -95,16 +168,8 @@ async function submitCommand() {
         submitBtn.disabled = true;
         submitBtn.style.opacity = '0.5';
 
-        // 发送POST请求
-        const response = await fetch(KV_ENDPOINT, {
-            method: 'POST',
-            headers: {
-                'Content-Type': 'application/json',
-            },
-            body: JSON.stringify(requestData)
-        });
-
-        const data = await response.json();
+        // 发送命令
+        const data = await sendCommand(requestData);
 
         // 恢复按钮状态
         submitBtn.disabled = false;
@@ -116,8 +181,13 @@ async function submitCommand() {
         // 清空输入框
         input.value = '';
 
-        // 命令执行后刷新统计信息
-        loadStats();
+        // 响应中带有执行后的统计信息，不再单独请求
+        if (data.data && data.data.data) {
+            updateStats(data.data.data);
+        }
+        else {
+            loadStats();
+        }
 
     } catch (error) {
         console.error('Request failed:', error);
@@ -0,0 +1,75 @@
+#!/bin/bash
+# 对比低延迟模式（--busy-poll-us）开启和关闭时的请求延迟
+# 用法: scripts/bench-busy-poll.sh [BUSY_POLL_US] [REQUESTS] [GAP_US]
+#   依次以关闭和开启 busy poll 启动服务器，在一个 keep-alive 连接上逐个发送 GET /api/kv/hash/{key}，
+#   每个请求之间间隔 GAP_US 微秒（让工作线程有机会进入空闲），打印 p50/p99 往返延迟
+#   需要 python3；其余参数（例如 --cpu-affinity --workers 2）通过环境变量 SERVER_ARGS 传给服务器
+
+set -e
+
+# 切换到项目根目录
+cd "$(dirname "$0")/.."
+
+BUSY_POLL_US=${1:-50}
+REQUESTS=${2:-5000}
+GAP_US=${3:-200}
+PORT=${PORT:-9390}
+BIN=backend/bin/kv-webserver
+
+make -C backend >/dev/null
+
+run() {
+    ./${BIN} ${PORT} ${SERVER_ARGS} "$@" >/dev/null 2>&1 &
+    local pid=$!
+    trap "kill ${pid} 2>/dev/null" EXIT
+    sleep 0.5
+
+    python3 - "${PORT}" "${REQUESTS}" "${GAP_US}" <<'EOF'
+import json, socket, sys, time
+
+port, requests, gap_us = int(sys.argv[1]), int(sys.argv[2]), float(sys.argv[3])
+s = socket.create_connection(("127.0.0.1", port))
+s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+def roundtrip(req):
+    s.sendall(req)
+    data = b""
+    while True:
+        end = data.find(b"\r\n\r\n")
+        if end >= 0:
+            head = data[:end].lower()
+            i = head.find(b"content-length:")
+            length = int(head[i + 15:].split(b"\r\n")[0]) if i >= 0 else 0
+            if len(data) >= end + 4 + length:
+                return
+        data += s.recv(65536)
+
+body = json.dumps([{"cmd": "HSET", "key": "bench", "value": "x" * 64}]).encode()
+roundtrip(b"POST /api/kv HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\nContent-Type: application/json\r\n"
+    b"Content-Length: %d\r\n\r\n" % len(body) + body)
+
+req = b"GET /api/kv/hash/bench HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n"
+for _ in range(100):
+    roundtrip(req)
+lat = []
+for _ in range(requests):
+    start = time.perf_counter()
+    roundtrip(req)
+    lat.append((time.perf_counter() - start) * 1e6)
+    deadline = time.perf_counter() + gap_us / 1e6
+    while time.perf_counter() < deadline:
+        pass
+lat.sort()
+print("p50 %6.0f us   p99 %6.0f us" % (lat[len(lat) // 2], lat[len(lat) * 99 // 100]))
+EOF
+
+    kill ${pid} 2>/dev/null
+    wait ${pid} 2>/dev/null || true
+    trap - EXIT
+}
+
+echo "cpus: $(nproc), ${REQUESTS} requests, ${GAP_US} us apart"
+printf "busy poll off:        "
+run
+printf "busy poll %4d us:    " "${BUSY_POLL_US}"
+run --busy-poll-us "${BUSY_POLL_US}"